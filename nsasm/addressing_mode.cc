@@ -422,26 +422,6 @@ ErrorOr<AddressingMode> DeduceMode(Mnemonic m, SyntacticAddressingMode smode,
   return Error("Logic error: bad enum value?");
 }
 
-int InstructionLength(AddressingMode a) {
-  if (a == A_imp || a == A_acc) {
-    return 1;
-  }
-  if (a == A_imm_b || a == A_dir_b || a == A_dir_bx || a == A_dir_by ||
-      a == A_ind_b || a == A_ind_bx || a == A_ind_by || a == A_lng_b ||
-      a == A_lng_by || a == A_stk || a == A_stk_y || a == A_rel8) {
-    return 2;
-  }
-  if (a == A_imm_w || a == A_dir_w || a == A_dir_wx || a == A_dir_wy ||
-      a == A_ind_w || a == A_ind_wx || a == A_lng_w || a == A_mov ||
-      a == A_rel16) {
-    return 3;
-  }
-  if (a == A_dir_l || a == A_dir_lx) {
-    return 4;
-  }
-  return 0;
-}
-
 namespace {
 std::vector<AddressingMode>* MakeAllAddressingModes() {
   auto result = new std::vector<AddressingMode>;
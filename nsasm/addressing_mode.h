@@ -74,8 +74,26 @@ ErrorOr<AddressingMode> DeduceMode(Mnemonic m, SyntacticAddressingMode smode,
 
 // Returns the size of an instruction with the given addressing mode.
 //
-// Returns -1 on invalid input.
-int InstructionLength(AddressingMode a);
+// Returns 0 on invalid input (including the flag-dependent sentinel modes).
+constexpr int InstructionLength(AddressingMode a) {
+  if (a == A_imp || a == A_acc) {
+    return 1;
+  }
+  if (a == A_imm_b || a == A_dir_b || a == A_dir_bx || a == A_dir_by ||
+      a == A_ind_b || a == A_ind_bx || a == A_ind_by || a == A_lng_b ||
+      a == A_lng_by || a == A_stk || a == A_stk_y || a == A_rel8) {
+    return 2;
+  }
+  if (a == A_imm_w || a == A_dir_w || a == A_dir_wx || a == A_dir_wy ||
+      a == A_ind_w || a == A_ind_wx || a == A_lng_w || a == A_mov ||
+      a == A_rel16) {
+    return 3;
+  }
+  if (a == A_dir_l || a == A_dir_lx) {
+    return 4;
+  }
+  return 0;
+}
 
 // Returns the datatype of the first argument for the given addressing mode,
 // or T_unknown if this addressing mode does not take arguments.
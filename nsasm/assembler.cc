@@ -1,10 +1,71 @@
 #include "nsasm/assembler.h"
 
+#include <algorithm>
+#include <functional>
+#include <set>
+#include <utility>
+#include <vector>
+
 #include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
+#include "nsasm/module_cache.h"
 
 namespace nsasm {
 
+namespace {
+
+// Holds the writes made by a single module during the final pass, so that
+// modules can be assembled concurrently and then committed to the real sink in
+// a fixed order.
+class StagingSink : public OutputSink {
+ public:
+  ErrorOr<void> Write(nsasm::Address address,
+                      absl::Span<const std::uint8_t> data) override {
+    writes_.push_back(
+        {address, std::vector<uint8_t>(data.begin(), data.end()), location_});
+    return {};
+  }
+
+  void SetStatementLocation(const Location& location) override {
+    location_ = location;
+  }
+
+  // Replays every staged write, in the order it was made, into `sink`.  Errors
+  // are reported against the statement that made the write.
+  ErrorOr<void> Commit(OutputSink* sink) const {
+    for (const Staged& write : writes_) {
+      NSASM_RETURN_IF_ERROR_WITH_LOCATION(
+          sink->Write(write.address, write.data), write.location);
+    }
+    return {};
+  }
+
+ private:
+  struct Staged {
+    nsasm::Address address;
+    std::vector<uint8_t> data;
+    Location location;
+  };
+
+  std::vector<Staged> writes_;
+  Location location_;
+};
+
+// Calls `task(i)` for each i in [0, count), on `pool` if one is given.
+void ForEachIndex(int count, ThreadPool* pool,
+                  const std::function<void(int)>& task) {
+  if (pool) {
+    pool->ParallelFor(count, task);
+  } else {
+    for (int i = 0; i < count; ++i) {
+      task(i);
+    }
+  }
+}
+
+}  // namespace
+
 void Assembler::AddModule(Module&& module) {
   modules_.push_back(std::move(module));
 }
@@ -16,46 +77,156 @@ nsasm::ErrorOr<void> Assembler::AddAsmFile(const File& file) {
   return {};
 }
 
-nsasm::ErrorOr<std::vector<Module*>> Assembler::FindAssemblyOrder() {
-  std::vector<Module*> order;
+nsasm::ErrorOr<void> Assembler::AddAsmFiles(const std::vector<File>& files,
+                                            ThreadPool* pool,
+                                            const std::string& cache_dir) {
+  std::vector<absl::optional<ErrorOr<Module>>> modules(files.size());
+  ForEachIndex(files.size(), pool, [&files, &modules, &cache_dir](int i) {
+    if (cache_dir.empty()) {
+      modules[i].emplace(Module::LoadAsmFile(files[i]));
+    } else {
+      modules[i].emplace(CachedLoadAsmFile(cache_dir, files[i]));
+    }
+  });
+  for (const auto& module : modules) {
+    NSASM_RETURN_IF_ERROR(*module);
+  }
+  for (auto& module : modules) {
+    AddModule(**std::move(module));
+  }
+  return {};
+}
+
+namespace {
+
+// Returns a name for `module` suitable for error messages.
+std::string DescribeModule(const Module& module) {
+  if (!module.Name().empty()) {
+    return module.Name();
+  }
+  return module.Path();
+}
+
+}  // namespace
+
+nsasm::ErrorOr<void> Assembler::BuildDependencyGraph() {
+  ModuleDependencyGraph graph;
+  for (Module& module : modules_) {
+    graph.modules.push_back(&module);
+  }
+  const int count = graph.modules.size();
+  graph.dependencies.resize(count);
+  graph.dependents.resize(count);
 
-  absl::flat_hash_set<Module*> already_inserted;
+  // Map every exported name to the module that defines it.
+  absl::flat_hash_map<FullIdentifier, int> exporter;
   absl::flat_hash_map<FullIdentifier, Location> exported_names;
+  name_to_module_map_.clear();
+  for (int i = 0; i < count; ++i) {
+    for (const auto& node : graph.modules[i]->ExportedNames()) {
+      auto it = exported_names.find(node.first);
+      if (it != exported_names.end()) {
+        return Error(
+                   "Duplicate defintion of `%s` "
+                   "(conflicting definition at %s)",
+                   node.first.ToString(), node.second.ToString())
+            .SetLocation(it->second);
+      }
+      exported_names.emplace(node.first, node.second);
+      exporter[node.first] = i;
+      name_to_module_map_[node.first] = graph.modules[i];
+    }
+  }
 
-  while (order.size() < modules_.size()) {
-    bool more_found = false;
-    for (auto& module : modules_) {
-      if (already_inserted.contains(&module)) {
-        continue;
+  // Add an edge for every module whose .equ expressions read a name exported
+  // by another.
+  for (int i = 0; i < count; ++i) {
+    absl::flat_hash_set<int> seen;
+    for (const FullIdentifier& dependency :
+         graph.modules[i]->Dependencies()) {
+      auto it = exporter.find(dependency);
+      if (it == exporter.end()) {
+        return Error("No definition for `%s`, used in .equ expression",
+                     dependency.ToString())
+            .SetLocation(graph.modules[i]->Path());
       }
-      bool all_dependencies_met = true;
-      for (const FullIdentifier& dependency : module.Dependencies()) {
-        if (!exported_names.contains(dependency)) {
-          all_dependencies_met = false;
-          break;
+      const int target = it->second;
+      if (target != i && seen.insert(target).second) {
+        graph.dependencies[i].push_back(target);
+        graph.dependents[target].push_back(i);
+      }
+    }
+    std::sort(graph.dependencies[i].begin(), graph.dependencies[i].end());
+  }
+  for (auto& dependents : graph.dependents) {
+    std::sort(dependents.begin(), dependents.end());
+  }
+
+  // Topologically sort the modules by level.  Each level holds the modules
+  // whose dependencies all lie in earlier levels, in the order the modules
+  // were added.
+  std::vector<int> indegree(count);
+  std::vector<int> current;
+  for (int i = 0; i < count; ++i) {
+    indegree[i] = graph.dependencies[i].size();
+    if (indegree[i] == 0) {
+      current.push_back(i);
+    }
+  }
+  int placed = 0;
+  while (!current.empty()) {
+    std::vector<int> next;
+    for (int i : current) {
+      for (int dependent : graph.dependents[i]) {
+        if (--indegree[dependent] == 0) {
+          next.push_back(dependent);
         }
       }
-      if (all_dependencies_met) {
-        more_found = true;
-        order.push_back(&module);
-        already_inserted.insert(&module);
-        for (const auto& node : module.ExportedNames()) {
-          if (exported_names.contains(node.first)) {
-            return Error(
-                       "Duplicate defintion of `%s` "
-                       "(conflicting definition at %s)",
-                       node.first.ToString(), node.second.ToString())
-                .SetLocation(exported_names[node.first]);
-          }
-          exported_names[node.first] = node.second;
-          name_to_module_map_[node.first] = &module;
+    }
+    std::sort(next.begin(), next.end());
+    placed += current.size();
+    graph.levels.push_back(std::move(current));
+    current = std::move(next);
+  }
+
+  if (placed < count) {
+    // Every module left over depends on another module left over, so walking
+    // those dependencies from any of them must eventually repeat.
+    int start = 0;
+    while (indegree[start] == 0) {
+      ++start;
+    }
+    std::vector<int> chain;
+    absl::flat_hash_map<int, int> position;
+    int i = start;
+    while (!position.contains(i)) {
+      position[i] = chain.size();
+      chain.push_back(i);
+      for (int dependency : graph.dependencies[i]) {
+        if (indegree[dependency] > 0) {
+          i = dependency;
+          break;
         }
       }
     }
-    if (!more_found) {
-      // TODO: Return an error message explaining the cyclic dependency
-      return Error("Cyclic dependency in .equ definitions");
+    std::string description;
+    for (size_t j = position[i]; j < chain.size(); ++j) {
+      absl::StrAppend(&description, "`",
+                      DescribeModule(*graph.modules[chain[j]]), "` -> ");
     }
+    absl::StrAppend(&description, "`", DescribeModule(*graph.modules[i]), "`");
+    return Error("Cyclic dependency in .equ definitions: %s", description);
+  }
+
+  dependency_graph_ = std::move(graph);
+  return {};
+}
+
+nsasm::ErrorOr<std::vector<int>> Assembler::FindAssemblyOrder() {
+  NSASM_RETURN_IF_ERROR(BuildDependencyGraph());
+  std::vector<int> order;
+  for (const std::vector<int>& level : dependency_graph_.levels) {
+    order.insert(order.end(), level.begin(), level.end());
   }
   return order;
 }
@@ -78,36 +249,244 @@ class AssemblerLookupContext : public LookupContext {
     return v->ToInt();
   }
 
+  // Returns true if any of the names in `consumed` no longer has the value
+  // recorded for it.
+  bool AnyChanged(
+      const absl::flat_hash_map<FullIdentifier, int>& consumed) const {
+    for (const auto& node : consumed) {
+      auto value = Lookup(node.first);
+      if (!value.ok() || *value != node.second) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Records the current value of each of `names` that has one in `values`,
+  // replacing its previous contents.
+  void RecordValues(const std::set<FullIdentifier>& names,
+                    absl::flat_hash_map<FullIdentifier, int>* values) const {
+    values->clear();
+    for (const FullIdentifier& name : names) {
+      auto value = Lookup(name);
+      if (value.ok()) {
+        (*values)[name] = *value;
+      }
+    }
+  }
+
+ private:
+  const Assembler* assembler_;
+};
+
+// Binds names exported by other modules, recording each name bound.
+class AssemblerBindingContext : public BindingContext {
+ public:
+  AssemblerBindingContext(const Assembler* assembler,
+                          std::set<FullIdentifier>* names)
+      : assembler_(assembler), names_(names) {}
+
+  const ValueSlot* Bind(const FullIdentifier& id) const override {
+    names_->insert(id);
+    auto it = assembler_->name_to_module_map_.find(id);
+    if (it == assembler_->name_to_module_map_.end()) {
+      return nullptr;
+    }
+    return it->second->SlotForName(id);
+  }
+
  private:
   const Assembler* assembler_;
+  std::set<FullIdentifier>* names_;
 };
 
-nsasm::ErrorOr<void> Assembler::Assemble(OutputSink* sink) {
+void Assembler::BindModules(const std::vector<int>& modules,
+                            ThreadPool* pool) {
+  ForEachIndex(modules.size(), pool, [&](int i) {
+    std::set<FullIdentifier>& names = consumed_names_[modules[i]].names;
+    names.clear();
+    modules_[modules[i]].Bind(AssemblerBindingContext(this, &names));
+  });
+}
+
+nsasm::ErrorOr<void> Assembler::Assemble(OutputSink* sink, ThreadPool* pool) {
   auto module_order = FindAssemblyOrder();
   NSASM_RETURN_IF_ERROR(module_order);
+  const std::vector<int>& order = *module_order;
+  consumed_names_.assign(modules_.size(), ConsumedNames());
 
   // First pass: laying out code and finding the address of each instruction.
-  for (Module* module : *module_order) {
-    NSASM_RETURN_IF_ERROR(module->RunFirstPass());
+  // Each module's first pass only looks at its own lines, so these can run
+  // concurrently.  Errors are reported in module order.
+  std::vector<ErrorOr<void>> first_pass_results(order.size());
+  ForEachIndex(order.size(), pool, [&](int i) {
+    first_pass_results[i] = modules_[order[i]].RunFirstPass();
+  });
+  for (const auto& result : first_pass_results) {
+    NSASM_RETURN_IF_ERROR(result);
   }
 
+  // Every name now has a slot for its value, so resolve names to slots once,
+  // rather than looking them up on every evaluation.
+  BindModules(order, pool);
+
+  // Second pass: evaluating .equ expressions.  This stays serial, as .equ
+  // values may depend on those of earlier modules in the order.
   AssemblerLookupContext context(this);
+  for (int i : order) {
+    NSASM_RETURN_IF_ERROR(modules_[i].RunSecondPass(context));
+    context.RecordValues(modules_[i].Dependencies(),
+                         &consumed_names_[i].second_pass);
+  }
+
+  NSASM_RETURN_IF_ERROR(AssembleModules(order, sink, pool));
+  assembled_ = true;
+  return {};
+}
 
-  // Second pass: evaluating .equ expressions.
-  for (Module* module : *module_order) {
-    NSASM_RETURN_IF_ERROR(module->RunSecondPass(context));
+nsasm::ErrorOr<void> Assembler::Reassemble(const File& file,
+                                           const InputSource& original,
+                                           OutputSink* sink, ThreadPool* pool,
+                                           const std::string& cache_dir) {
+  if (!assembled_) {
+    return Error("logic error: Reassemble() called before Assemble()");
+  }
+  auto target = std::find_if(
+      modules_.begin(), modules_.end(),
+      [&file](const Module& module) { return module.Path() == file.path(); });
+  if (target == modules_.end()) {
+    return Error("No module was loaded from %s", file.path());
   }
+  const int changed = target - modules_.begin();
+
+  auto module = cache_dir.empty() ? Module::LoadAsmFile(file)
+                                  : CachedLoadAsmFile(cache_dir, file);
+  NSASM_RETURN_IF_ERROR(module);
+  NSASM_RETURN_IF_ERROR(module->RunFirstPass());
+
+  // Replace the module in place, so that pointers to modules stay valid.  From
+  // here on, a failure leaves the assembler partly updated.
+  assembled_ = false;
+  const Symbol old_name(target->Name());
+  const DataRange replaced_bytes = target->OwnedBytes();
+  *target = *std::move(module);
+  const Symbol new_name(target->Name());
+  consumed_names_[changed] = ConsumedNames();
+  auto module_order = FindAssemblyOrder();
+  NSASM_RETURN_IF_ERROR(module_order);
+  const std::vector<int>& order = *module_order;
 
-  // Final pass: assembly
-  for (Module* module : *module_order) {
-    NSASM_RETURN_IF_ERROR(module->Assemble(sink, context));
-    if (!memory_module_map_.Insert(module->OwnedBytes(), module)) {
-      // TODO: this could convey a lot more info...
-      return nsasm::Error("Module `%s` writing to previously claimed memory",
-                          module->Name());
+  // Bindings into the old module now dangle, so rebind the new module and
+  // every module that uses a name in its namespace.
+  std::vector<int> rebind;
+  for (int i : order) {
+    const std::set<FullIdentifier>& names = consumed_names_[i].names;
+    if (i == changed ||
+        std::any_of(names.begin(), names.end(),
+                    [old_name, new_name](const FullIdentifier& name) {
+                      return name.Module() == old_name ||
+                             name.Module() == new_name;
+                    })) {
+      rebind.push_back(i);
     }
   }
+  BindModules(rebind, pool);
 
+  // Re-evaluate .equ expressions in dependency order, so that each module's
+  // reads are checked against names that are already up to date.
+  AssemblerLookupContext context(this);
+  std::vector<bool> stale(modules_.size());
+  for (int i : order) {
+    ConsumedNames& consumed = consumed_names_[i];
+    if (i != changed && !context.AnyChanged(consumed.second_pass)) {
+      continue;
+    }
+    stale[i] = true;
+    NSASM_RETURN_IF_ERROR(modules_[i].RunSecondPass(context));
+    context.RecordValues(modules_[i].Dependencies(), &consumed.second_pass);
+  }
+
+  // Every value is now final, so reassemble the modules with new .equ values,
+  // along with any module whose instructions read a changed name.
+  // Note what each of them wrote last time, so that bytes a module no longer
+  // writes can be restored from the original.
+  std::vector<int> reassemble;
+  std::vector<DataRange> previous_bytes;
+  for (int i : order) {
+    if (stale[i] || context.AnyChanged(consumed_names_[i].final_pass)) {
+      reassemble.push_back(i);
+      previous_bytes.push_back(i == changed ? replaced_bytes
+                                            : modules_[i].OwnedBytes());
+    }
+  }
+  NSASM_RETURN_IF_ERROR(AssembleModules(reassemble, sink, pool));
+  NSASM_RETURN_IF_ERROR(RestoreReleasedBytes(previous_bytes, original, sink));
+  assembled_ = true;
+  return {};
+}
+
+nsasm::ErrorOr<void> Assembler::AssembleModules(const std::vector<int>& modules,
+                                                OutputSink* sink,
+                                                ThreadPool* pool) {
+  // Every label has a value by now, so modules only read each other's state
+  // here.  Assemble each into its own staging buffer, then commit the results
+  // in the order given.
+  std::vector<StagingSink> staged(modules.size());
+  std::vector<ErrorOr<void>> results(modules.size());
+  AssemblerLookupContext context(this);
+  ForEachIndex(modules.size(), pool, [&](int i) {
+    results[i] = modules_[modules[i]].Assemble(&staged[i], context);
+  });
+  for (const auto& result : results) {
+    NSASM_RETURN_IF_ERROR(result);
+  }
+  for (int i : modules) {
+    ConsumedNames& consumed = consumed_names_[i];
+    context.RecordValues(consumed.names, &consumed.final_pass);
+  }
+
+  // Check for overlapping output before anything is written.  Modules that
+  // were not reassembled keep their claims from the previous run.
+  RangeMap<Module*> memory_module_map;
+  for (const std::vector<int>& level : dependency_graph_.levels) {
+    for (int i : level) {
+      Module* module = &modules_[i];
+      if (!memory_module_map.Insert(module->OwnedBytes(), module)) {
+        // TODO: this could convey a lot more info...
+        return nsasm::Error("Module `%s` writing to previously claimed memory",
+                            module->Name());
+      }
+    }
+  }
+  memory_module_map_ = std::move(memory_module_map);
+
+  for (size_t i = 0; i < modules.size(); ++i) {
+    NSASM_RETURN_IF_ERROR(staged[i].Commit(sink));
+  }
+  return {};
+}
+
+nsasm::ErrorOr<void> Assembler::RestoreReleasedBytes(
+    const std::vector<DataRange>& previous_bytes, const InputSource& original,
+    OutputSink* sink) const {
+  for (const DataRange& range : previous_bytes) {
+    for (const Chunk& chunk : range.Chunks()) {
+      nsasm::Address address = chunk.first;
+      while (address < chunk.second) {
+        int length = 0;
+        while (address.AddUnwrapped(length) < chunk.second &&
+               !memory_module_map_.Contains(address.AddUnwrapped(length))) {
+          ++length;
+        }
+        if (length > 0) {
+          auto bytes = original.ReadView(address, length);
+          NSASM_RETURN_IF_ERROR(bytes);
+          NSASM_RETURN_IF_ERROR(sink->Write(address, *bytes));
+        }
+        address = address.AddUnwrapped(std::max(length, 1));
+      }
+    }
+  }
   return {};
 }
 
@@ -160,12 +539,11 @@ void Assembler::DebugPrint() const {
   }
 }
 
-ErrorOr<Assembler> Assemble(const std::vector<File>& files, OutputSink* sink) {
+ErrorOr<Assembler> Assemble(const std::vector<File>& files, OutputSink* sink,
+                            ThreadPool* pool) {
   Assembler a;
-  for (const File& file : files) {
-    NSASM_RETURN_IF_ERROR(a.AddAsmFile(file));
-  }
-  NSASM_RETURN_IF_ERROR(a.Assemble(sink));
+  NSASM_RETURN_IF_ERROR(a.AddAsmFiles(files, pool));
+  NSASM_RETURN_IF_ERROR(a.Assemble(sink, pool));
   return a;
 }
 
@@ -1,16 +1,41 @@
 #ifndef NSASM_ASSEMBLER_H
 #define NSASM_ASSEMBLER_H
 
+#include <set>
+#include <string>
+#include <vector>
+
 #include "absl/container/flat_hash_map.h"
 #include "nsasm/calling_convention.h"
 #include "nsasm/error.h"
+#include "nsasm/memory.h"
 #include "nsasm/module.h"
 #include "nsasm/ranges.h"
+#include "nsasm/thread_pool.h"
 
 namespace nsasm {
 
+class AssemblerBindingContext;
 class AssemblerLookupContext;
 
+// The graph of .equ dependencies between an assembler's modules.  Modules are
+// referred to by their index into `modules`.
+struct ModuleDependencyGraph {
+  // Every module, in the order it was added to the assembler.
+  std::vector<Module*> modules;
+
+  // dependencies[i] holds the modules whose exported names are read by .equ
+  // expressions in module i, and dependents[i] holds the modules that read
+  // names exported by module i.  Both are sorted and free of duplicates.
+  std::vector<std::vector<int>> dependencies;
+  std::vector<std::vector<int>> dependents;
+
+  // The modules grouped by dependency level.  Every dependency of a module in
+  // levels[n] is in an earlier level, so the modules within a level may be
+  // processed in any order, or concurrently.
+  std::vector<std::vector<int>> levels;
+};
+
 class Assembler {
  public:
   Assembler(const Assembler&) = delete;
@@ -22,10 +47,43 @@ class Assembler {
 
   ErrorOr<void> AddAsmFile(const File& file);
 
+  // As AddAsmFile(), for each of `files`.  Files are tokenized and parsed in
+  // parallel on `pool` if one is given, and the resulting modules are added
+  // in the order of `files`.  On failure, returns the error from the earliest
+  // file that failed to load, and adds no modules.
+  //
+  // If `cache_dir` is not empty, parsed modules are loaded from and saved to
+  // a module cache in that directory (see module_cache.h).
+  ErrorOr<void> AddAsmFiles(const std::vector<File>& files,
+                            ThreadPool* pool = nullptr,
+                            const std::string& cache_dir = "");
+
   // Assemble all modules together into a single sink.
   //
+  // If `pool` is given, the first and final passes run on it concurrently
+  // across modules.  Output is staged per module and written to `sink` in
+  // module order, so the result (and any error reported) is the same either
+  // way.
+  //
   // This can only be called once.
-  ErrorOr<void> Assemble(OutputSink* sink);
+  ErrorOr<void> Assemble(OutputSink* sink, ThreadPool* pool = nullptr);
+
+  // Replaces the module loaded from `file.path()` with the new contents of
+  // `file`, and writes the changed output into `sink`, which should hold the
+  // output of the previous Assemble() or Reassemble() call.
+  //
+  // Only the replaced module, and modules that read a name whose value has
+  // changed, are evaluated and assembled again.  Bytes that were written
+  // before but are no longer written by any module are restored from
+  // `original`, which should hold what `sink` held before the first
+  // Assemble() call.
+  //
+  // If `file` fails to parse or lay out, an error is returned and nothing
+  // changes.  After any other error, the assembler must be rebuilt from
+  // scratch.
+  ErrorOr<void> Reassemble(const File& file, const InputSource& original,
+                           OutputSink* sink, ThreadPool* pool = nullptr,
+                           const std::string& cache_dir = "");
 
   // Post-assembly queries
 
@@ -44,26 +102,72 @@ class Assembler {
   std::map<nsasm::Address, ReturnConvention> JumpTargetReturnConventions()
       const;
 
+  // Returns the .equ dependency graph computed by Assemble().
+  const ModuleDependencyGraph& DependencyGraph() const {
+    return dependency_graph_;
+  }
+
   // Output each named module's contents to stdout
   void DebugPrint() const;
 
  private:
   void AddModule(Module&& module);
 
+  // Builds dependency_graph_ and name_to_module_map_ from the loaded modules.
+  // Returns an error on duplicate or missing names, or on a dependency cycle.
+  ErrorOr<void> BuildDependencyGraph();
+
   // Calculates an order of module assembly so that all .equ expressions are
-  // evaluated before any are accessed.
-  ErrorOr<std::vector<Module*>> FindAssemblyOrder();
+  // evaluated before any are accessed.  Modules are given by their index into
+  // modules_.
+  ErrorOr<std::vector<int>> FindAssemblyOrder();
+
+  // Runs the final pass over the given modules, rebuilds memory_module_map_,
+  // and writes the modules' output to `sink` in the order given.
+  ErrorOr<void> AssembleModules(const std::vector<int>& modules,
+                                OutputSink* sink, ThreadPool* pool);
+
+  // Writes the bytes of `previous_bytes` that no module claims anymore back
+  // to `sink`, copying them from `original`.  Only the given ranges are
+  // examined, so this costs time in proportion to them rather than to the
+  // whole program.
+  ErrorOr<void> RestoreReleasedBytes(
+      const std::vector<DataRange>& previous_bytes,
+      const InputSource& original, OutputSink* sink) const;
 
   friend class AssemblerLookupContext;
 
+  friend class AssemblerBindingContext;
+
+  // Binds the names used by the given modules (see Module::Bind()), and
+  // records the external names each uses.
+  void BindModules(const std::vector<int>& modules, ThreadPool* pool);
+
+  // The names a module reads from other modules, and the values they had the
+  // last time each pass was run over it.  Used by Reassemble() to find the
+  // modules affected by a change.
+  struct ConsumedNames {
+    // Every external name bound in the module.
+    std::set<FullIdentifier> names;
+    // The values of the module's .equ dependencies, and of all of `names`.
+    absl::flat_hash_map<FullIdentifier, int> second_pass;
+    absl::flat_hash_map<FullIdentifier, int> final_pass;
+  };
+
   std::deque<Module> modules_;
 
   RangeMap<Module*> memory_module_map_;
   absl::flat_hash_map<FullIdentifier, Module*> name_to_module_map_;
+  ModuleDependencyGraph dependency_graph_;
+  // Indexed like modules_.
+  std::vector<ConsumedNames> consumed_names_;
+  bool assembled_ = false;
 };
 
-// Simple factory function for assembling a collection of files
-ErrorOr<Assembler> Assemble(const std::vector<File>& files, OutputSink* sink);
+// Simple factory function for assembling a collection of files.  If `pool` is
+// given, files are parsed and assembled on it in parallel.
+ErrorOr<Assembler> Assemble(const std::vector<File>& files, OutputSink* sink,
+                            ThreadPool* pool = nullptr);
 
 }  // namespace nsasm
 
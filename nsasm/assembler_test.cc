@@ -0,0 +1,249 @@
+#include "nsasm/assembler.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "nsasm/file.h"
+#include "nsasm/rom.h"
+#include "nsasm/thread_pool.h"
+#include "test/test_sink.h"
+
+namespace nsasm {
+namespace {
+
+// Forwards writes to another sink, recording which banks were written to.
+class BankTrackingSink : public OutputSink {
+ public:
+  explicit BankTrackingSink(OutputSink* sink) : sink_(sink) {}
+
+  ErrorOr<void> Write(nsasm::Address address,
+                      absl::Span<const std::uint8_t> data) override {
+    banks_.insert(address.Bank());
+    return sink_->Write(address, data);
+  }
+
+  const std::set<int>& Banks() const { return banks_; }
+
+ private:
+  OutputSink* sink_;
+  std::set<int> banks_;
+};
+
+// Returns a LoRom image covering the banks written by MakeFiles(count), filled
+// with `fill`.
+std::unique_ptr<Rom> MakeOriginal(int count, uint8_t fill) {
+  return std::make_unique<Rom>(kLoRom, "original.sfc", std::vector<uint8_t>(),
+                               std::vector<uint8_t>(count * 0x8000, fill));
+}
+
+// Returns a set of modules, each calling a routine in the next.
+std::vector<File> MakeFiles(int count) {
+  std::vector<File> files;
+  for (int i = 0; i < count; ++i) {
+    std::string contents = absl::StrFormat(
+        ".module mod%d\n"
+        ".org $%02x8000\n"
+        ".entry m8x8\n"
+        "entry:\n"
+        "LDA #$%02x\n",
+        i, 0x80 + i, i);
+    if (i + 1 < count) {
+      absl::StrAppendFormat(&contents, "JSL @mod%d::entry\n", i + 1);
+    }
+    contents += "RTL\n";
+    files.push_back(MakeFakeFile(absl::StrFormat("mod%d.asm", i), contents));
+  }
+  return files;
+}
+
+TEST(Assembler, ParallelLoadMatchesSequential) {
+  const std::vector<File> files = MakeFiles(20);
+
+  RecordingSink sequential_sink;
+  auto sequential = Assemble(files, &sequential_sink);
+  NSASM_ASSERT_OK(sequential);
+
+  ThreadPool pool(4);
+  RecordingSink parallel_sink;
+  auto parallel = Assemble(files, &parallel_sink, &pool);
+  NSASM_ASSERT_OK(parallel);
+
+  EXPECT_FALSE(parallel_sink.Bytes().empty());
+  EXPECT_EQ(parallel_sink.Bytes(), sequential_sink.Bytes());
+  EXPECT_EQ(parallel->JumpTargets(), sequential->JumpTargets());
+}
+
+TEST(Assembler, ParallelLoadReportsFirstError) {
+  std::vector<File> files = MakeFiles(20);
+  files[7] = MakeFakeFile("bad7.asm", "LDA #$12 junk\n");
+  files[13] = MakeFakeFile("bad13.asm", "LDA #$12 junk\n");
+
+  ThreadPool pool(4);
+  Assembler assembler;
+  auto result = assembler.AddAsmFiles(files, &pool);
+  ASSERT_FALSE(result.ok());
+  EXPECT_THAT(result.error().ToString(), testing::HasSubstr("bad7.asm"));
+}
+
+TEST(Assembler, ParallelAssembleReportsFirstError) {
+  std::vector<File> files = MakeFiles(20);
+  // Code after the RTL is never reached, which fails the first pass.
+  files[19] = MakeFakeFile("bad19.asm",
+                           ".module mod19\n.org $938000\n.entry m8x8\n"
+                           "entry:\nRTL\nNOP\n");
+  files[5] = MakeFakeFile("bad5.asm",
+                          ".module mod5\n.org $858000\n.entry m8x8\n"
+                          "entry:\nRTL\nNOP\n");
+
+  ThreadPool pool(4);
+  RecordingSink sink;
+  auto result = Assemble(files, &sink, &pool);
+  ASSERT_FALSE(result.ok());
+  EXPECT_THAT(result.error().ToString(), testing::HasSubstr("bad5.asm"));
+}
+
+TEST(Assembler, SinkErrorsReportStatementLine) {
+  // The first statement written, `LDA #$00` on line 5, doesn't match the ROM.
+  RomIdentityTest sink(MakeOriginal(1, 0xff));
+  ThreadPool pool(4);
+  auto result = Assemble(MakeFiles(1), &sink, &pool);
+  ASSERT_FALSE(result.ok());
+  EXPECT_THAT(result.error().ToString(), testing::StartsWith("mod0.asm:5: "));
+}
+
+TEST(Assembler, DependencyLevels) {
+  // gamma depends on alpha and beta; beta depends on alpha; delta stands
+  // alone.
+  std::vector<File> files = {
+      MakeFakeFile("gamma.asm", ".module gamma\nv .equ alpha::v + beta::v\n"),
+      MakeFakeFile("beta.asm", ".module beta\nv .equ alpha::v + 1\n"),
+      MakeFakeFile("alpha.asm", ".module alpha\nv .equ 1\n"),
+      MakeFakeFile("delta.asm", ".module delta\nv .equ 4\n"),
+  };
+  RecordingSink sink;
+  auto assembler = Assemble(files, &sink);
+  NSASM_ASSERT_OK(assembler);
+
+  const ModuleDependencyGraph& graph = assembler->DependencyGraph();
+  using testing::ElementsAre;
+  EXPECT_THAT(graph.dependencies,
+              ElementsAre(ElementsAre(1, 2), ElementsAre(2), ElementsAre(),
+                          ElementsAre()));
+  EXPECT_THAT(graph.dependents,
+              ElementsAre(ElementsAre(), ElementsAre(0), ElementsAre(0, 1),
+                          ElementsAre()));
+  EXPECT_THAT(graph.levels,
+              ElementsAre(ElementsAre(2, 3), ElementsAre(1), ElementsAre(0)));
+}
+
+TEST(Assembler, CyclicDependencyReportsChain) {
+  std::vector<File> files = {
+      MakeFakeFile("alpha.asm", ".module alpha\nv .equ 1\n"),
+      MakeFakeFile("beta.asm", ".module beta\nv .equ gamma::v\n"),
+      MakeFakeFile("gamma.asm", ".module gamma\nv .equ delta::v + alpha::v\n"),
+      MakeFakeFile("delta.asm", ".module delta\nv .equ beta::v\n"),
+  };
+  RecordingSink sink;
+  auto assembler = Assemble(files, &sink);
+  ASSERT_FALSE(assembler.ok());
+  EXPECT_THAT(assembler.error().ToString(),
+              testing::HasSubstr("`beta` -> `gamma` -> `delta` -> `beta`"));
+}
+
+TEST(Assembler, ReassembleOnlyAffectedModules) {
+  std::vector<File> files = MakeFiles(5);
+  auto original = MakeOriginal(5, 0x5a);
+  RecordingSink sink;
+  auto assembler = Assemble(files, &sink);
+  NSASM_ASSERT_OK(assembler);
+
+  // Changing an operand moves no labels, so only mod2 is reassembled.
+  files[2] = MakeFakeFile("mod2.asm",
+                          ".module mod2\n.org $828000\n.entry m8x8\n"
+                          "entry:\nLDA #$55\nJSL @mod3::entry\nRTL\n");
+  BankTrackingSink patch(&sink);
+  NSASM_ASSERT_OK(assembler->Reassemble(files[2], *original, &patch));
+  EXPECT_THAT(patch.Banks(), testing::ElementsAre(0x82));
+
+  // Moving mod2::entry also reassembles mod1, which calls it.
+  files[2] = MakeFakeFile("mod2.asm",
+                          ".module mod2\n.org $828000\n.entry m8x8\nNOP\n"
+                          "entry:\nLDA #$55\nJSL @mod3::entry\nRTL\n");
+  BankTrackingSink second_patch(&sink);
+  NSASM_ASSERT_OK(assembler->Reassemble(files[2], *original, &second_patch));
+  EXPECT_THAT(second_patch.Banks(), testing::ElementsAre(0x81, 0x82));
+
+  // The patched output matches a full assembly of the new sources.
+  RecordingSink expected;
+  NSASM_ASSERT_OK(Assemble(files, &expected));
+  EXPECT_EQ(sink.Bytes(), expected.Bytes());
+
+  // Shrinking mod2 from eight bytes to one also moves mod2::entry, and the
+  // seven bytes it no longer writes get their original contents back.
+  files[2] = MakeFakeFile("mod2.asm",
+                          ".module mod2\n.org $828000\n.entry m8x8\n"
+                          "entry:\nRTL\n");
+  BankTrackingSink third_patch(&sink);
+  NSASM_ASSERT_OK(assembler->Reassemble(files[2], *original, &third_patch));
+  EXPECT_THAT(third_patch.Banks(), testing::ElementsAre(0x81, 0x82));
+
+  RecordingSink shrunk;
+  NSASM_ASSERT_OK(Assemble(files, &shrunk));
+  std::map<Address, uint8_t> shrunk_bytes = shrunk.Bytes();
+  for (int i = 1; i < 8; ++i) {
+    shrunk_bytes[Address(0x828000 + i)] = 0x5a;
+  }
+  EXPECT_EQ(sink.Bytes(), shrunk_bytes);
+}
+
+TEST(Assembler, ReassemblePropagatesEquValues) {
+  std::vector<File> files = {
+      MakeFakeFile("alpha.asm", ".module alpha\nv .equ 1\n"),
+      MakeFakeFile("beta.asm",
+                   ".module beta\nv .equ alpha::v + 1\n.org $818000\n"
+                   ".entry m8x8\nLDA #v\nRTL\n"),
+      MakeFakeFile("gamma.asm",
+                   ".module gamma\n.org $828000\n.entry m8x8\nLDA #$12\n"
+                   "RTL\n"),
+  };
+  auto original = MakeOriginal(3, 0);
+  RecordingSink sink;
+  auto assembler = Assemble(files, &sink);
+  NSASM_ASSERT_OK(assembler);
+
+  files[0] = MakeFakeFile("alpha.asm", ".module alpha\nv .equ 5\n");
+  BankTrackingSink patch(&sink);
+  NSASM_ASSERT_OK(assembler->Reassemble(files[0], *original, &patch));
+  EXPECT_THAT(patch.Banks(), testing::ElementsAre(0x81));
+  EXPECT_EQ(sink.Bytes().at(Address(0x818001)), 6);
+}
+
+TEST(Assembler, ReassembleRejectsBadFile) {
+  std::vector<File> files = MakeFiles(3);
+  auto original = MakeOriginal(3, 0);
+  RecordingSink sink;
+  auto assembler = Assemble(files, &sink);
+  NSASM_ASSERT_OK(assembler);
+
+  EXPECT_FALSE(assembler
+                   ->Reassemble(MakeFakeFile("mod1.asm", "LDA #$12 junk\n"),
+                                *original, &sink)
+                   .ok());
+  EXPECT_FALSE(
+      assembler->Reassemble(MakeFakeFile("new.asm", ""), *original, &sink)
+          .ok());
+
+  // The failed attempts changed nothing, so the assembler is still usable.
+  NSASM_ASSERT_OK(assembler->Reassemble(files[1], *original, &sink));
+  RecordingSink expected;
+  NSASM_ASSERT_OK(Assemble(files, &expected));
+  EXPECT_EQ(sink.Bytes(), expected.Bytes());
+}
+
+}  // namespace
+}  // namespace nsasm
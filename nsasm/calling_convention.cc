@@ -17,4 +17,29 @@ std::string ReturnConvention::ToSuffixString() const {
   }
 }
 
+uint16_t ReturnConventionCode(const ReturnConvention& convention) {
+  if (convention.IsExitCall()) {
+    return 0x100;
+  }
+  auto flags = convention.YieldFlags();
+  if (flags.has_value()) {
+    return 0x200 | flags->ToByte();
+  }
+  return 0;
+}
+
+ReturnConvention ReturnConventionFromCode(uint16_t code, ByteReader* in) {
+  switch (code >> 8) {
+    case 0:
+      return ReturnConvention();
+    case 1:
+      return ReturnConvention(NoReturn());
+    case 2:
+      return ReturnConvention(StatusFlags::FromByte(code & 0xff));
+    default:
+      in->Fail();
+      return ReturnConvention();
+  }
+}
+
 }  // namespace nsasm
@@ -1,8 +1,11 @@
 #ifndef NSASM_CALLING_CONVENTION_H_
 #define NSASM_CALLING_CONVENTION_H_
 
+#include <cstdint>
+
 #include "absl/types/variant.h"
 #include "nsasm/execution_state.h"
+#include "nsasm/serialize.h"
 
 namespace nsasm {
 
@@ -62,6 +65,13 @@ class ReturnConvention {
   absl::variant<absl::monostate, StatusFlags, NoReturn> state_;
 };
 
+// Packs a return convention into 16 bits, for serialization and comparison.
+uint16_t ReturnConventionCode(const ReturnConvention& convention);
+
+// Unpacks a value returned by ReturnConventionCode().  Marks `in` as failed if
+// `code` is malformed.
+ReturnConvention ReturnConventionFromCode(uint16_t code, ByteReader* in);
+
 struct CallingConvention {
   StatusFlags incoming_state;
   ReturnConvention return_state;
@@ -6,106 +6,89 @@
 
 namespace nsasm {
 
-ErrorOr<Instruction> Decode(absl::Span<const uint8_t> bytes,
-                            const StatusFlags& flags) {
+bool DecodeOp(absl::Span<const uint8_t> bytes, const StatusFlags& flags,
+              DecodedOp* op) {
   if (bytes.empty()) {
-    return Error("Not enough bytes to decode");
+    return false;
   }
-  uint8_t opcode = bytes.front();
-  bytes.remove_prefix(1);
-
-  Instruction decoded;
-  std::tie(decoded.mnemonic, decoded.addressing_mode) = DecodeOpcode(opcode);
-  decoded.suffix = S_none;
-
-  // correct for sentinel addressing modes
-  if (decoded.addressing_mode == A_imm_fm ||
-      decoded.addressing_mode == A_imm_fx) {
-    BitState narrow_register =
-        (decoded.addressing_mode == A_imm_fm) ? flags.MBit() : flags.XBit();
-    if (narrow_register == B_on) {
-      decoded.addressing_mode = A_imm_b;
-    } else if (narrow_register == B_off) {
-      decoded.addressing_mode = A_imm_w;
-    } else {
-      return Error(
-          "Argument size of opcode 0x%02x (%s) depends on processor state, "
-          "which is not known here",
-          opcode, ToString(decoded.mnemonic));
-    }
+  const OpcodeInfo& info = DecodeTableFor(flags)[bytes[0]];
+  if (info.length == 0 || bytes.size() < info.length) {
+    return false;
   }
+  op->mnemonic = info.mnemonic;
+  op->addressing_mode = info.addressing_mode;
+  op->length = info.length;
+  op->operand_type = info.operand_type;
+  op->is_local_branch = info.is_local_branch;
+  op->is_exit = info.is_exit;
 
   // Read arguments
-  if (decoded.addressing_mode == A_dir_l ||
-      decoded.addressing_mode == A_dir_lx) {
-    // 24 bit argument
-    if (bytes.size() < 3) {
-      return Error("Not enough bytes to decode");
-    }
-    decoded.arg1 = absl::make_unique<Literal>(
-        bytes[0] + (bytes[1] * 256) + (bytes[2] * 256 * 256), T_long);
+  op->arg1 = 0;
+  op->arg2 = 0;
+  switch (op->length) {
+    case 2:
+      op->arg1 = bytes[1];
+      break;
+    case 3:
+      op->arg1 = bytes[1] + (bytes[2] * 256);
+      break;
+    case 4:
+      op->arg1 = bytes[1] + (bytes[2] * 256) + (bytes[3] * 256 * 256);
+      break;
+  }
+  if (op->addressing_mode == A_mov) {
+    // pair of 8 bit arguments, encoded in reverse order
+    op->arg1 = bytes[2];
+    op->arg2 = bytes[1];
+  } else if (op->addressing_mode == A_rel8 && op->arg1 >= 128) {
+    // 8 bit signed argument
+    op->arg1 -= 256;
+  } else if (op->addressing_mode == A_rel16 && op->arg1 >= 32768) {
+    // 16 bit signed argument
+    op->arg1 -= 65536;
   }
-  if (decoded.addressing_mode == A_imm_w ||
-      decoded.addressing_mode == A_dir_w ||
-      decoded.addressing_mode == A_dir_wx ||
-      decoded.addressing_mode == A_dir_wy ||
-      decoded.addressing_mode == A_ind_w ||
-      decoded.addressing_mode == A_ind_wx ||
-      decoded.addressing_mode == A_lng_w) {
-    // 16 bit argument
-    if (bytes.size() < 2) {
-      return Error("Not enough bytes to decode");
-    }
-    decoded.arg1 =
-        absl::make_unique<Literal>(bytes[0] + (bytes[1] * 256), T_word);
+  return true;
+}
+
+Instruction ToInstruction(const DecodedOp& op) {
+  Instruction decoded;
+  decoded.mnemonic = op.mnemonic;
+  decoded.addressing_mode = op.addressing_mode;
+  decoded.suffix = S_none;
+  if (op.operand_type != T_unknown) {
+    decoded.arg1 = absl::make_unique<Literal>(op.arg1, op.operand_type);
   }
-  if (decoded.addressing_mode == A_imm_b ||
-      decoded.addressing_mode == A_dir_b ||
-      decoded.addressing_mode == A_dir_bx ||
-      decoded.addressing_mode == A_dir_by ||
-      decoded.addressing_mode == A_ind_b ||
-      decoded.addressing_mode == A_ind_bx ||
-      decoded.addressing_mode == A_ind_by ||
-      decoded.addressing_mode == A_lng_b ||
-      decoded.addressing_mode == A_lng_by || decoded.addressing_mode == A_stk ||
-      decoded.addressing_mode == A_stk_y) {
-    // 8 bit argument
-    if (bytes.size() < 1) {
-      return Error("Not enough bytes to decode");
-    }
-    decoded.arg1 = absl::make_unique<Literal>(bytes[0], T_byte);
+  if (op.addressing_mode == A_mov) {
+    decoded.arg2 = absl::make_unique<Literal>(op.arg2, T_byte);
   }
-  if (decoded.addressing_mode == A_mov) {
-    // pair of 8 bit arguments
-    if (bytes.size() < 2) {
-      return Error("Not enough bytes to decode");
-    }
-    decoded.arg1 = absl::make_unique<Literal>(bytes[1], T_byte);
-    decoded.arg2 = absl::make_unique<Literal>(bytes[0], T_byte);
+  return decoded;
+}
+
+ErrorOr<Instruction> Decode(absl::Span<const uint8_t> bytes,
+                            const StatusFlags& flags) {
+  DecodedOp op;
+  if (DecodeOp(bytes, flags, &op)) {
+    return ToInstruction(op);
   }
-  if (decoded.addressing_mode == A_rel8) {
-    // 8 bit signed argument
-    if (bytes.size() < 1) {
-      return Error("Not enough bytes to decode");
-    }
-    int value = bytes[0];
-    if (value >= 128) {
-      value -= 256;
-    }
-    decoded.arg1 = absl::make_unique<Literal>(value, T_signed_byte);
+
+  // Decoding failed; work out why.
+  if (bytes.empty()) {
+    return Error("Not enough bytes to decode");
   }
-  if (decoded.addressing_mode == A_rel16) {
-    // 8 bit signed argument
-    if (bytes.size() < 2) {
-      return Error("Not enough bytes to decode");
-    }
-    int value = bytes[0] + (bytes[1] * 256);
-    if (value >= 32768) {
-      value -= 65536;
-    }
-    decoded.arg1 = absl::make_unique<Literal>(value, T_signed_word);
+  uint8_t opcode = bytes.front();
+  Mnemonic mnemonic;
+  AddressingMode addressing_mode;
+  std::tie(mnemonic, addressing_mode) = DecodeOpcode(opcode);
+  if ((addressing_mode == A_imm_fm && flags.MBit() != B_on &&
+       flags.MBit() != B_off) ||
+      (addressing_mode == A_imm_fx && flags.XBit() != B_on &&
+       flags.XBit() != B_off)) {
+    return Error(
+        "Argument size of opcode 0x%02x (%s) depends on processor state, "
+        "which is not known here",
+        opcode, ToString(mnemonic));
   }
-  return {std::move(decoded)};
+  return Error("Not enough bytes to decode");
 }
 
 }  // namespace nsasm
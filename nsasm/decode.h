@@ -12,12 +12,43 @@ namespace nsasm {
 
 // Returns a 65816 instruction decoded from a chunk of memory.
 //
-// Returns an error f a valid instruction can't be found (because there aren't
+// Returns an error if a valid instruction can't be found (because there aren't
 // enough bytes to read, or because the provided StatusFlags is uncertain about
 // a processor flag required for proper decoding).
 ErrorOr<Instruction> Decode(absl::Span<const uint8_t> bytes,
                             const StatusFlags& flags);
 
+// Plain-data form of a decoded instruction.  This owns no heap memory, so it
+// is cheap to produce and throw away.
+struct DecodedOp {
+  Mnemonic mnemonic;
+  // The definite addressing mode; never A_imm_fm or A_imm_fx.
+  AddressingMode addressing_mode;
+  // Size of the instruction in bytes, including the opcode.
+  int length;
+  // Type of the first operand, or T_unknown if there is none.
+  NumericType operand_type;
+  // As Instruction::IsLocalBranch() and IsExitInstruction(), read from the
+  // decode table.  `is_exit` doesn't account for return conventions.
+  bool is_local_branch;
+  bool is_exit;
+  // Operand values, as they would appear in the arguments of the equivalent
+  // Instruction.  Relative branch offsets are sign-extended.  `arg2` is only
+  // used by A_mov instructions.
+  int arg1;
+  int arg2;
+};
+
+// As Decode(), but never allocates or formats an error message.
+//
+// Returns false if a valid instruction can't be found, in which case Decode()
+// will return an error describing why.
+bool DecodeOp(absl::Span<const uint8_t> bytes, const StatusFlags& flags,
+              DecodedOp* op);
+
+// Returns the Instruction equivalent to the given DecodedOp.
+Instruction ToInstruction(const DecodedOp& op);
+
 }  // namespace nsasm
 
 #endif  // NSASM_DECODE_H_1
@@ -1,5 +1,6 @@
 #include "nsasm/decode.h"
 
+#include "absl/strings/str_format.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "nsasm/opcode_map.h"
@@ -116,4 +117,42 @@ TEST(Decode, mode_independent_instructions) {
   }
 }
 
+TEST(Decode, decoded_op_matches_instruction) {
+  StatusFlags all_flags[] = {StatusFlags(), StatusFlags(B_on, B_on, B_on),
+                             StatusFlags(B_off, B_on, B_on),
+                             StatusFlags(B_off, B_off, B_off),
+                             StatusFlags(B_off, B_on, B_off),
+                             StatusFlags(B_off, B_off, B_on)};
+  for (int i = 0; i < 256; ++i) {
+    for (const StatusFlags& flags : all_flags) {
+      for (uint8_t operand : {0x21, 0xfe}) {
+        SCOPED_TRACE(absl::StrFormat("opcode 0x%02x, %s, operand 0x%02x", i,
+                                     flags.ToString(), operand));
+        std::vector<uint8_t> data = {uint8_t(i), operand, 0x43, 0x85};
+        for (size_t size = 0; size <= data.size(); ++size) {
+          auto bytes = absl::MakeSpan(data).subspan(0, size);
+          auto decoded = Decode(bytes, flags);
+          DecodedOp op;
+          ASSERT_EQ(DecodeOp(bytes, flags, &op), decoded.ok());
+          if (!decoded.ok()) {
+            continue;
+          }
+          EXPECT_EQ(op.mnemonic, decoded->mnemonic);
+          EXPECT_EQ(op.addressing_mode, decoded->addressing_mode);
+          EXPECT_EQ(op.length, decoded->SerializedSize());
+          EXPECT_EQ(op.is_local_branch, decoded->IsLocalBranch());
+          EXPECT_EQ(op.is_exit, decoded->IsExitInstruction());
+          if (decoded->arg1) {
+            EXPECT_EQ(op.arg1, decoded->arg1.Evaluate(lookup_context));
+          }
+          if (decoded->arg2) {
+            EXPECT_EQ(op.arg2, decoded->arg2.Evaluate(lookup_context));
+          }
+          EXPECT_EQ(ToInstruction(op).ToString(), decoded->ToString());
+        }
+      }
+    }
+  }
+}
+
 }  // namespace nsasm
@@ -9,6 +9,33 @@
 
 namespace nsasm {
 
+void Directive::Serialize(ByteWriter* out) const {
+  out->WriteU16(name);
+  argument.Serialize(out);
+  out->WriteU8(flag_state_argument.ToByte());
+  out->WriteU16(ReturnConventionCode(return_convention_argument));
+  out->WriteU32(list_argument.size());
+  for (const ExpressionOrNull& expr : list_argument) {
+    expr.Serialize(out);
+  }
+  out->WriteU32(location.LineNumber());
+}
+
+Directive Directive::Deserialize(ByteReader* in, const Location& file) {
+  Directive directive;
+  directive.name = ReadEnum(in, D_remote);
+  directive.argument = ExpressionOrNull::Deserialize(in);
+  directive.flag_state_argument = StatusFlags::FromByte(in->ReadU8());
+  directive.return_convention_argument =
+      ReturnConventionFromCode(in->ReadU16(), in);
+  for (uint32_t n = in->ReadU32(); n > 0 && in->ok(); --n) {
+    directive.list_argument.push_back(ExpressionOrNull::Deserialize(in));
+  }
+  directive.location = file;
+  directive.location.Update(Location(int(in->ReadU32())));
+  return directive;
+}
+
 DirectiveType DirectiveTypeByName(DirectiveName d) {
   static auto lookup = new absl::flat_hash_map<DirectiveName, DirectiveType>{
       {D_begin, DT_no_arg},     {D_db, DT_list_arg},
@@ -51,6 +51,19 @@ struct Directive {
   std::string ToString() const;
 
   bool IsExitInstruction() const { return name == D_halt; }
+
+  // Binds the names in this directive's arguments (see Expression::Bind()).
+  void Bind(const BindingContext& context) {
+    argument.Bind(context);
+    for (ExpressionOrNull& expr : list_argument) {
+      expr.Bind(context);
+    }
+  }
+
+  // Writes this directive to a cache file, or reads it back, as with
+  // Instruction::Serialize() and Instruction::Deserialize().
+  void Serialize(ByteWriter* out) const;
+  static Directive Deserialize(ByteReader* in, const Location& file);
 };
 
 // googletest pretty printers (streams are an abomination)
@@ -1,8 +1,11 @@
 #include "nsasm/disassemble.h"
 
 #include <string>
+#include <tuple>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/strings/str_cat.h"
 #include "nsasm/decode.h"
 #include "nsasm/error.h"
@@ -10,15 +13,55 @@
 
 namespace nsasm {
 
+namespace {
+
+// Marks an instruction whose argument size depends on the M or X flag with
+// the size implied by the given flag state, if known.
+void ApplySizeSuffix(const StatusFlags& flags, Instruction* ins) {
+  StatusFlagUsed flag_used = FlagControllingInstructionSize(ins->mnemonic);
+  if (flag_used == kUsesMFlag) {
+    if (flags.MBit() == B_on) {
+      ins->suffix = S_b;
+    } else if (flags.MBit() == B_off) {
+      ins->suffix = S_w;
+    }
+  }
+  if (flag_used == kUsesXFlag) {
+    if (flags.XBit() == B_on) {
+      ins->suffix = S_b;
+    } else if (flags.XBit() == B_off) {
+      ins->suffix = S_w;
+    }
+  }
+}
+
+uint32_t AddressBits(nsasm::Address address) {
+  return (address.Bank() << 16) | address.BankAddress();
+}
+
+}  // namespace
+
 ErrorOr<std::map<nsasm::Address, StatusFlags>> Disassembler::Disassemble(
     nsasm::Address starting_address, const StatusFlags& initial_status_flags) {
+  entry_points_.insert(starting_address);
+  Trace trace;
+  NSASM_RETURN_IF_ERROR(
+      TraceFrom(starting_address, initial_status_flags, &trace));
+  Commit(&trace);
+  return std::move(trace.far_branch_targets);
+}
+
+ErrorOr<void> Disassembler::TraceFrom(nsasm::Address starting_address,
+                                      const StatusFlags& initial_status_flags,
+                                      Trace* trace) const {
   // Map of newly decoded, or locally modified, instructions.  This is
-  // written to disassembly_ at the end of this function, assuming we did not
-  // exit with an error.
-  std::map<nsasm::Address, DisassembledInstruction> new_disassembly;
+  // written to disassembly_ by Commit(), assuming we did not exit with an
+  // error.
+  std::map<nsasm::Address, TracedInstruction>& new_disassembly =
+      trace->new_disassembly;
   auto get_instruction =
-      [this,
-       &new_disassembly](nsasm::Address address) -> DisassembledInstruction* {
+      [this, trace,
+       &new_disassembly](nsasm::Address address) -> TracedInstruction* {
     // return the instruction if it already is in the new map
     auto new_disassembly_it = new_disassembly.find(address);
     if (new_disassembly_it != new_disassembly.end()) {
@@ -26,30 +69,37 @@ ErrorOr<std::map<nsasm::Address, StatusFlags>> Disassembler::Disassemble(
     };
     // otherwise, if it's in this class's state, copy it over into the new map
     // and return the copy
+    trace->reads.push_back(address);
     auto old_disassembly_it = disassembly_.find(address);
     if (old_disassembly_it != disassembly_.end()) {
-      DisassembledInstruction& copy = new_disassembly[address];
-      copy = old_disassembly_it->second;
+      const DisassembledInstruction& old = old_disassembly_it->second;
+      TracedInstruction& copy = new_disassembly[address];
+      copy.label = old.label;
+      copy.instruction = old.instruction;
+      copy.is_entry = old.is_entry;
+      copy.current_execution_state = states_.Get(old.current_execution_state);
+      copy.next_execution_state = states_.Get(old.next_execution_state);
       return &copy;
     }
     return nullptr;
   };
 
   // Mapping of instruction addresses to jump target label name
-  std::map<nsasm::Address, std::string> label_names;
-  auto get_label = [this, &label_names](nsasm::Address address) {
+  std::map<nsasm::Address, std::string>& label_names = trace->label_names;
+  auto get_label = [this, trace, &label_names](nsasm::Address address) {
     // Is address in label map?
     auto it = label_names.find(address);
     if (it != label_names.end()) {
       return it->second;
     }
     // Was address given a label in a previous disassembly?
+    trace->reads.push_back(address);
     auto it2 = disassembly_.find(address);
     if (it2 != disassembly_.end() && !it2->second.label.empty()) {
       return it2->second.label;
     }
     // Never before seen; generate a name now.
-    return label_names[address] = GenSym();
+    return label_names[address] = GenSym(address);
   };
 
   // Map of locations to consider next, and the execution state to use
@@ -66,7 +116,8 @@ ErrorOr<std::map<nsasm::Address, StatusFlags>> Disassembler::Disassemble(
   };
 
   // Map of far branch targets to incoming states
-  std::map<nsasm::Address, StatusFlags> far_branch_targets;
+  std::map<nsasm::Address, StatusFlags>& far_branch_targets =
+      trace->far_branch_targets;
   auto add_far_branch = [&far_branch_targets](nsasm::Address address,
                                               const ExecutionState& state) {
     auto it = far_branch_targets.find(address);
@@ -77,11 +128,13 @@ ErrorOr<std::map<nsasm::Address, StatusFlags>> Disassembler::Disassemble(
     }
   };
 
+  // Number of times the state at each address has changed on a revisit.
+  std::map<nsasm::Address, int> changes;
+
   ExecutionState initial_execution_state(initial_status_flags);
 
   add_to_decode_stack(starting_address, initial_execution_state);
-  // ensure entry point is marked, and has a label
-  entry_points_.insert(starting_address);
+  // ensure entry point has a label
   get_label(starting_address);
 
   while (!decode_stack.empty()) {
@@ -92,78 +145,91 @@ ErrorOr<std::map<nsasm::Address, StatusFlags>> Disassembler::Disassemble(
     nsasm::Address pc = next.first;
     const ExecutionState& current_execution_state = next.second;
 
-    DisassembledInstruction* existing_instruction = get_instruction(pc);
+    TracedInstruction* existing_instruction = get_instruction(pc);
     if (!existing_instruction) {
       // This is the first time we've seen this address.  Try to disassemble
       // it.
-      auto instruction_data = src_->Read(pc, 4);
+      auto instruction_data = src_->ReadView(pc, 4);
       NSASM_RETURN_IF_ERROR_WITH_LOCATION(instruction_data, src_->Path(), pc);
-      auto instruction =
-          Decode(*instruction_data, current_execution_state.Flags());
-      NSASM_RETURN_IF_ERROR_WITH_LOCATION(instruction, src_->Path(), pc);
-
-      int instruction_bytes = InstructionLength(instruction->addressing_mode);
+      DecodedOp op;
+      if (!DecodeOp(*instruction_data, current_execution_state.Flags(), &op)) {
+        return Decode(*instruction_data, current_execution_state.Flags())
+            .error()
+            .SetLocation(src_->Path(), pc);
+      }
+      Instruction instruction = ToInstruction(op);
 
-      nsasm::Address next_pc = pc.AddWrapped(instruction_bytes);
+      nsasm::Address next_pc = pc.AddWrapped(op.length);
       auto next_execution_state = current_execution_state;
       NSASM_RETURN_IF_ERROR_WITH_LOCATION(
-          instruction->Execute(&next_execution_state), src_->Path(), pc);
+          instruction.Execute(&next_execution_state), src_->Path(), pc);
 
-      auto far_branch_address = instruction->FarBranchTarget(pc);
+      auto far_branch_address = instruction.FarBranchTarget(pc);
       if (far_branch_address.has_value()) {
         nsasm::Address target = *far_branch_address;
         add_far_branch(target, next_execution_state);
-        if (instruction->mnemonic == M_jsr || instruction->mnemonic == M_jsl) {
+        if (instruction.mnemonic == M_jsr || instruction.mnemonic == M_jsl) {
           // If the subroutine call requires a yield, add that to disassembly.
           auto return_conventions_it = return_conventions_.find(target);
           if (return_conventions_it != return_conventions_.end()) {
-            instruction->return_convention = return_conventions_it->second;
+            instruction.return_convention = return_conventions_it->second;
           }
         }
-        instruction->return_convention.ApplyTo(&next_execution_state);
+        instruction.return_convention.ApplyTo(&next_execution_state);
       }
 
       // If this instruction is relatively addressed, we need a label, and
       // need to add that address to code we should try to disassemble.
-      if (instruction->IsLocalBranch()) {
-        int value = *instruction->arg1.Evaluate(NullLookupContext());
-        nsasm::Address target = next_pc.AddWrapped(value);
-        instruction->arg1.ApplyLabel(get_label(target));
+      if (op.is_local_branch) {
+        nsasm::Address target = next_pc.AddWrapped(op.arg1);
+        instruction.arg1.ApplyLabel(get_label(target));
         auto branch_execution_state = current_execution_state;
         NSASM_RETURN_IF_ERROR_WITH_LOCATION(
-            instruction->ExecuteBranch(&branch_execution_state), src_->Path(),
+            instruction.ExecuteBranch(&branch_execution_state), src_->Path(),
             pc);
         add_to_decode_stack(target, branch_execution_state);
       }
 
-      // We've decoded an instruction!  Store it.
-      DisassembledInstruction di;
-      di.instruction = std::move(*instruction);
-      di.current_execution_state = current_execution_state;
-      di.next_execution_state = next_execution_state;
-      new_disassembly[pc] = std::move(di);
-
       // If this instruction doesn't terminate the subroutine, we need to
       // execute the next line as well.
-      if (!di.instruction.IsExitInstruction()) {
+      if (!op.is_exit && !instruction.return_convention.IsExitCall()) {
         add_to_decode_stack(next_pc, next_execution_state);
       }
+
+      // We've decoded an instruction!  Store it.
+      TracedInstruction di;
+      di.instruction = std::move(instruction);
+      di.current_execution_state = current_execution_state;
+      di.next_execution_state = next_execution_state;
+      new_disassembly[pc] = std::move(di);
     } else {
       // We've been here before.  Weaken the incoming state bits for this
       // instruction to allow for the new input flag state.  If this represents
       // a change, check that the resulting state is still consistent, and
       // propagate the changed flag state bits forward.
-      DisassembledInstruction& di = *existing_instruction;
-      ExecutionState combined_execution_state =
-          current_execution_state | di.current_execution_state;
+      // Once an address has changed state kWideningThreshold times, widen
+      // instead, so that loops settle quickly.
+      TracedInstruction& di = *existing_instruction;
+      ExecutionState combined_execution_state = di.current_execution_state;
+      if (changes[pc] < kWideningThreshold) {
+        combined_execution_state |= current_execution_state;
+      } else {
+        combined_execution_state.WidenWith(current_execution_state);
+      }
       if (combined_execution_state != di.current_execution_state) {
+        ++changes[pc];
         // Check that the instruction still decodes with the new flag state.
         // (We can throw the answer away if so, since we've already disassembled
         // this instruction before.)
-        auto instruction_data = src_->Read(pc, 4);
-        NSASM_RETURN_IF_ERROR_WITH_LOCATION(
-            Decode(*instruction_data, combined_execution_state.Flags()),
-            src_->Path(), pc);
+        auto instruction_data = src_->ReadView(pc, 4);
+        NSASM_RETURN_IF_ERROR_WITH_LOCATION(instruction_data, src_->Path(), pc);
+        DecodedOp op;
+        if (!DecodeOp(*instruction_data, combined_execution_state.Flags(),
+                      &op)) {
+          return Decode(*instruction_data, combined_execution_state.Flags())
+              .error()
+              .SetLocation(src_->Path(), pc);
+        }
 
         // Update the flag state on this instruction
         di.current_execution_state = combined_execution_state;
@@ -172,12 +238,10 @@ ErrorOr<std::map<nsasm::Address, StatusFlags>> Disassembler::Disassemble(
         NSASM_RETURN_IF_ERROR_WITH_LOCATION(
             di.instruction.Execute(&next_execution_state), src_->Path(), pc);
         di.next_execution_state = next_execution_state;
-        int instruction_bytes =
-            InstructionLength(di.instruction.addressing_mode);
-        nsasm::Address next_pc = pc.AddWrapped(instruction_bytes);
+        nsasm::Address next_pc = pc.AddWrapped(op.length);
 
         // Propagate the changed state forward to the next instruction...
-        if (!di.instruction.IsExitInstruction()) {
+        if (!op.is_exit && !di.instruction.return_convention.IsExitCall()) {
           add_to_decode_stack(next_pc, next_execution_state);
         }
         // ... the far branch target ...
@@ -186,7 +250,7 @@ ErrorOr<std::map<nsasm::Address, StatusFlags>> Disassembler::Disassemble(
           add_far_branch(*far_branch_address, next_execution_state);
         }
         // ... and the local branch target.
-        if (di.instruction.IsLocalBranch()) {
+        if (op.is_local_branch) {
           auto branch_execution_state = current_execution_state;
           NSASM_RETURN_IF_ERROR_WITH_LOCATION(
               di.instruction.ExecuteBranch(&branch_execution_state),
@@ -203,41 +267,263 @@ ErrorOr<std::map<nsasm::Address, StatusFlags>> Disassembler::Disassemble(
 
   // Add a suffix to each new disassembly instruction that supports one.
   for (auto& node : new_disassembly) {
-    Instruction& ins = node.second.instruction;
-    const StatusFlags& flags = node.second.current_execution_state.Flags();
-    StatusFlagUsed flag_used = FlagControllingInstructionSize(ins.mnemonic);
-    if (flag_used == kUsesMFlag) {
-      if (flags.MBit() == B_on) {
-        ins.suffix = S_b;
-      } else if (flags.MBit() == B_off) {
-        ins.suffix = S_w;
+    ApplySizeSuffix(node.second.current_execution_state.Flags(),
+                    &node.second.instruction);
+  }
+
+  return {};
+}
+
+void Disassembler::Commit(Trace* trace) {
+  // Copy the entries from the temporary map to the permanent state.
+  for (auto& node : trace->new_disassembly) {
+    TracedInstruction& traced = node.second;
+    DisassembledInstruction& di = disassembly_[node.first];
+    di.label = std::move(traced.label);
+    di.instruction = std::move(traced.instruction);
+    di.is_entry = traced.is_entry;
+    di.current_execution_state = states_.Intern(traced.current_execution_state);
+    di.next_execution_state = states_.Intern(traced.next_execution_state);
+  }
+
+  // Apply labels to all instructions.
+  for (const auto& label_name : trace->label_names) {
+    disassembly_[label_name.first].label = label_name.second;
+  }
+}
+
+std::vector<Disassembler::SeedError> Disassembler::DisassembleToFixedPoint(
+    const std::map<nsasm::Address, StatusFlags>& seeds,
+    const std::function<bool(nsasm::Address)>& skip, ThreadPool* pool) {
+  std::vector<SeedError> errors;
+
+  // Entry points to visit in the next round, with their merged flag state.
+  std::map<nsasm::Address, StatusFlags> worklist;
+  auto add_to_worklist = [this, &worklist, &skip](nsasm::Address address,
+                                                  const StatusFlags& flags) {
+    if (skip && skip(address)) {
+      return;
+    }
+    auto it = entry_flags_.find(address);
+    if (it == entry_flags_.end()) {
+      entry_flags_[address] = flags;
+    } else {
+      StatusFlags merged = it->second | flags;
+      if (merged == it->second) {
+        // Nothing new to learn from this entry point.
+        return;
       }
+      it->second = merged;
     }
-    if (flag_used == kUsesXFlag) {
-      if (flags.XBit() == B_on) {
-        ins.suffix = S_b;
-      } else if (flags.XBit() == B_off) {
-        ins.suffix = S_w;
+    worklist[address] = entry_flags_[address];
+  };
+
+  for (const auto& seed : seeds) {
+    add_to_worklist(seed.first, seed.second);
+  }
+  while (!worklist.empty()) {
+    std::vector<std::pair<nsasm::Address, StatusFlags>> round(worklist.begin(),
+                                                              worklist.end());
+    worklist.clear();
+
+    // Trace from every entry point in this round.  With a thread pool, this is
+    // done speculatively and in parallel, against the disassembly as it stood
+    // at the start of the round.
+    std::vector<Trace> traces(round.size());
+    std::vector<ErrorOr<void>> results(round.size());
+    if (pool) {
+      pool->ParallelFor(round.size(), [&](int i) {
+        results[i] = TraceFrom(round[i].first, round[i].second, &traces[i]);
+      });
+    }
+
+    // Commit the traces in address order.  A speculative trace that read an
+    // address written by an earlier commit in this round is stale, and is
+    // redone against the current state.  This makes the result identical to
+    // tracing each entry point in turn.
+    absl::flat_hash_set<nsasm::Address> written;
+    for (size_t i = 0; i < round.size(); ++i) {
+      const nsasm::Address address = round[i].first;
+      const StatusFlags& flags = round[i].second;
+      Trace& trace = traces[i];
+      bool stale = !pool;
+      for (nsasm::Address read : trace.reads) {
+        stale = stale || written.contains(read);
+      }
+      if (stale) {
+        trace = Trace();
+        results[i] = TraceFrom(address, flags, &trace);
+      }
+      entry_points_.insert(address);
+      if (!results[i].ok()) {
+        errors.push_back(SeedError{address, flags, results[i].error()});
+        continue;
+      }
+      if (pool) {
+        for (const auto& node : trace.new_disassembly) {
+          written.insert(node.first);
+        }
+        for (const auto& node : trace.label_names) {
+          written.insert(node.first);
+        }
+      }
+      Commit(&trace);
+      for (const auto& target : trace.far_branch_targets) {
+        add_to_worklist(target.first, target.second);
       }
     }
   }
+  return errors;
+}
 
-  // Copy the entries from the temporary map to the permanent state.
-  for (const auto& node : new_disassembly) {
-    disassembly_[node.first] = node.second;
+void Disassembler::SaveAnalysis(ByteWriter* out) const {
+  out->WriteU32(return_conventions_.size());
+  for (const auto& node : return_conventions_) {
+    out->WriteU32(AddressBits(node.first));
+    out->WriteU16(ReturnConventionCode(node.second));
+  }
+  out->WriteU32(entry_points_.size());
+  for (nsasm::Address address : entry_points_) {
+    out->WriteU32(AddressBits(address));
+  }
+  out->WriteU32(entry_flags_.size());
+  for (const auto& node : entry_flags_) {
+    out->WriteU32(AddressBits(node.first));
+    out->WriteU8(node.second.ToByte());
   }
 
-  // Apply labels to all instructions.
-  for (const auto& label_name : label_names) {
-    disassembly_[label_name.first].label = label_name.second;
+  // Write each distinct execution state once, and refer to them by index.
+  absl::flat_hash_map<StateHandle, uint32_t> state_index;
+  std::vector<StateHandle> states;
+  auto index_of = [&](StateHandle handle) {
+    auto inserted = state_index.emplace(handle, states.size());
+    if (inserted.second) {
+      states.push_back(handle);
+    }
+    return inserted.first->second;
+  };
+  for (const auto& node : disassembly_) {
+    index_of(node.second.current_execution_state);
+    index_of(node.second.next_execution_state);
+  }
+  out->WriteU32(states.size());
+  for (StateHandle handle : states) {
+    states_.Get(handle).Serialize(out);
+  }
+
+  // Instructions themselves are not written; they are decoded again on load.
+  out->WriteU32(disassembly_.size());
+  for (const auto& node : disassembly_) {
+    const DisassembledInstruction& di = node.second;
+    out->WriteU32(AddressBits(node.first));
+    out->WriteString(di.label);
+    out->WriteU8(di.is_entry);
+    out->WriteU32(state_index[di.current_execution_state]);
+    out->WriteU32(state_index[di.next_execution_state]);
+  }
+}
+
+ErrorOr<void> Disassembler::LoadAnalysis(ByteReader* in) {
+  const Error malformed("Malformed disassembly cache");
+
+  std::map<nsasm::Address, ReturnConvention> return_conventions;
+  for (uint32_t n = in->ReadU32(); n > 0 && in->ok(); --n) {
+    nsasm::Address address(in->ReadU32() & 0xffffff);
+    return_conventions[address] = ReturnConventionFromCode(in->ReadU16(), in);
+  }
+  bool same_conventions =
+      return_conventions.size() == return_conventions_.size();
+  for (auto it1 = return_conventions.begin(), it2 = return_conventions_.begin();
+       same_conventions && it1 != return_conventions.end(); ++it1, ++it2) {
+    same_conventions =
+        it1->first == it2->first &&
+        ReturnConventionCode(it1->second) == ReturnConventionCode(it2->second);
+  }
+
+  std::set<nsasm::Address> entry_points;
+  for (uint32_t n = in->ReadU32(); n > 0 && in->ok(); --n) {
+    entry_points.insert(nsasm::Address(in->ReadU32() & 0xffffff));
+  }
+  std::map<nsasm::Address, StatusFlags> entry_flags;
+  for (uint32_t n = in->ReadU32(); n > 0 && in->ok(); --n) {
+    nsasm::Address address(in->ReadU32() & 0xffffff);
+    entry_flags[address] = StatusFlags::FromByte(in->ReadU8());
+  }
+  std::vector<ExecutionState> saved_states;
+  for (uint32_t n = in->ReadU32(); n > 0 && in->ok(); --n) {
+    saved_states.push_back(ExecutionState::Deserialize(in));
+  }
+  if (!in->ok()) {
+    return malformed;
+  }
+  if (!same_conventions) {
+    return Error("Disassembly cache used different return conventions");
   }
 
-  return far_branch_targets;
+  DisassemblyMap disassembly;
+  // The indices into saved_states of each instruction's states.
+  std::vector<std::tuple<nsasm::Address, uint32_t, uint32_t>> state_indices;
+  for (uint32_t n = in->ReadU32(); n > 0 && in->ok(); --n) {
+    nsasm::Address pc(in->ReadU32() & 0xffffff);
+    DisassembledInstruction& di = disassembly[pc];
+    di.label = in->ReadString();
+    di.is_entry = in->ReadU8();
+    uint32_t current_index = in->ReadU32();
+    uint32_t next_index = in->ReadU32();
+    if (!in->ok() || current_index >= saved_states.size() ||
+        next_index >= saved_states.size()) {
+      return malformed;
+    }
+    state_indices.emplace_back(pc, current_index, next_index);
+
+    // Decode the instruction again, and annotate it as TraceFrom() does.
+    const StatusFlags& flags = saved_states[current_index].Flags();
+    auto instruction_data = src_->ReadView(pc, 4);
+    NSASM_RETURN_IF_ERROR_WITH_LOCATION(instruction_data, src_->Path(), pc);
+    DecodedOp op;
+    if (!DecodeOp(*instruction_data, flags, &op)) {
+      return Error("Disassembly cache does not match input")
+          .SetLocation(src_->Path(), pc);
+    }
+    di.instruction = ToInstruction(op);
+    Instruction& ins = di.instruction;
+    auto far_branch_address = ins.FarBranchTarget(pc);
+    if (far_branch_address.has_value() &&
+        (ins.mnemonic == M_jsr || ins.mnemonic == M_jsl)) {
+      auto it = return_conventions_.find(*far_branch_address);
+      if (it != return_conventions_.end()) {
+        ins.return_convention = it->second;
+      }
+    }
+    if (ins.IsLocalBranch()) {
+      nsasm::Address target = pc.AddWrapped(op.length).AddWrapped(op.arg1);
+      ins.arg1.ApplyLabel(GenSym(target));
+    }
+    ApplySizeSuffix(flags, &ins);
+  }
+  if (!in->ok() || !in->AtEnd()) {
+    return malformed;
+  }
+
+  // Nothing can fail from here on, so the states can be added to the pool.
+  std::vector<StateHandle> states;
+  for (const ExecutionState& state : saved_states) {
+    states.push_back(states_.Intern(state));
+  }
+  for (const auto& [pc, current_index, next_index] : state_indices) {
+    DisassembledInstruction& di = disassembly[pc];
+    di.current_execution_state = states[current_index];
+    di.next_execution_state = states[next_index];
+  }
+  disassembly_ = std::move(disassembly);
+  entry_points_ = std::move(entry_points);
+  entry_flags_ = std::move(entry_flags);
+  return {};
 }
 
 ErrorOr<void> Disassembler::Cleanup() {
-  // Currently all labels are "gensym#" in visitation order; change them to
-  // "label#" or "entry#", in address order.
+  // Currently all labels are "gensym######" names derived from their
+  // addresses; change them to "label#" or "entry#", in address order.
   int next_label = 0;
   int next_entry = 0;
   absl::flat_hash_map<std::string, std::string> label_rewrite;
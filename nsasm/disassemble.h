@@ -1,32 +1,27 @@
 #ifndef NSASM_DISASSEMBLE_H_
 #define NSASM_DISASSEMBLE_H_
 
+#include <functional>
 #include <map>
 #include <string>
+#include <vector>
 
+#include "absl/strings/str_format.h"
 #include "absl/types/optional.h"
+#include "nsasm/disassembly_map.h"
 #include "nsasm/error.h"
 #include "nsasm/execution_state.h"
 #include "nsasm/instruction.h"
 #include "nsasm/memory.h"
 #include "nsasm/rom.h"
+#include "nsasm/serialize.h"
+#include "nsasm/thread_pool.h"
 
 namespace nsasm {
 
-struct DisassembledInstruction {
-  std::string label;
-  Instruction instruction;
-  bool is_entry = false;
-  ExecutionState current_execution_state;
-  ExecutionState next_execution_state;
-};
-
-using DisassemblyMap = std::map<nsasm::Address, DisassembledInstruction>;
-
 class Disassembler {
  public:
-  Disassembler(std::unique_ptr<InputSource> src)
-      : src_(std::move(src)), current_sym_(0) {}
+  Disassembler(std::unique_ptr<InputSource> src) : src_(std::move(src)) {}
 
   // movable but not copiable
   Disassembler(const Disassembler&) = delete;
@@ -41,10 +36,58 @@ class Disassembler {
   // this disassembly.
   ErrorOr<std::map<nsasm::Address, StatusFlags>> Disassemble(
       nsasm::Address starting_address, const StatusFlags& initial_status_flags);
+
+  // An error encountered while disassembling from a single entry point.
+  struct SeedError {
+    nsasm::Address address;
+    StatusFlags flags;
+    Error error;
+  };
+
+  // Disassemble from each of the given seeds, and then from the far branch
+  // targets found, until no new code is discovered.
+  //
+  // The merged incoming flag state of every entry point is remembered, even
+  // across calls, and an entry point is only disassembled again when that
+  // merged state changes.  Entry points are visited in rounds, in address
+  // order within each round, so the result is deterministic.
+  //
+  // If `skip` is provided, addresses for which it returns true are never
+  // disassembled.  (This is used to avoid disassembling code that is already
+  // available as source.)
+  //
+  // If `pool` is provided, the entry points in each round are traced in
+  // parallel.  The result is identical to the single-threaded result.  The
+  // input source must be safe to read from multiple threads at once.
+  //
+  // Failing to disassemble from one entry point does not stop the process.
+  // All such errors are returned, in the order they were encountered.
+  std::vector<SeedError> DisassembleToFixedPoint(
+      const std::map<nsasm::Address, StatusFlags>& seeds,
+      const std::function<bool(nsasm::Address)>& skip = nullptr,
+      ThreadPool* pool = nullptr);
+
+  // Writes the analysis performed so far (the disassembly, entry points and
+  // their merged flag states, and the return conventions in use) to `out`.
+  // This must be called before Cleanup().
+  void SaveAnalysis(ByteWriter* out) const;
+
+  // Replaces this object's analysis with one written by SaveAnalysis().
+  // Instructions are decoded again from the input source, which must hold
+  // the same data as when the analysis was saved.  Fails, without modifying
+  // this object, if the data is malformed, or if the return conventions
+  // installed here differ from those used by the saved analysis.
+  ErrorOr<void> LoadAnalysis(ByteReader* in);
+
   ErrorOr<void> Cleanup();
 
   const DisassemblyMap& Result() const { return disassembly_; }
 
+  // Returns the execution state referred to by a handle in Result().
+  const ExecutionState& State(StateHandle handle) const {
+    return states_.Get(handle);
+  }
+
   // Install a set of subroutine return calling convention.  Any subroutine jump
   // to the given address is disassembled with the given return convention.
   // This will cause jumps to the provided addresses to set the flag state, or
@@ -55,15 +98,53 @@ class Disassembler {
   }
 
  private:
+  // A DisassembledInstruction holding full execution states.  Traces work
+  // with these, so that they never need to write to states_.
+  struct TracedInstruction {
+    std::string label;
+    Instruction instruction;
+    bool is_entry = false;
+    ExecutionState current_execution_state;
+    ExecutionState next_execution_state;
+  };
+
+  // The result of disassembling from a single entry point, before it is
+  // merged into the disassembler's state.
+  struct Trace {
+    // Newly decoded, or locally modified, instructions.
+    std::map<nsasm::Address, TracedInstruction> new_disassembly;
+    // Labels for newly found jump targets.
+    std::map<nsasm::Address, std::string> label_names;
+    // Far branch targets found, with their incoming flag state.
+    std::map<nsasm::Address, StatusFlags> far_branch_targets;
+    // Every address at which the existing disassembly was consulted.
+    std::vector<nsasm::Address> reads;
+  };
+
+  // Disassembles code starting at the given address and state, without
+  // modifying this object.  This is safe to call from several threads at once.
+  ErrorOr<void> TraceFrom(nsasm::Address starting_address,
+                          const StatusFlags& initial_status_flags,
+                          Trace* trace) const;
+
+  // Merges a successful trace into the disassembly.
+  void Commit(Trace* trace);
+
   absl::optional<std::string> NameForAddress(nsasm::Address address);
 
-  std::string GenSym() { return absl::StrCat("gensym", ++current_sym_); }
+  static std::string GenSym(nsasm::Address address) {
+    return absl::StrFormat("gensym%02x%04x", address.Bank(),
+                           address.BankAddress());
+  }
 
   std::unique_ptr<InputSource> src_;
   std::set<nsasm::Address> entry_points_;
-  std::map<nsasm::Address, DisassembledInstruction> disassembly_;
+  DisassemblyMap disassembly_;
+  ExecutionStatePool states_;
   std::map<nsasm::Address, ReturnConvention> return_conventions_;
-  int current_sym_;
+  // Merged flag state of all branches into each entry point seen by
+  // DisassembleToFixedPoint().
+  std::map<nsasm::Address, StatusFlags> entry_flags_;
 };
 
 };  // namespace nsasm
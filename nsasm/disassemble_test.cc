@@ -0,0 +1,168 @@
+#include "nsasm/disassemble.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "nsasm/rom.h"
+#include "nsasm/thread_pool.h"
+
+namespace nsasm {
+namespace {
+
+using testing::HasSubstr;
+using testing::IsEmpty;
+using testing::SizeIs;
+
+const StatusFlags kM8X8(B_off, B_on, B_on);
+const StatusFlags kM16X16(B_off, B_off, B_off);
+
+// Builds a 64KiB HiRom image, visible at bank $c0, with the given code at the
+// given offsets.  Unused space is filled with STP.
+std::unique_ptr<Rom> MakeRom(
+    const std::vector<std::pair<int, std::vector<uint8_t>>>& code) {
+  std::vector<uint8_t> data(0x10000, 0xdb);
+  for (const auto& chunk : code) {
+    std::copy(chunk.second.begin(), chunk.second.end(),
+              data.begin() + chunk.first);
+  }
+  return std::make_unique<Rom>(kHiRom, "test.sfc", std::vector<uint8_t>(),
+                               std::move(data));
+}
+
+TEST(Disassembler, FixedPointFollowsDeepCallChains) {
+  // A chain of 200 subroutines, each calling the next.
+  const int kDepth = 200;
+  std::vector<std::pair<int, std::vector<uint8_t>>> code;
+  for (int i = 0; i < kDepth - 1; ++i) {
+    // JSL next; RTL
+    int next = (i + 1) * 5;
+    code.push_back(
+        {i * 5, {0x22, uint8_t(next), uint8_t(next >> 8), 0xc0, 0x6b}});
+  }
+  code.push_back({(kDepth - 1) * 5, {0x6b}});  // RTL
+
+  Disassembler disassembler(MakeRom(code));
+  auto errors =
+      disassembler.DisassembleToFixedPoint({{Address(0xc00000), kM8X8}});
+  EXPECT_THAT(errors, IsEmpty());
+  EXPECT_THAT(disassembler.Result(), SizeIs(kDepth * 2 - 1));
+}
+
+TEST(Disassembler, FixedPointReentersOnlyOnFlagChange) {
+  // LDA #$12; RTL -- only decodable if the M flag is known.
+  Disassembler disassembler(MakeRom({{0x1000, {0xa9, 0x12, 0x6b}}}));
+  const Address entry(0xc01000);
+
+  EXPECT_THAT(disassembler.DisassembleToFixedPoint({{entry, kM8X8}}),
+              IsEmpty());
+  EXPECT_THAT(disassembler.Result(), SizeIs(2));
+
+  // Seeing the same entry point again with the same flags does no work.
+  EXPECT_THAT(disassembler.DisassembleToFixedPoint({{entry, kM8X8}}),
+              IsEmpty());
+
+  // A conflicting flag state is merged with the previous one and revisited,
+  // which makes the immediate argument size ambiguous.
+  auto errors = disassembler.DisassembleToFixedPoint({{entry, kM16X16}});
+  ASSERT_THAT(errors, SizeIs(1));
+  EXPECT_EQ(errors[0].address, entry);
+  EXPECT_EQ(errors[0].flags, kM8X8 | kM16X16);
+  EXPECT_THAT(errors[0].error.ToString(), HasSubstr("processor state"));
+
+  // The merged state is remembered, so the error isn't reported twice.
+  EXPECT_THAT(disassembler.DisassembleToFixedPoint({{entry, kM16X16}}),
+              IsEmpty());
+}
+
+TEST(Disassembler, FixedPointSkipsAddresses) {
+  Disassembler disassembler(MakeRom({
+      {0x0000, {0x22, 0x00, 0x20, 0xc0, 0x6b}},  // JSL $c02000; RTL
+      {0x2000, {0x6b}},                          // RTL
+  }));
+  auto errors = disassembler.DisassembleToFixedPoint(
+      {{Address(0xc00000), kM8X8}},
+      [](Address address) { return address == Address(0xc02000); });
+  EXPECT_THAT(errors, IsEmpty());
+  EXPECT_THAT(disassembler.Result(), SizeIs(2));
+  EXPECT_EQ(disassembler.Result().count(Address(0xc02000)), 0);
+}
+
+// Renders everything about a disassembly that is visible in its output.
+std::vector<std::string> Describe(const Disassembler& disassembler) {
+  std::vector<std::string> result;
+  for (const auto& node : disassembler.Result()) {
+    const DisassembledInstruction& di = node.second;
+    result.push_back(absl::StrFormat(
+        "%s %s%s %s %s", node.first.ToString(), di.label,
+        di.is_entry ? "*" : "", di.instruction.ToString(),
+        disassembler.State(di.current_execution_state).Flags().ToString()));
+  }
+  return result;
+}
+
+TEST(Disassembler, ParallelFixedPointMergesSharedCode) {
+  // Two entry points in the same round which reach the same code in different
+  // states.  The shared code must end up with the merged state.
+  auto make_rom = [] {
+    return MakeRom({
+        {0x0000, {0xe2, 0x20, 0x80, 0x1c}},  // SEP #$20; BRA $c00020
+        {0x0010, {0xc2, 0x20, 0x80, 0x0c}},  // REP #$20; BRA $c00020
+        {0x0020, {0xea, 0x6b}},              // NOP; RTL
+    });
+  };
+  const std::map<Address, StatusFlags> seeds = {{Address(0xc00000), kM8X8},
+                                                {Address(0xc00010), kM8X8}};
+
+  Disassembler sequential(make_rom());
+  EXPECT_THAT(sequential.DisassembleToFixedPoint(seeds), IsEmpty());
+  ThreadPool pool(2);
+  Disassembler parallel(make_rom());
+  EXPECT_THAT(parallel.DisassembleToFixedPoint(seeds, nullptr, &pool),
+              IsEmpty());
+  EXPECT_EQ(Describe(parallel), Describe(sequential));
+  const DisassembledInstruction& shared =
+      parallel.Result().at(Address(0xc00020));
+  EXPECT_EQ(parallel.State(shared.current_execution_state).Flags().MBit(),
+            B_unknown);
+}
+
+TEST(Disassembler, ParallelFixedPointMatchesSequential) {
+  // Random bytes make for lots of tangled, overlapping code paths, which
+  // exercises the conflict handling in the parallel path.
+  std::mt19937 rng(12345);
+  std::vector<uint8_t> data(0x10000);
+  for (uint8_t& byte : data) {
+    byte = uint8_t(rng());
+  }
+  std::map<Address, StatusFlags> seeds;
+  for (int i = 0; i < 64; ++i) {
+    seeds.emplace(Address(0xc00000 | (rng() & 0xffff)), kM8X8);
+  }
+
+  auto run = [&](ThreadPool* pool) {
+    Disassembler disassembler(std::make_unique<Rom>(
+        kHiRom, "test.sfc", std::vector<uint8_t>(), data));
+    std::vector<std::string> result;
+    for (const auto& error :
+         disassembler.DisassembleToFixedPoint(seeds, nullptr, pool)) {
+      result.push_back(error.address.ToString() + error.error.ToString());
+    }
+    EXPECT_TRUE(disassembler.Cleanup().ok());
+    for (std::string& line : Describe(disassembler)) {
+      result.push_back(std::move(line));
+    }
+    return result;
+  };
+
+  const std::vector<std::string> sequential = run(nullptr);
+  EXPECT_THAT(sequential, SizeIs(testing::Gt(64)));
+  ThreadPool pool(4);
+  EXPECT_EQ(run(&pool), sequential);
+}
+
+}  // namespace
+}  // namespace nsasm
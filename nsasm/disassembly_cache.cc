@@ -0,0 +1,98 @@
+#include "nsasm/disassembly_cache.h"
+
+#include "absl/strings/str_format.h"
+#include "nsasm/serialize.h"
+
+namespace nsasm {
+
+namespace {
+
+constexpr uint32_t kCacheMagic = 0x4344534e;  // "NSDC"
+constexpr uint32_t kCacheVersion = 2;
+
+uint32_t AddressBits(nsasm::Address address) {
+  return (address.Bank() << 16) | address.BankAddress();
+}
+
+// Returns true if every seed in `subset` also appears in `seeds`, with the
+// same flags.
+bool IsSubset(const std::map<nsasm::Address, StatusFlags>& subset,
+              const std::map<nsasm::Address, StatusFlags>& seeds) {
+  for (const auto& node : subset) {
+    auto it = seeds.find(node.first);
+    if (it == seeds.end() || it->second != node.second) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+std::string DisassemblyCachePath(const std::string& cache_dir, uint64_t key) {
+  return absl::StrFormat("%s/%016x.nsdis", cache_dir, key);
+}
+
+std::vector<Disassembler::SeedError> CachedDisassembleToFixedPoint(
+    const std::string& cache_path, uint64_t key, Disassembler* disassembler,
+    const std::map<nsasm::Address, StatusFlags>& seeds,
+    const std::function<bool(nsasm::Address)>& skip, ThreadPool* pool) {
+  std::vector<Disassembler::SeedError> errors;
+  std::map<nsasm::Address, StatusFlags> cached_seeds;
+  bool loaded = false;
+
+  // A missing or unusable cache file just means starting from scratch.
+  auto data = ReadBinaryFile(cache_path);
+  if (data.ok()) {
+    ByteReader in(*data);
+    if (in.ReadU32() == kCacheMagic && in.ReadU32() == kCacheVersion &&
+        in.ReadU64() == key) {
+      for (uint32_t n = in.ReadU32(); n > 0 && in.ok(); --n) {
+        nsasm::Address address(in.ReadU32() & 0xffffff);
+        cached_seeds[address] = StatusFlags::FromByte(in.ReadU8());
+      }
+      for (uint32_t n = in.ReadU32(); n > 0 && in.ok(); --n) {
+        nsasm::Address address(in.ReadU32() & 0xffffff);
+        StatusFlags flags = StatusFlags::FromByte(in.ReadU8());
+        std::string message = in.ReadString();
+        errors.push_back(
+            Disassembler::SeedError{address, flags, Error("%s", message)});
+      }
+      loaded = in.ok() && IsSubset(cached_seeds, seeds) &&
+               disassembler->LoadAnalysis(&in).ok();
+    }
+  }
+  if (!loaded) {
+    errors.clear();
+  } else if (cached_seeds == seeds) {
+    return errors;
+  }
+
+  // Entry points already analyzed with the same flags are not revisited, so
+  // this only does work for the new seeds.
+  for (auto& error : disassembler->DisassembleToFixedPoint(seeds, skip, pool)) {
+    errors.push_back(std::move(error));
+  }
+
+  ByteWriter out;
+  out.WriteU32(kCacheMagic);
+  out.WriteU32(kCacheVersion);
+  out.WriteU64(key);
+  out.WriteU32(seeds.size());
+  for (const auto& node : seeds) {
+    out.WriteU32(AddressBits(node.first));
+    out.WriteU8(node.second.ToByte());
+  }
+  out.WriteU32(errors.size());
+  for (const auto& error : errors) {
+    out.WriteU32(AddressBits(error.address));
+    out.WriteU8(error.flags.ToByte());
+    out.WriteString(error.error.ToString());
+  }
+  disassembler->SaveAnalysis(&out);
+  // The cache only saves time; a failed write costs nothing else.
+  (void)WriteBinaryFile(cache_path, out.Data());
+  return errors;
+}
+
+}  // namespace nsasm
@@ -0,0 +1,44 @@
+#ifndef NSASM_DISASSEMBLY_CACHE_H_
+#define NSASM_DISASSEMBLY_CACHE_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "nsasm/disassemble.h"
+#include "nsasm/error.h"
+#include "nsasm/thread_pool.h"
+
+namespace nsasm {
+
+// Returns the cache file path to use for the given key inside `cache_dir`.
+std::string DisassemblyCachePath(const std::string& cache_dir, uint64_t key);
+
+// Runs `disassembler->DisassembleToFixedPoint(seeds, skip, pool)`, reusing
+// the results of an earlier run stored at `cache_path`, and then writes the
+// new results back to that path.
+//
+// `key` must identify everything the disassembly depends on apart from the
+// seeds and the disassembler's return conventions: the ROM contents (see
+// Fnv1a()), and whatever `skip` is derived from.  A cache file with a
+// different key is ignored.
+//
+// When the cached seeds are exactly `seeds`, the cached analysis is loaded
+// with no further work.  When `seeds` adds new seeds to the cached set, the
+// cached analysis is loaded and extended from the new seeds only.  Otherwise
+// the disassembly starts from scratch.  In all cases, the returned errors
+// include those recorded with the cached analysis.
+//
+// `disassembler` must not have been used yet.  Failing to write the cache file
+// is not an error; the next run just starts from scratch.
+std::vector<Disassembler::SeedError> CachedDisassembleToFixedPoint(
+    const std::string& cache_path, uint64_t key, Disassembler* disassembler,
+    const std::map<nsasm::Address, StatusFlags>& seeds,
+    const std::function<bool(nsasm::Address)>& skip = nullptr,
+    ThreadPool* pool = nullptr);
+
+}  // namespace nsasm
+
+#endif  // NSASM_DISASSEMBLY_CACHE_H_
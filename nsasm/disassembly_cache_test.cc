@@ -0,0 +1,197 @@
+#include "nsasm/disassembly_cache.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "nsasm/rom.h"
+#include "nsasm/serialize.h"
+
+namespace nsasm {
+namespace {
+
+const StatusFlags kM8X8(B_off, B_on, B_on);
+const StatusFlags kM16X16(B_off, B_off, B_off);
+
+std::vector<uint8_t> MakeRomData() {
+  std::vector<uint8_t> data(0x10000, 0xdb);  // STP
+  auto put = [&data](int offset, std::vector<uint8_t> code) {
+    std::copy(code.begin(), code.end(), data.begin() + offset);
+  };
+  // $c00000: LDA #$12; BEQ +2; JSL $c01000; LDY #$34; RTL
+  put(0x0000, {0xa9, 0x12, 0xf0, 0x04, 0x22, 0x00, 0x10, 0xc0, 0xa0, 0x34,
+               0x6b});
+  // $c01000: REP #$30; LDA #$1234; RTL
+  put(0x1000, {0xc2, 0x30, 0xa9, 0x34, 0x12, 0x6b});
+  // $c02000: JSL $c01000; RTL
+  put(0x2000, {0x22, 0x00, 0x10, 0xc0, 0x6b});
+  // $c03000: LDA #$00 -- fails to decode with unknown M flag; RTL
+  put(0x3000, {0xa9, 0x00, 0x6b});
+  return data;
+}
+
+std::unique_ptr<Rom> MakeRom(std::vector<uint8_t> data = MakeRomData()) {
+  return std::make_unique<Rom>(kHiRom, "test.sfc", std::vector<uint8_t>(),
+                               std::move(data));
+}
+
+// Renders the errors and cleaned-up disassembly from a run.
+std::vector<std::string> Describe(
+    const std::vector<Disassembler::SeedError>& errors,
+    Disassembler* disassembler) {
+  std::vector<std::string> result;
+  for (const auto& error : errors) {
+    result.push_back(absl::StrFormat("error %s %s %s", error.address.ToString(),
+                                     error.flags.ToString(),
+                                     error.error.ToString()));
+  }
+  EXPECT_TRUE(disassembler->Cleanup().ok());
+  for (const auto& node : disassembler->Result()) {
+    const DisassembledInstruction& di = node.second;
+    result.push_back(absl::StrFormat(
+        "%s %s%s %s %s %s", node.first.ToString(), di.label,
+        di.is_entry ? "*" : "", di.instruction.ToString(),
+        disassembler->State(di.current_execution_state).Flags().ToString(),
+        disassembler->State(di.next_execution_state).Flags().ToString()));
+  }
+  return result;
+}
+
+std::vector<std::string> Uncached(
+    const std::map<Address, StatusFlags>& seeds) {
+  Disassembler disassembler(MakeRom());
+  auto errors = disassembler.DisassembleToFixedPoint(seeds);
+  return Describe(errors, &disassembler);
+}
+
+std::vector<std::string> Cached(const std::string& path, uint64_t key,
+                                const std::map<Address, StatusFlags>& seeds) {
+  Disassembler disassembler(MakeRom());
+  auto errors =
+      CachedDisassembleToFixedPoint(path, key, &disassembler, seeds);
+  return Describe(errors, &disassembler);
+}
+
+class DisassemblyCacheTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = DisassemblyCachePath(
+        testing::TempDir(),
+        Fnv1a(testing::UnitTest::GetInstance()->current_test_info()->name()));
+    std::remove(path_.c_str());
+  }
+  void TearDown() override { std::remove(path_.c_str()); }
+
+  std::string path_;
+  const uint64_t key_ = Fnv1a(MakeRomData());
+};
+
+TEST_F(DisassemblyCacheTest, WarmRunMatchesColdRun) {
+  const std::map<Address, StatusFlags> seeds = {
+      {Address(0xc00000), kM8X8},
+      {Address(0xc03000), StatusFlags()},
+  };
+  const std::vector<std::string> expected = Uncached(seeds);
+  ASSERT_THAT(expected, testing::Contains(testing::HasSubstr("error")));
+
+  EXPECT_EQ(Cached(path_, key_, seeds), expected);
+  auto cache_file = ReadBinaryFile(path_);
+  ASSERT_TRUE(cache_file.ok());
+
+  // The second run loads the cache, and has nothing to write back.
+  EXPECT_EQ(Cached(path_, key_, seeds), expected);
+  EXPECT_EQ(*ReadBinaryFile(path_), *cache_file);
+}
+
+TEST_F(DisassemblyCacheTest, ExtendsFromNewSeeds) {
+  const std::map<Address, StatusFlags> seeds = {{Address(0xc00000), kM8X8}};
+  const std::map<Address, StatusFlags> more_seeds = {
+      {Address(0xc00000), kM8X8},
+      {Address(0xc02000), kM16X16},
+  };
+  Cached(path_, key_, seeds);
+  EXPECT_EQ(Cached(path_, key_, more_seeds), Uncached(more_seeds));
+  // The cache now holds the larger seed set.
+  EXPECT_EQ(Cached(path_, key_, more_seeds), Uncached(more_seeds));
+}
+
+TEST_F(DisassemblyCacheTest, IgnoresUnusableCache) {
+  const std::map<Address, StatusFlags> seeds = {{Address(0xc00000), kM8X8}};
+  const std::map<Address, StatusFlags> other_seeds = {
+      {Address(0xc00000), kM16X16}};
+
+  // A seed with changed flags forces a cold run.
+  Cached(path_, key_, seeds);
+  EXPECT_EQ(Cached(path_, key_, other_seeds), Uncached(other_seeds));
+
+  // So does a different key.
+  Cached(path_, key_, seeds);
+  EXPECT_EQ(Cached(path_, key_ + 1, seeds), Uncached(seeds));
+
+  // And a corrupt file.
+  Cached(path_, key_, seeds);
+  auto data = ReadBinaryFile(path_);
+  ASSERT_TRUE(data.ok());
+  data->resize(data->size() - 3);
+  ASSERT_TRUE(WriteBinaryFile(path_, *data).ok());
+  EXPECT_EQ(Cached(path_, key_, seeds), Uncached(seeds));
+}
+
+TEST_F(DisassemblyCacheTest, IgnoresUnwritableCache) {
+  const std::map<Address, StatusFlags> seeds = {
+      {Address(0xc00000), kM8X8},
+      {Address(0xc03000), StatusFlags()},
+  };
+  const std::string path = DisassemblyCachePath(
+      testing::TempDir() + "/no/such/dir", key_);
+  EXPECT_EQ(Cached(path, key_, seeds), Uncached(seeds));
+  EXPECT_FALSE(ReadBinaryFile(path).ok());
+}
+
+TEST_F(DisassemblyCacheTest, ChecksReturnConventions) {
+  const std::map<Address, StatusFlags> seeds = {{Address(0xc02000), kM8X8}};
+  Cached(path_, key_, seeds);
+
+  // A return convention changes the disassembly, so the cache can't be used.
+  Disassembler disassembler(MakeRom());
+  disassembler.AddTargetReturnConventions(
+      {{Address(0xc01000), ReturnConvention(NoReturn())}});
+  auto errors =
+      CachedDisassembleToFixedPoint(path_, key_, &disassembler, seeds);
+  std::vector<std::string> description = Describe(errors, &disassembler);
+
+  Disassembler uncached(MakeRom());
+  uncached.AddTargetReturnConventions(
+      {{Address(0xc01000), ReturnConvention(NoReturn())}});
+  EXPECT_EQ(description,
+            Describe(uncached.DisassembleToFixedPoint(seeds), &uncached));
+}
+
+TEST(DisassemblerAnalysis, RoundTrip) {
+  const std::map<Address, StatusFlags> seeds = {{Address(0xc00000), kM8X8}};
+  Disassembler disassembler(MakeRom());
+  EXPECT_THAT(disassembler.DisassembleToFixedPoint(seeds), testing::IsEmpty());
+  ByteWriter out;
+  disassembler.SaveAnalysis(&out);
+
+  Disassembler loaded(MakeRom());
+  ByteReader in(out.Data());
+  ASSERT_TRUE(loaded.LoadAnalysis(&in).ok());
+  // Nothing is left to do for the same seeds.
+  EXPECT_THAT(loaded.DisassembleToFixedPoint(seeds), testing::IsEmpty());
+  EXPECT_EQ(Describe({}, &loaded), Describe({}, &disassembler));
+
+  // Truncated data is rejected, leaving the disassembler untouched.
+  std::vector<uint8_t> truncated = out.Data();
+  truncated.pop_back();
+  Disassembler failed(MakeRom());
+  ByteReader truncated_in(truncated);
+  EXPECT_FALSE(failed.LoadAnalysis(&truncated_in).ok());
+  EXPECT_TRUE(failed.Result().empty());
+}
+
+}  // namespace
+}  // namespace nsasm
@@ -0,0 +1,63 @@
+#include "nsasm/disassembly_map.h"
+
+namespace nsasm {
+
+constexpr uint32_t DisassemblyMap::kEnd;
+constexpr uint32_t DisassemblyMap::kNoSlot;
+
+DisassembledInstruction& DisassemblyMap::operator[](nsasm::Address address) {
+  std::unique_ptr<Bank>& bank = banks_[address.Bank()];
+  if (!bank) {
+    bank = std::make_unique<Bank>();
+    bank->slots.fill(kNoSlot);
+  }
+  uint32_t& slot = bank->slots[address.BankAddress()];
+  if (slot == kNoSlot) {
+    slot = entries_.size();
+    entries_.emplace_back(address, DisassembledInstruction());
+    ++bank->count;
+  }
+  return entries_[slot].second;
+}
+
+DisassemblyMap::iterator DisassemblyMap::erase(iterator it) {
+  const uint32_t address = it.address_;
+  Bank& bank = *banks_[address >> 16];
+  uint32_t& slot = bank.slots[address & 0xffff];
+
+  // Move the last entry into the hole, so that storage stays contiguous.
+  const uint32_t last = entries_.size() - 1;
+  if (slot != last) {
+    const uint32_t moved = Raw(entries_[last].first);
+    entries_[slot] = std::move(entries_[last]);
+    banks_[moved >> 16]->slots[moved & 0xffff] = slot;
+  }
+  entries_.pop_back();
+  slot = kNoSlot;
+  --bank.count;
+  return iterator(this, NextAddress(address + 1));
+}
+
+void DisassemblyMap::clear() {
+  entries_.clear();
+  for (std::unique_ptr<Bank>& bank : banks_) {
+    bank.reset();
+  }
+}
+
+uint32_t DisassemblyMap::NextAddress(uint32_t address) const {
+  while (address < kEnd) {
+    const Bank* bank = banks_[address >> 16].get();
+    if (bank && bank->count > 0) {
+      for (uint32_t offset = address & 0xffff; offset < 0x10000; ++offset) {
+        if (bank->slots[offset] != kNoSlot) {
+          return (address & 0xff0000) | offset;
+        }
+      }
+    }
+    address = (address & 0xff0000) + 0x10000;
+  }
+  return kEnd;
+}
+
+}  // namespace nsasm
@@ -0,0 +1,165 @@
+#ifndef NSASM_DISASSEMBLY_MAP_H_
+#define NSASM_DISASSEMBLY_MAP_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "nsasm/address.h"
+#include "nsasm/execution_state_pool.h"
+#include "nsasm/instruction.h"
+
+namespace nsasm {
+
+struct DisassembledInstruction {
+  std::string label;
+  Instruction instruction;
+  bool is_entry = false;
+  // Handles into the owning Disassembler's ExecutionStatePool.
+  StateHandle current_execution_state;
+  StateHandle next_execution_state;
+};
+
+// Ordered mapping of addresses to disassembled instructions.
+//
+// Instructions are stored contiguously.  Each bank that holds any
+// instructions gets a lazily allocated table with one slot per address,
+// indexing into that storage, so lookups are a pair of array accesses.
+//
+// Iteration visits entries in address order.  Iterators refer to an address
+// rather than a storage location, so they remain valid when other entries
+// are inserted or erased.
+class DisassemblyMap {
+ public:
+  using value_type = std::pair<nsasm::Address, DisassembledInstruction>;
+
+  template <bool kConst>
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = DisassemblyMap::value_type;
+    using difference_type = std::ptrdiff_t;
+    using reference =
+        typename std::conditional<kConst, const value_type&, value_type&>::type;
+    using pointer =
+        typename std::conditional<kConst, const value_type*, value_type*>::type;
+    using map_pointer = typename std::conditional<kConst, const DisassemblyMap*,
+                                                  DisassemblyMap*>::type;
+
+    Iterator() : map_(nullptr), address_(kEnd) {}
+    // Allow conversion from iterator to const_iterator.
+    template <bool kOtherConst,
+              typename = typename std::enable_if<kConst && !kOtherConst>::type>
+    Iterator(const Iterator<kOtherConst>& rhs)
+        : map_(rhs.map_), address_(rhs.address_) {}
+
+    // The key must not be modified through a non-const iterator.
+    reference operator*() const { return map_->entries_[map_->Slot(address_)]; }
+    pointer operator->() const { return &**this; }
+
+    Iterator& operator++() {
+      address_ = map_->NextAddress(address_ + 1);
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    bool operator==(const Iterator& rhs) const {
+      return address_ == rhs.address_;
+    }
+    bool operator!=(const Iterator& rhs) const {
+      return address_ != rhs.address_;
+    }
+
+   private:
+    friend class DisassemblyMap;
+    template <bool>
+    friend class Iterator;
+
+    Iterator(map_pointer map, uint32_t address)
+        : map_(map), address_(address) {}
+
+    map_pointer map_;
+    uint32_t address_;
+  };
+
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  DisassemblyMap() = default;
+  DisassemblyMap(DisassemblyMap&&) = default;
+  DisassemblyMap& operator=(DisassemblyMap&&) = default;
+
+  bool empty() const { return entries_.empty(); }
+  size_t size() const { return entries_.size(); }
+
+  iterator begin() { return iterator(this, NextAddress(0)); }
+  iterator end() { return iterator(this, kEnd); }
+  const_iterator begin() const { return const_iterator(this, NextAddress(0)); }
+  const_iterator end() const { return const_iterator(this, kEnd); }
+
+  iterator find(nsasm::Address address) {
+    return Contains(address) ? iterator(this, Raw(address)) : end();
+  }
+  const_iterator find(nsasm::Address address) const {
+    return Contains(address) ? const_iterator(this, Raw(address)) : end();
+  }
+  size_t count(nsasm::Address address) const { return Contains(address); }
+
+  // Returns the instruction at the given address, inserting an empty one if
+  // none exists.
+  DisassembledInstruction& operator[](nsasm::Address address);
+
+  // Returns the instruction at the given address, which must exist.
+  const DisassembledInstruction& at(nsasm::Address address) const {
+    return entries_[Slot(Raw(address))].second;
+  }
+
+  // Removes the given entry, and returns an iterator to the entry following
+  // it.
+  iterator erase(iterator it);
+
+  void clear();
+
+ private:
+  static constexpr uint32_t kEnd = 0x1000000;
+  static constexpr uint32_t kNoSlot = 0xffffffff;
+
+  struct Bank {
+    std::array<uint32_t, 0x10000> slots;
+    int count = 0;
+  };
+
+  static uint32_t Raw(nsasm::Address address) {
+    return (uint32_t(address.Bank()) << 16) | address.BankAddress();
+  }
+
+  bool Contains(nsasm::Address address) const {
+    const Bank* bank = banks_[address.Bank()].get();
+    return bank && bank->slots[address.BankAddress()] != kNoSlot;
+  }
+
+  // Index into entries_ of the given present address.
+  uint32_t Slot(uint32_t address) const {
+    return banks_[address >> 16]->slots[address & 0xffff];
+  }
+
+  // Returns the first present address at or after the given one, or kEnd.
+  uint32_t NextAddress(uint32_t address) const;
+
+  std::vector<value_type> entries_;
+  std::array<std::unique_ptr<Bank>, 256> banks_;
+};
+
+}  // namespace nsasm
+
+#endif  // NSASM_DISASSEMBLY_MAP_H_
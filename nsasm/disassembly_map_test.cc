@@ -0,0 +1,99 @@
+#include "nsasm/disassembly_map.h"
+
+#include <map>
+#include <random>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace nsasm {
+namespace {
+
+// Returns the addresses and labels in the map, in iteration order.
+std::vector<std::pair<Address, std::string>> Contents(
+    const DisassemblyMap& map) {
+  std::vector<std::pair<Address, std::string>> result;
+  for (const auto& node : map) {
+    result.emplace_back(node.first, node.second.label);
+  }
+  return result;
+}
+
+TEST(DisassemblyMap, Basics) {
+  DisassemblyMap map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.begin(), map.end());
+
+  map[Address(0x808000)].label = "b";
+  map[Address(0x008000)].label = "a";
+  map[Address(0x80ffff)].label = "c";
+  map[Address(0xff0000)].label = "d";
+  EXPECT_EQ(map.size(), 4);
+  EXPECT_EQ(map.count(Address(0x008000)), 1);
+  EXPECT_EQ(map.count(Address(0x008001)), 0);
+  EXPECT_EQ(map.count(Address(0x018000)), 0);
+  EXPECT_EQ(map.at(Address(0x80ffff)).label, "c");
+  EXPECT_EQ(map.find(Address(0x123456)), map.end());
+  EXPECT_EQ(map.find(Address(0x808000))->second.label, "b");
+
+  // Iteration is in address order, not insertion order.
+  EXPECT_THAT(Contents(map),
+              testing::ElementsAre(std::make_pair(Address(0x008000), "a"),
+                                   std::make_pair(Address(0x808000), "b"),
+                                   std::make_pair(Address(0x80ffff), "c"),
+                                   std::make_pair(Address(0xff0000), "d")));
+
+  // Lookup of an existing entry doesn't insert.
+  map[Address(0x808000)].is_entry = true;
+  EXPECT_EQ(map.size(), 4);
+  EXPECT_EQ(map.at(Address(0x808000)).label, "b");
+
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.count(Address(0x808000)), 0);
+}
+
+TEST(DisassemblyMap, EraseKeepsOtherIteratorsValid) {
+  DisassemblyMap map;
+  for (int i = 0; i < 10; ++i) {
+    map[Address(0x7e0000 + i)].label = std::to_string(i);
+  }
+  auto it = map.find(Address(0x7e0003));
+  auto later = map.find(Address(0x7e0008));
+  it = map.erase(it);
+  EXPECT_EQ(it->first, Address(0x7e0004));
+  EXPECT_EQ(later->second.label, "8");
+  EXPECT_EQ(map.erase(map.find(Address(0x7e0009))), map.end());
+  EXPECT_EQ(map.size(), 8);
+  EXPECT_EQ(map.count(Address(0x7e0003)), 0);
+}
+
+TEST(DisassemblyMap, MatchesStdMap) {
+  std::mt19937 rng(1234);
+  DisassemblyMap map;
+  std::map<Address, std::string> reference;
+  for (int i = 0; i < 5000; ++i) {
+    // Cluster addresses in a few banks, so that erasure and reinsertion hit
+    // existing entries.
+    Address address(((rng() % 4) << 22) | (rng() % 0x800));
+    if (rng() % 3 == 0) {
+      auto it = map.find(address);
+      EXPECT_EQ(it != map.end(), reference.erase(address) > 0);
+      if (it != map.end()) {
+        map.erase(it);
+      }
+    } else {
+      std::string label = std::to_string(i);
+      map[address].label = label;
+      reference[address] = label;
+    }
+  }
+  std::vector<std::pair<Address, std::string>> expected(reference.begin(),
+                                                        reference.end());
+  EXPECT_EQ(Contents(map), expected);
+  EXPECT_EQ(map.size(), reference.size());
+}
+
+}  // namespace
+}  // namespace nsasm
@@ -5,11 +5,23 @@
 namespace nsasm {
 
 std::string Error::ToString() const {
-  std::string loc_str = location_.ToString();
+  if (!record_) {
+    return "";
+  }
+  std::string loc_str = record_->location.ToString();
   if (loc_str.empty()) {
-    return message_;
+    return record_->message;
+  }
+  return absl::StrFormat("%s: %s", loc_str, record_->message);
+}
+
+Error::Record* Error::MutableRecord() {
+  if (record_ && record_->references.load(std::memory_order_acquire) > 1) {
+    Record* copy = new Record(*record_);
+    Unref();
+    record_ = copy;
   }
-  return absl::StrFormat("%s: %s", loc_str, message_);
+  return record_;
 }
 
 }  // namespace nsasm
\ No newline at end of file
@@ -1,7 +1,10 @@
 #ifndef NSASM_ERROR_H_
 #define NSASM_ERROR_H_
 
+#include <atomic>
 #include <string>
+#include <type_traits>
+#include <utility>
 
 #include "absl/strings/str_format.h"
 #include "absl/types/optional.h"
@@ -10,33 +13,107 @@
 
 namespace nsasm {
 
+template <typename T>
+class ErrorOr;
+
+// An error message with an optional location.
+//
+// Errors are only created on failure paths, but ErrorOr<T> is returned from
+// every evaluation and lookup, so an Error is a single pointer to a shared,
+// reference-counted record.  This keeps ErrorOr<T> little bigger than T and
+// its success path free of any string handling, and copying an Error only
+// bumps the count.  SetLocation() copies the record first if it is shared.
+//
+// A moved-from Error, or the one returned by a successful ErrorOr<void>, holds
+// no record.  It prints as an empty string, ignores SetLocation(), and
+// compares equal only to other such Errors.
 class ABSL_MUST_USE_RESULT Error {
  public:
   template <typename... Args>
   explicit Error(const absl::FormatSpec<Args...>& format, const Args&... args)
-      : message_(absl::StrFormat(format, args...)), location_() {}
+      : record_(new Record(absl::StrFormat(format, args...))) {}
+
+  Error(const Error& rhs) : record_(rhs.record_) { Ref(); }
+  Error(Error&& rhs) noexcept : record_(std::exchange(rhs.record_, nullptr)) {}
+  Error& operator=(const Error& rhs) {
+    Error copy(rhs);
+    std::swap(record_, copy.record_);
+    return *this;
+  }
+  Error& operator=(Error&& rhs) noexcept {
+    if (this != &rhs) {
+      Unref();
+      record_ = std::exchange(rhs.record_, nullptr);
+    }
+    return *this;
+  }
+  ~Error() { Unref(); }
 
-  Error& SetLocation(Location location) {
-    location_.Update(location);
+  Error& SetLocation(Location location) & {
+    if (Record* record = MutableRecord()) {
+      record->location.Update(location);
+    }
     return *this;
   }
+  Error&& SetLocation(Location location) && {
+    return std::move(SetLocation(location));
+  }
 
   // Update from two location objects.  This is intended to accept a path and
   // address, or path and line number.
-  Error& SetLocation(Location loc1, Location loc2) {
-    location_.Update(loc1);
-    location_.Update(loc2);
+  Error& SetLocation(Location loc1, Location loc2) & {
+    if (Record* record = MutableRecord()) {
+      record->location.Update(loc1);
+      record->location.Update(loc2);
+    }
     return *this;
   }
+  Error&& SetLocation(Location loc1, Location loc2) && {
+    return std::move(SetLocation(loc1, loc2));
+  }
 
   std::string ToString() const;
 
-  bool operator==(const Error& rhs) const { return message_ == rhs.message_; }
-  bool operator!=(const Error& rhs) const { return message_ != rhs.message_; }
+  bool operator==(const Error& rhs) const {
+    if (!record_ || !rhs.record_) {
+      return record_ == rhs.record_;
+    }
+    return record_->message == rhs.record_->message;
+  }
+  bool operator!=(const Error& rhs) const { return !(*this == rhs); }
 
  private:
-  std::string message_;
-  Location location_;
+  friend class ErrorOr<void>;
+
+  struct Record {
+    explicit Record(std::string message) : message(std::move(message)) {}
+    Record(const Record& rhs) : message(rhs.message), location(rhs.location) {}
+
+    std::atomic<int> references{1};
+    std::string message;
+    Location location;
+  };
+
+  // The null state, used only by ErrorOr<void> to mean success.
+  Error() = default;
+
+  void Ref() const {
+    if (record_) {
+      record_->references.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  void Unref() const {
+    if (record_ &&
+        record_->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete record_;
+    }
+  }
+
+  // Returns this error's record, first copying it if it is shared, or null if
+  // there is none.
+  Record* MutableRecord();
+
+  Record* record_ = nullptr;
 };
 
 template <typename T>
@@ -44,7 +121,7 @@ class ABSL_MUST_USE_RESULT ErrorOr {
  public:
   ErrorOr(T&& t) : value(std::move(t)) {}
   ErrorOr(const T& t) : value(t) {}
-  ErrorOr(Error&& e) : value(e) {}
+  ErrorOr(Error&& e) : value(std::move(e)) {}
   ErrorOr(const Error& e) : value(e) {}
 
   const T& operator*() const& { return absl::get<T>(value); }
@@ -69,22 +146,32 @@ class ABSL_MUST_USE_RESULT ErrorOr {
 template <>
 class ABSL_MUST_USE_RESULT ErrorOr<void> {
  public:
-  ErrorOr() : value(absl::nullopt) {}
-  ErrorOr(Error&& e) : value(e) {}
+  ErrorOr() {}
+  ErrorOr(Error&& e) : value(std::move(e)) {}
   ErrorOr(const Error& e) : value(e) {}
 
   void operator*() const {}
 
-  Error error() const { return *value; }
-  bool ok() const { return !value; }
+  Error error() const { return value; }
+  bool ok() const { return !value.record_; }
 
-  bool operator==(const ErrorOr<void>& rhs) const { return value == rhs.value; }
-  bool operator!=(const ErrorOr<void>& rhs) const { return value != rhs.value; }
+  bool operator==(const ErrorOr<void>& rhs) const {
+    return ok() ? rhs.ok() : (!rhs.ok() && value == rhs.value);
+  }
+  bool operator!=(const ErrorOr<void>& rhs) const { return !(*this == rhs); }
 
  private:
-  absl::optional<Error> value;
+  // Null on success.
+  Error value;
 };
 
+// Errors are handles, so that ErrorOr<T> stays cheap on the success path.
+static_assert(sizeof(Error) == sizeof(void*));
+static_assert(std::is_nothrow_move_constructible_v<Error> &&
+              std::is_nothrow_move_assignable_v<Error>);
+static_assert(sizeof(ErrorOr<void>) == sizeof(void*));
+static_assert(sizeof(ErrorOr<int>) <= 2 * sizeof(void*));
+
 }  // namespace nsasm
 
 #define NSASM_RETURN_IF_ERROR(v) \
@@ -0,0 +1,67 @@
+#include "nsasm/error.h"
+
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace nsasm {
+namespace {
+
+TEST(Error, Formatting) {
+  std::string name = "foo";
+  Error error("Value '%s' at %d (%s)", std::string_view(name), 12, "bar");
+  name = "overwritten";
+  EXPECT_EQ(error.ToString(), "Value 'foo' at 12 (bar)");
+
+  error.SetLocation(Location("test.asm", 3));
+  EXPECT_EQ(error.ToString(), "test.asm:3: Value 'foo' at 12 (bar)");
+
+  // Copies are independent.
+  Error copy = error;
+  copy.SetLocation(Location(4));
+  EXPECT_EQ(copy.ToString(), "test.asm:4: Value 'foo' at 12 (bar)");
+  EXPECT_EQ(error.ToString(), "test.asm:3: Value 'foo' at 12 (bar)");
+  EXPECT_EQ(copy, error);
+}
+
+TEST(Error, ErrorOr) {
+  ErrorOr<int> value = 5;
+  ASSERT_TRUE(value.ok());
+  EXPECT_EQ(*value, 5);
+
+  ErrorOr<int> failure = Error("failed");
+  ASSERT_FALSE(failure.ok());
+  EXPECT_EQ(failure.error().ToString(), "failed");
+
+  ErrorOr<void> ok;
+  EXPECT_TRUE(ok.ok());
+  EXPECT_EQ(ok, ErrorOr<void>());
+  ErrorOr<void> void_failure = Error("failed %d", 1);
+  EXPECT_FALSE(void_failure.ok());
+  EXPECT_NE(void_failure, ok);
+  EXPECT_EQ(void_failure, ErrorOr<void>(Error("failed 1")));
+}
+
+TEST(Error, EmptyErrors) {
+  // The error from a successful ErrorOr<void>, and a moved-from error, hold
+  // no record, but are still safe to use.
+  Error empty = ErrorOr<void>().error();
+  EXPECT_EQ(empty.ToString(), "");
+  empty.SetLocation(Location("test.asm", 3));
+  EXPECT_EQ(empty.ToString(), "");
+  EXPECT_EQ(empty, ErrorOr<void>().error());
+
+  Error error("failed");
+  Error moved = std::move(error);
+  EXPECT_EQ(error.ToString(), "");
+  EXPECT_NE(error, moved);
+  EXPECT_EQ(error, empty);
+  error = moved;
+  EXPECT_EQ(error, moved);
+}
+
+}  // namespace
+}  // namespace nsasm
@@ -2,6 +2,7 @@
 
 #include "absl/strings/ascii.h"
 #include "absl/strings/str_cat.h"
+#include "nsasm/serialize.h"
 
 namespace nsasm {
 namespace {
@@ -98,4 +99,85 @@ absl::optional<StatusFlags> StatusFlags::FromName(std::string_view name) {
   return StatusFlags(B_off, m_bit, x_bit);
 }
 
+void StackValue::Serialize(ByteWriter* out) const {
+  out->WriteU8(type_);
+  out->WriteU8(type_ == T_flags ? flags_.ToByte() : value_);
+}
+
+StackValue StackValue::Deserialize(ByteReader* in) {
+  uint8_t type = in->ReadU8();
+  uint8_t value = in->ReadU8();
+  StackValue result;
+  if (type > T_dbr) {
+    in->Fail();
+    return result;
+  }
+  result.type_ = Type(type);
+  if (type == T_flags) {
+    result.flags_ = StatusFlags::FromByte(value);
+  } else {
+    result.value_ = value;
+  }
+  return result;
+}
+
+void Stack::Serialize(ByteWriter* out) const {
+  out->WriteU8(abandoned_);
+  out->WriteU32(stack_.size());
+  for (const StackValue& value : stack_) {
+    value.Serialize(out);
+  }
+}
+
+Stack Stack::Deserialize(ByteReader* in) {
+  Stack result;
+  result.abandoned_ = in->ReadU8();
+  uint32_t size = in->ReadU32();
+  for (uint32_t i = 0; i < size && in->ok(); ++i) {
+    result.stack_.push_back(StackValue::Deserialize(in));
+  }
+  return result;
+}
+
+namespace {
+
+void SerializeRegister(const RegisterValue& reg, ByteWriter* out) {
+  out->WriteU8(reg.type());
+  out->WriteU16(*reg);
+}
+
+RegisterValue DeserializeRegister(ByteReader* in) {
+  uint8_t type = in->ReadU8();
+  uint16_t value = in->ReadU16();
+  if (type == RegisterValue::T_value) {
+    return RegisterValue(value);
+  }
+  if (type > RegisterValue::T_value) {
+    in->Fail();
+  }
+  return RegisterValue(RegisterValue::Type(type));
+}
+
+}  // namespace
+
+void ExecutionState::Serialize(ByteWriter* out) const {
+  SerializeRegister(a_reg_, out);
+  SerializeRegister(x_reg_, out);
+  SerializeRegister(y_reg_, out);
+  SerializeRegister(dbr_, out);
+  out->WriteU8(flags_.ToByte());
+  stack_.Serialize(out);
+}
+
+ExecutionState ExecutionState::Deserialize(ByteReader* in) {
+  ExecutionState result;
+  result.a_reg_ = DeserializeRegister(in);
+  result.x_reg_ = DeserializeRegister(in);
+  result.y_reg_ = DeserializeRegister(in);
+  result.dbr_ = DeserializeRegister(in);
+  result.flags_ = StatusFlags::FromByte(in->ReadU8());
+  result.stack_ = Stack::Deserialize(in);
+  return result;
+}
+
 }  // namespace nsasm
@@ -3,12 +3,16 @@
 
 #include <cstdint>
 #include <string_view>
+#include <utility>
 
 #include "absl/container/inlined_vector.h"
 #include "absl/types/optional.h"
 
 namespace nsasm {
 
+class ByteReader;
+class ByteWriter;
+
 // Possible static analysis states of a status register bit.
 enum BitState : uint8_t {
   // Bit is known to be zero
@@ -127,6 +131,20 @@ class StatusFlags {
 
   bool operator!=(const StatusFlags& rhs) const { return !(*this == rhs); }
 
+  // Packs this flag state into a single byte, and back.
+  uint8_t ToByte() const {
+    return e_bit_ | (m_bit_ << 2) | (x_bit_ << 4) | (c_bit_ << 6);
+  }
+  static StatusFlags FromByte(uint8_t byte) {
+    return StatusFlags(BitState(byte & 3), BitState((byte >> 2) & 3),
+                       BitState((byte >> 4) & 3), BitState(byte >> 6));
+  }
+
+  template <typename H>
+  friend H AbslHashValue(H h, const StatusFlags& f) {
+    return H::combine(std::move(h), f.EBit(), f.MBit(), f.XBit(), f.CBit());
+  }
+
  private:
   uint8_t e_bit_ : 2;
   uint8_t m_bit_ : 2;
@@ -180,6 +198,11 @@ class RegisterValue {
     return *this;
   }
 
+  template <typename H>
+  friend H AbslHashValue(H h, const RegisterValue& r) {
+    return H::combine(std::move(h), r.type_, r.value_);
+  }
+
  private:
   Type type_;
   uint16_t value_;
@@ -311,6 +334,17 @@ struct StackValue {
     return value_ == rhs.value_;
   }
 
+  void Serialize(ByteWriter* out) const;
+  static StackValue Deserialize(ByteReader* in);
+
+  template <typename H>
+  friend H AbslHashValue(H h, const StackValue& v) {
+    if (v.type_ == T_flags) {
+      return H::combine(std::move(h), v.type_, v.flags_);
+    }
+    return H::combine(std::move(h), v.type_, v.value_);
+  }
+
  private:
   Type type_;
   union {
@@ -322,6 +356,11 @@ struct StackValue {
 // Static analysis representation of the stack
 class Stack {
  public:
+  // The deepest stack that is tracked.  Pushing past this depth abandons
+  // stack analysis, which bounds the size of a state in code that pushes
+  // without pulling.
+  static constexpr size_t kMaxDepth = 64;
+
   // Construct an empty stack (the state at the start of a subroutine).
   Stack() : abandoned_(false), stack_() {}
 
@@ -335,6 +374,7 @@ class Stack {
   void PushByte(uint8_t value) {
     if (!abandoned_) {
       stack_.push_back(StackValue(value));
+      CheckDepth();
     }
   }
 
@@ -349,6 +389,7 @@ class Stack {
   void PushUnknownByte() {
     if (!abandoned_) {
       stack_.push_back(StackValue());
+      CheckDepth();
     }
   }
 
@@ -371,6 +412,7 @@ class Stack {
     if (!abandoned_) {
       stack_.push_back(StackValue());
       stack_.push_back(StackValue());
+      CheckDepth();
     }
   }
 
@@ -391,7 +433,8 @@ class Stack {
   // Pull a variable-sized object from the stack.  If that's not what's on top
   // of the stack, this fails.
   StackValue PullVarsize() {
-    if (abandoned_) {
+    if (abandoned_ || stack_.empty()) {
+      Abandon();
       return StackValue();
     }
     StackValue result = stack_.back();
@@ -404,6 +447,12 @@ class Stack {
   }
 
  private:
+  void CheckDepth() {
+    if (stack_.size() > kMaxDepth) {
+      Abandon();
+    }
+  }
+
   void PushReg(RegisterValue reg, BitState bit, StackValue::Type lo_byte_type,
                StackValue::Type hi_byte_type, StackValue::Type var_byte_type) {
     if (!abandoned_) {
@@ -418,6 +467,7 @@ class Stack {
         stack_.emplace_back(hi_byte_type, reg);
         stack_.emplace_back(lo_byte_type, reg);
       }
+      CheckDepth();
     }
   }
 
@@ -486,12 +536,14 @@ class Stack {
   void PushDBR(RegisterValue dbr) {
     if (!abandoned_) {
       stack_.emplace_back(StackValue::T_dbr, dbr);
+      CheckDepth();
     }
   }
 
   void PushFlags(StatusFlags flags) {
     if (!abandoned_) {
       stack_.emplace_back(flags);
+      CheckDepth();
     }
   }
 
@@ -525,15 +577,53 @@ class Stack {
     return *this;
   }
 
+  // Widening (see ExecutionState::WidenWith()).  Slots that differ become
+  // unknown outright, rather than being merged, and the stack is abandoned
+  // only if the depths differ or it is deeper than kMaxDepth.
+  Stack& WidenWith(const Stack& rhs) {
+    if (abandoned_ || rhs.abandoned_ || stack_.size() != rhs.stack_.size() ||
+        stack_.size() > kMaxDepth) {
+      Abandon();
+      return *this;
+    }
+    for (size_t i = 0; i < stack_.size(); ++i) {
+      if (stack_[i] == rhs.stack_[i]) {
+        continue;
+      }
+      if (!stack_[i].CanMergeWith(rhs.stack_[i])) {
+        Abandon();
+        return *this;
+      }
+      if (stack_[i].IsVarSize()) {
+        stack_[i] |= rhs.stack_[i];
+      } else {
+        stack_[i] = StackValue();
+      }
+    }
+    return *this;
+  }
+
   bool operator==(const Stack& rhs) const {
     return abandoned_ == rhs.abandoned_ && stack_ == rhs.stack_;
   }
 
+  void Serialize(ByteWriter* out) const;
+  static Stack Deserialize(ByteReader* in);
+
+  template <typename H>
+  friend H AbslHashValue(H h, const Stack& s) {
+    return H::combine(std::move(h), s.abandoned_, s.stack_);
+  }
+
  private:
   bool abandoned_;
   absl::InlinedVector<StackValue, 16> stack_;
 };
 
+// The number of times an analysis merges a changed state into the same program
+// point before it widens (see ExecutionState::WidenWith()) instead.
+constexpr int kWideningThreshold = 4;
+
 // Representation of the execution state on a line.  A little on the big side,
 // but this is still a value type.
 class ExecutionState {
@@ -613,6 +703,21 @@ class ExecutionState {
     return result |= rhs;
   }
 
+  // Widening.  Merges `rhs` into this state component by component: each
+  // register, flag bit or stack slot that differs becomes unknown, and the
+  // rest are kept.  Every component can then change at most once more, so a
+  // program point whose state is widened reaches a fixed point within a few
+  // more visits.
+  ExecutionState& WidenWith(const ExecutionState& rhs) {
+    a_reg_ |= rhs.a_reg_;
+    x_reg_ |= rhs.x_reg_;
+    y_reg_ |= rhs.y_reg_;
+    dbr_ |= rhs.dbr_;
+    flags_ |= rhs.flags_;
+    stack_.WidenWith(rhs.stack_);
+    return *this;
+  }
+
   bool operator==(const ExecutionState& rhs) const {
     return a_reg_ == rhs.a_reg_ && x_reg_ == rhs.x_reg_ &&
            y_reg_ == rhs.y_reg_ && dbr_ == rhs.dbr_ && flags_ == rhs.flags_ &&
@@ -621,6 +726,17 @@ class ExecutionState {
 
   bool operator!=(const ExecutionState& rhs) const { return !(*this == rhs); }
 
+  // Writes this state to a cache file, or reads it back.  Deserialize() marks
+  // `in` as failed if the data is malformed.
+  void Serialize(ByteWriter* out) const;
+  static ExecutionState Deserialize(ByteReader* in);
+
+  template <typename H>
+  friend H AbslHashValue(H h, const ExecutionState& s) {
+    return H::combine(std::move(h), s.a_reg_, s.x_reg_, s.y_reg_, s.dbr_,
+                      s.flags_, s.stack_);
+  }
+
  private:
   RegisterValue a_reg_;
   RegisterValue x_reg_;
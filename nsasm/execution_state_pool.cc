@@ -0,0 +1,33 @@
+#include "nsasm/execution_state_pool.h"
+
+#include <algorithm>
+
+namespace nsasm {
+
+StateHandle ExecutionStatePool::Intern(const ExecutionState& state) {
+  auto it = ids_.find(state);
+  if (it != ids_.end()) {
+    return StateHandle(*it);
+  }
+  const uint32_t id = states_->size();
+  states_->push_back(state);
+  ids_.insert(id);
+  return StateHandle(id);
+}
+
+StateHandle ExecutionStatePool::Merge(StateHandle lhs, StateHandle rhs) {
+  if (lhs == rhs) {
+    return lhs;
+  }
+  // Merging is commutative, so only cache one ordering of each pair.
+  std::pair<uint32_t, uint32_t> key = std::minmax(lhs.id_, rhs.id_);
+  auto it = merges_.find(key);
+  if (it != merges_.end()) {
+    return StateHandle(it->second);
+  }
+  StateHandle result = Intern(Get(lhs) | Get(rhs));
+  merges_.emplace(key, result.id_);
+  return result;
+}
+
+}  // namespace nsasm
@@ -0,0 +1,111 @@
+#ifndef NSASM_EXECUTION_STATE_POOL_H_
+#define NSASM_EXECUTION_STATE_POOL_H_
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "nsasm/execution_state.h"
+
+namespace nsasm {
+
+// Compact reference to an ExecutionState interned in an ExecutionStatePool.
+// Two handles from the same pool are equal exactly when their states are.
+//
+// A default-constructed handle refers to the default ExecutionState.
+class StateHandle {
+ public:
+  constexpr StateHandle() : id_(0) {}
+
+  uint32_t id() const { return id_; }
+
+  bool operator==(StateHandle rhs) const { return id_ == rhs.id_; }
+  bool operator!=(StateHandle rhs) const { return id_ != rhs.id_; }
+
+  template <typename H>
+  friend H AbslHashValue(H h, StateHandle handle) {
+    return H::combine(std::move(h), handle.id_);
+  }
+
+ private:
+  friend class ExecutionStatePool;
+  explicit StateHandle(uint32_t id) : id_(id) {}
+
+  uint32_t id_;
+};
+
+// Hash-consing store of ExecutionStates.
+//
+// Large analyses see thousands of instructions but only a handful of distinct
+// states, so storing a StateHandle per instruction rather than a full
+// ExecutionState saves a great deal of memory, and comparing states is a
+// single integer comparison.
+//
+// Interned states are never removed; references returned by Get() remain
+// valid for the lifetime of the pool.  This class is not thread-safe, though
+// concurrent calls to Get() are fine when nothing is being interned.
+class ExecutionStatePool {
+ public:
+  ExecutionStatePool()
+      : states_(new std::deque<ExecutionState>),
+        ids_(0, IdHash{states_.get()}, IdEq{states_.get()}) {
+    Intern(ExecutionState());
+  }
+
+  // movable but not copiable
+  ExecutionStatePool(const ExecutionStatePool&) = delete;
+  ExecutionStatePool& operator=(const ExecutionStatePool&) = delete;
+  ExecutionStatePool(ExecutionStatePool&&) = default;
+  ExecutionStatePool& operator=(ExecutionStatePool&&) = default;
+
+  // Returns the handle for the given state, adding it to the pool if needed.
+  StateHandle Intern(const ExecutionState& state);
+
+  const ExecutionState& Get(StateHandle handle) const {
+    return (*states_)[handle.id_];
+  }
+
+  // Returns the handle for the merge of the two given states (as by
+  // ExecutionState::operator|).  Results are cached.
+  StateHandle Merge(StateHandle lhs, StateHandle rhs);
+
+  // Number of distinct states in the pool.
+  size_t size() const { return states_->size(); }
+
+ private:
+  // The index of interned states holds only their ids, and hashes and compares
+  // them by looking up the states themselves, so that each state is stored
+  // once.  Lookups by ExecutionState are heterogeneous.
+  struct IdHash {
+    using is_transparent = void;
+    size_t operator()(uint32_t id) const { return (*this)((*states)[id]); }
+    size_t operator()(const ExecutionState& state) const {
+      return absl::Hash<ExecutionState>()(state);
+    }
+    const std::deque<ExecutionState>* states;
+  };
+  struct IdEq {
+    using is_transparent = void;
+    bool operator()(uint32_t lhs, uint32_t rhs) const { return lhs == rhs; }
+    bool operator()(uint32_t lhs, const ExecutionState& rhs) const {
+      return (*states)[lhs] == rhs;
+    }
+    bool operator()(const ExecutionState& lhs, uint32_t rhs) const {
+      return lhs == (*states)[rhs];
+    }
+    const std::deque<ExecutionState>* states;
+  };
+
+  // Held by pointer, so that the index's functors stay valid when the pool is
+  // moved.
+  std::unique_ptr<std::deque<ExecutionState>> states_;
+  absl::flat_hash_set<uint32_t, IdHash, IdEq> ids_;
+  absl::flat_hash_map<std::pair<uint32_t, uint32_t>, uint32_t> merges_;
+};
+
+}  // namespace nsasm
+
+#endif  // NSASM_EXECUTION_STATE_POOL_H_
@@ -0,0 +1,63 @@
+#include "nsasm/execution_state_pool.h"
+
+#include "gtest/gtest.h"
+
+namespace nsasm {
+namespace {
+
+TEST(ExecutionStatePool, Interning) {
+  ExecutionStatePool pool;
+  EXPECT_EQ(pool.size(), 1);
+  EXPECT_EQ(pool.Intern(ExecutionState()), StateHandle());
+  EXPECT_EQ(pool.Get(StateHandle()), ExecutionState());
+
+  ExecutionState a(StatusFlags(B_off, B_on, B_on));
+  a.Accumulator() = RegisterValue(0x12);
+  ExecutionState b = a;
+  b.GetStack().PushByte(uint8_t(0x34));
+
+  StateHandle ha = pool.Intern(a);
+  StateHandle hb = pool.Intern(b);
+  EXPECT_NE(ha, hb);
+  EXPECT_NE(ha, StateHandle());
+  EXPECT_EQ(pool.Intern(a), ha);
+  EXPECT_EQ(pool.Intern(b), hb);
+  EXPECT_EQ(pool.size(), 3);
+  EXPECT_EQ(pool.Get(ha), a);
+  EXPECT_EQ(pool.Get(hb), b);
+
+  // Equal states intern to the same handle, however they were built.
+  ExecutionState c = b;
+  c.GetStack().PullByte();
+  EXPECT_EQ(pool.Intern(c), ha);
+
+  // A moved pool keeps its handles.
+  ExecutionStatePool moved = std::move(pool);
+  EXPECT_EQ(moved.Intern(a), ha);
+  EXPECT_EQ(moved.Get(hb), b);
+  EXPECT_EQ(moved.size(), 3);
+}
+
+TEST(ExecutionStatePool, Merging) {
+  ExecutionStatePool pool;
+  ExecutionState a(StatusFlags(B_off, B_on, B_on));
+  ExecutionState b(StatusFlags(B_off, B_off, B_on));
+  a.XRegister() = RegisterValue(5);
+  b.XRegister() = RegisterValue(5);
+
+  StateHandle ha = pool.Intern(a);
+  StateHandle hb = pool.Intern(b);
+  EXPECT_EQ(pool.Merge(ha, ha), ha);
+
+  StateHandle merged = pool.Merge(ha, hb);
+  EXPECT_EQ(pool.Get(merged), a | b);
+  EXPECT_EQ(pool.Get(merged).Flags().MBit(), B_unknown);
+  EXPECT_EQ(*pool.Get(merged).XRegister(), 5);
+  EXPECT_EQ(pool.Merge(hb, ha), merged);
+  EXPECT_EQ(pool.Merge(merged, ha), merged);
+  // The default state, a, b, and their merge.
+  EXPECT_EQ(pool.size(), 4);
+}
+
+}  // namespace
+}  // namespace nsasm
@@ -0,0 +1,69 @@
+#include "nsasm/execution_state.h"
+
+#include "gtest/gtest.h"
+
+namespace nsasm {
+namespace {
+
+TEST(ExecutionState, Widening) {
+  ExecutionState a(StatusFlags(B_off, B_on, B_on));
+  a.Accumulator() = RegisterValue(0x12);
+  a.XRegister() = RegisterValue(0x34);
+  a.GetStack().PushByte(uint8_t(0x56));
+  a.PushFlags();
+
+  // Widening with a state that changes nothing keeps every value.
+  ExecutionState widened = a;
+  widened.WidenWith(a);
+  EXPECT_EQ(widened, a);
+
+  // Otherwise, only the parts that differ are forgotten.
+  ExecutionState b = a;
+  b.Accumulator() = RegisterValue(0x13);
+  widened.WidenWith(b);
+  EXPECT_EQ(widened.Flags(), a.Flags());
+  EXPECT_FALSE(widened.Accumulator().HasValue());
+  EXPECT_EQ(widened.XRegister(), a.XRegister());
+  EXPECT_EQ(widened.GetStack(), a.GetStack());
+
+  // A stack slot that differs becomes unknown, even where merging would keep
+  // part of it, and the slots around it are kept.
+  ExecutionState c(StatusFlags(B_off, B_off, B_on));
+  c.GetStack().PushByte(uint8_t(0x56));
+  c.PushFlags();
+  ExecutionState rewidened = widened;
+  rewidened.WidenWith(c);
+  EXPECT_EQ(rewidened.Flags().MBit(), B_unknown);
+  EXPECT_EQ((widened | c).GetStack().PullByte().type(), StackValue::T_flags);
+  Stack stack = rewidened.GetStack();
+  EXPECT_EQ(stack.PullByte().type(), StackValue::T_unknown);
+  EXPECT_EQ(stack.PullByte().value(), 0x56);
+
+  // Stacks of different depths can't be widened slot by slot.
+  ExecutionState d = a;
+  d.GetStack().PushByte(uint8_t(0x78));
+  widened = a;
+  widened.WidenWith(d);
+  Stack abandoned;
+  abandoned.Abandon();
+  EXPECT_EQ(widened.GetStack(), abandoned);
+  EXPECT_EQ(widened.XRegister(), a.XRegister());
+}
+
+TEST(ExecutionState, StackDepthIsBounded) {
+  Stack stack;
+  for (size_t i = 0; i < Stack::kMaxDepth; ++i) {
+    stack.PushByte(uint8_t(i));
+  }
+  Stack deeper = stack;
+  EXPECT_EQ(deeper.PullByte().value(), Stack::kMaxDepth - 1);
+
+  // One more push abandons the stack.
+  stack.PushByte(uint8_t(0));
+  Stack abandoned;
+  abandoned.Abandon();
+  EXPECT_EQ(stack, abandoned);
+}
+
+}  // namespace
+}  // namespace nsasm
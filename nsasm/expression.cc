@@ -5,6 +5,136 @@
 
 namespace nsasm {
 
+namespace {
+
+// Tags identifying each kind of expression in a cache file.
+enum ExpressionTag : uint8_t {
+  kNullTag,
+  kLiteralTag,
+  kIdentifierTag,
+  kBinaryTag,
+  kUnaryTag,
+  kLabelTag,
+};
+
+BinaryOp BinaryOpFromSymbol(char symbol) {
+  switch (symbol) {
+    case '+':
+      return MakePlusOp();
+    case '-':
+      return MakeMinusOp();
+    case '*':
+      return MakeMultiplyOp();
+    case '/':
+      return MakeDivideOp();
+    default:
+      return BinaryOp();
+  }
+}
+
+UnaryOp UnaryOpFromSymbol(char symbol) {
+  switch (symbol) {
+    case '-':
+      return MakeNegateOp();
+    case '<':
+      return MakeLowbyteOp();
+    case '>':
+      return MakeHighbyteOp();
+    case '^':
+      return MakeBankbyteOp();
+    default:
+      return UnaryOp();
+  }
+}
+
+}  // namespace
+
+void ExpressionOrNull::Serialize(ByteWriter* out) const {
+  if (expr_) {
+    expr_->Serialize(out);
+  } else {
+    out->WriteU8(kNullTag);
+  }
+}
+
+ExpressionOrNull ExpressionOrNull::Deserialize(ByteReader* in) {
+  switch (in->ReadU8()) {
+    case kNullTag:
+      return ExpressionOrNull();
+    case kLiteralTag: {
+      NumericType type = ReadEnum(in, T_signed_long);
+      int value = int32_t(in->ReadU32());
+      return absl::make_unique<Literal>(value, type);
+    }
+    case kIdentifierTag: {
+      NumericType type = ReadEnum(in, T_signed_long);
+      return absl::make_unique<IdentifierExpression>(
+          FullIdentifier::Deserialize(in), type);
+    }
+    case kBinaryTag: {
+      BinaryOp op = BinaryOpFromSymbol(in->ReadU8());
+      ExpressionOrNull lhs = Deserialize(in);
+      ExpressionOrNull rhs = Deserialize(in);
+      if (!op) {
+        in->Fail();
+        return ExpressionOrNull();
+      }
+      return absl::make_unique<BinaryExpression>(std::move(lhs),
+                                                 std::move(rhs), op);
+    }
+    case kUnaryTag: {
+      UnaryOp op = UnaryOpFromSymbol(in->ReadU8());
+      ExpressionOrNull arg = Deserialize(in);
+      if (!op) {
+        in->Fail();
+        return ExpressionOrNull();
+      }
+      return absl::make_unique<UnaryExpression>(std::move(arg), op);
+    }
+    case kLabelTag: {
+      std::string label = in->ReadString();
+      ExpressionOrNull held_value = Deserialize(in);
+      return absl::make_unique<Label>(
+          std::move(label),
+          absl::make_unique<ExpressionOrNull>(std::move(held_value)));
+    }
+    default:
+      in->Fail();
+      return ExpressionOrNull();
+  }
+}
+
+void Literal::Serialize(ByteWriter* out) const {
+  out->WriteU8(kLiteralTag);
+  out->WriteU16(type_);
+  out->WriteU32(uint32_t(value_));
+}
+
+void IdentifierExpression::Serialize(ByteWriter* out) const {
+  out->WriteU8(kIdentifierTag);
+  out->WriteU16(type_);
+  identifier_.Serialize(out);
+}
+
+void BinaryExpression::Serialize(ByteWriter* out) const {
+  out->WriteU8(kBinaryTag);
+  out->WriteU8(op_.symbol);
+  lhs_.Serialize(out);
+  rhs_.Serialize(out);
+}
+
+void UnaryExpression::Serialize(ByteWriter* out) const {
+  out->WriteU8(kUnaryTag);
+  out->WriteU8(op_.symbol);
+  arg_.Serialize(out);
+}
+
+void Label::Serialize(ByteWriter* out) const {
+  out->WriteU8(kLabelTag);
+  out->WriteString(label_);
+  held_value_->Serialize(out);
+}
+
 std::string Literal::ToString() const {
   int output_value = CastTo(type_, value_);
   switch (type_) {
@@ -7,9 +7,11 @@
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/types/optional.h"
+#include "nsasm/address.h"
 #include "nsasm/error.h"
 #include "nsasm/identifiers.h"
 #include "nsasm/numeric_type.h"
+#include "nsasm/serialize.h"
 
 namespace nsasm {
 
@@ -79,10 +81,23 @@ inline UnaryOp MakeBankbyteOp() {
   return UnaryOp(fn, tfn, '^');
 }
 
+// Storage for the value of a name, which is empty until the value is known.
+// Names in an expression can be bound to the slot holding their value (see
+// Expression::Bind()), so that evaluation needs no lookup by name.
+using ValueSlot = absl::optional<LabelValue>;
+
 class LookupContext {
  public:
   virtual ~LookupContext() = default;
   virtual ErrorOr<int> Lookup(const nsasm::FullIdentifier& id) const = 0;
+
+  // Looks up `id`, which Expression::Bind() resolved to `slot`, or to nullptr
+  // if it couldn't be resolved.  Contexts that trust bindings read the slot
+  // directly; by default, this ignores `slot` and calls Lookup().
+  virtual ErrorOr<int> LookupBound(const nsasm::FullIdentifier& id,
+                                   const ValueSlot* slot) const {
+    return Lookup(id);
+  }
 };
 
 class NullLookupContext : public LookupContext {
@@ -102,6 +117,15 @@ class IsLocalContext {
   virtual bool IsLocal(const nsasm::FullIdentifier& id) const = 0;
 };
 
+class BindingContext {
+ public:
+  virtual ~BindingContext() = default;
+
+  // Returns the slot that holds the value of `id`, or nullptr if `id` doesn't
+  // name anything in this context.
+  virtual const ValueSlot* Bind(const nsasm::FullIdentifier& id) const = 0;
+};
+
 // Virtual base class representing an argument value.  This can be a constant,
 // label, expression, etc.
 class Expression {
@@ -115,8 +139,8 @@ class Expression {
   // Returns the type of this expression, if known.
   virtual NumericType Type() const = 0;
 
-  // Returns the string value of this expression, iff it is a simple identifier.
-  virtual absl::optional<std::string> SimpleIdentifier() const {
+  // Returns the name in this expression, iff it is a simple identifier.
+  virtual absl::optional<Symbol> SimpleIdentifier() const {
     return absl::nullopt;
   }
 
@@ -135,6 +159,15 @@ class Expression {
   // to the requested type if provided.
   virtual std::string ToString() const = 0;
 
+  // Writes this expression to a cache file.  Read it back with
+  // ExpressionOrNull::Deserialize().
+  virtual void Serialize(ByteWriter* out) const = 0;
+
+  // Resolves each name in this expression to the slot holding its value, for
+  // use by LookupContext::LookupBound().  Bindings are not copied or
+  // serialized.
+  virtual void Bind(const BindingContext& context) {}
+
  protected:
   // Returns a copy of this expression.
   friend class ExpressionOrNull;
@@ -177,7 +210,7 @@ class ExpressionOrNull : public Expression {
     return expr_ ? expr_->Type() : T_unknown;
   }
 
-  absl::optional<std::string> SimpleIdentifier() const override {
+  absl::optional<Symbol> SimpleIdentifier() const override {
     if (expr_) {
       return expr_->SimpleIdentifier();
     }
@@ -198,6 +231,18 @@ class ExpressionOrNull : public Expression {
     return expr_ ? expr_->ToString() : "<NULL>";
   }
 
+  void Serialize(ByteWriter* out) const override;
+
+  // Reads back an expression written by Serialize().  Marks `in` as failed if
+  // the data is malformed.
+  static ExpressionOrNull Deserialize(ByteReader* in);
+
+  void Bind(const BindingContext& context) override {
+    if (expr_) {
+      expr_->Bind(context);
+    }
+  }
+
   bool IsLabel() const;
   void ApplyLabel(const std::string label);
 
@@ -232,6 +277,7 @@ class Literal : public Expression {
     return {};
   }
   std::string ToString() const override;
+  void Serialize(ByteWriter* out) const override;
 
  private:
   std::unique_ptr<Expression> Copy() const override {
@@ -249,7 +295,7 @@ class IdentifierExpression : public Expression {
       : type_(type), identifier_(std::move(identifier)) {}
 
   ErrorOr<int> Evaluate(const LookupContext& context) const override {
-    return context.Lookup(identifier_);
+    return context.LookupBound(identifier_, slot_);
   }
   NumericType Type() const override { return type_; }
   bool RequiresLookup() const override { return true; }
@@ -260,16 +306,20 @@ class IdentifierExpression : public Expression {
     } else if (identifier_.Qualified()) {
       return {identifier_};
     } else {
-      return {FullIdentifier("", identifier_.Identifier())};
+      return {FullIdentifier(Symbol(), identifier_.Identifier())};
     }
   }
   std::string ToString() const override;
-  absl::optional<std::string> SimpleIdentifier() const override {
+  void Serialize(ByteWriter* out) const override;
+  absl::optional<Symbol> SimpleIdentifier() const override {
     if (identifier_.Qualified()) {
       return absl::nullopt;
     }
     return identifier_.Identifier();
   }
+  void Bind(const BindingContext& context) override {
+    slot_ = context.Bind(identifier_);
+  }
 
  private:
   std::unique_ptr<Expression> Copy() const override {
@@ -278,6 +328,7 @@ class IdentifierExpression : public Expression {
 
   NumericType type_;
   FullIdentifier identifier_;
+  const ValueSlot* slot_ = nullptr;
 };
 
 class BinaryExpression : public Expression {
@@ -309,6 +360,11 @@ class BinaryExpression : public Expression {
     return absl::StrFormat("op%c(%s, %s)", op_.symbol, lhs_.ToString(),
                            rhs_.ToString());
   }
+  void Serialize(ByteWriter* out) const override;
+  void Bind(const BindingContext& context) override {
+    lhs_.Bind(context);
+    rhs_.Bind(context);
+  }
 
  private:
   std::unique_ptr<Expression> Copy() const override {
@@ -337,6 +393,8 @@ class UnaryExpression : public Expression {
   std::string ToString() const override {
     return absl::StrFormat("op%c(%s)", op_.symbol, arg_.ToString());
   }
+  void Serialize(ByteWriter* out) const override;
+  void Bind(const BindingContext& context) override { arg_.Bind(context); }
 
  private:
   std::unique_ptr<Expression> Copy() const override {
@@ -362,6 +420,7 @@ class Label : public Expression {
     return {};
   }
   std::string ToString() const override { return label_; }
+  void Serialize(ByteWriter* out) const override;
 
  private:
   friend class ExpressionOrNull;
@@ -0,0 +1,113 @@
+#include "nsasm/file_watcher.h"
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+namespace nsasm {
+
+namespace {
+
+// Splits `path` into its directory and file name.
+std::pair<std::string, std::string> SplitPath(const std::string& path) {
+  const size_t slash = path.rfind('/');
+  if (slash == std::string::npos) {
+    return {".", path};
+  }
+  if (slash == 0) {
+    return {"/", path.substr(1)};
+  }
+  return {path.substr(0, slash), path.substr(slash + 1)};
+}
+
+}  // namespace
+
+ErrorOr<std::unique_ptr<FileWatcher>> FileWatcher::Create(
+    const std::vector<std::string>& paths) {
+  int fd = inotify_init1(IN_CLOEXEC);
+  if (fd < 0) {
+    return Error("Failed to initialize inotify");
+  }
+  std::unique_ptr<FileWatcher> watcher(new FileWatcher(fd));
+  for (const std::string& path : paths) {
+    const auto parts = SplitPath(path);
+    // Watching a directory again returns the existing descriptor.
+    int wd = inotify_add_watch(fd, parts.first.c_str(),
+                               IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) {
+      return Error("Failed to watch directory %s", parts.first)
+          .SetLocation(path);
+    }
+    auto inserted =
+        watcher->watched_.emplace(std::make_pair(wd, parts.second),
+                                  watcher->paths_.size());
+    if (!inserted.second) {
+      return Error("Same file as %s", watcher->paths_[inserted.first->second])
+          .SetLocation(path);
+    }
+    watcher->paths_.push_back(path);
+  }
+  return watcher;
+}
+
+FileWatcher::~FileWatcher() { close(fd_); }
+
+ErrorOr<std::vector<std::string>> FileWatcher::WaitForChanges(int timeout_ms,
+                                                              int settle_ms) {
+  std::vector<bool> changed(paths_.size());
+  auto got_events = ReadEvents(timeout_ms, &changed);
+  NSASM_RETURN_IF_ERROR(got_events);
+  while (*got_events) {
+    got_events = ReadEvents(settle_ms, &changed);
+    NSASM_RETURN_IF_ERROR(got_events);
+  }
+  std::vector<std::string> result;
+  for (size_t i = 0; i < paths_.size(); ++i) {
+    if (changed[i]) {
+      result.push_back(paths_[i]);
+    }
+  }
+  return result;
+}
+
+ErrorOr<bool> FileWatcher::ReadEvents(int timeout_ms,
+                                      std::vector<bool>* changed) {
+  struct pollfd pfd = {fd_, POLLIN, 0};
+  int ready = poll(&pfd, 1, timeout_ms);
+  if (ready < 0 && errno != EINTR) {
+    return Error("Failed to wait for file changes");
+  }
+  if (ready <= 0) {
+    return false;
+  }
+
+  alignas(struct inotify_event) char buffer[4096];
+  ssize_t length = read(fd_, buffer, sizeof(buffer));
+  if (length < 0) {
+    if (errno == EINTR || errno == EAGAIN) {
+      return true;
+    }
+    return Error("Failed to read file changes");
+  }
+  for (char* p = buffer; p < buffer + length;) {
+    const auto* event = reinterpret_cast<const struct inotify_event*>(p);
+    p += sizeof(struct inotify_event) + event->len;
+    if (event->mask & IN_Q_OVERFLOW) {
+      // Events were dropped, so any of the files may have changed.
+      changed->assign(changed->size(), true);
+      continue;
+    }
+    if (event->len == 0) {
+      continue;
+    }
+    auto it = watched_.find({event->wd, std::string(event->name)});
+    if (it != watched_.end()) {
+      (*changed)[it->second] = true;
+    }
+  }
+  return true;
+}
+
+}  // namespace nsasm
@@ -0,0 +1,59 @@
+#ifndef NSASM_FILE_WATCHER_H_
+#define NSASM_FILE_WATCHER_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "nsasm/error.h"
+
+namespace nsasm {
+
+// Watches a set of files for changes, using inotify.
+//
+// The directories holding the files are watched, rather than the files
+// themselves, so that a file replaced by renaming a new copy over it (as many
+// editors do on save) is still seen to change.
+class FileWatcher {
+ public:
+  // Returns an error if a directory can't be watched, or if two of `paths`
+  // name the same file.
+  static ErrorOr<std::unique_ptr<FileWatcher>> Create(
+      const std::vector<std::string>& paths);
+
+  ~FileWatcher();
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+
+  // Blocks until at least one watched file has changed, and returns the paths
+  // of all changed files in the order given to Create().  Changes that arrive
+  // within `settle_ms` of each other are reported together, so that a burst of
+  // writes to one file (or a save of several) causes a single rebuild.
+  //
+  // If `timeout_ms` is not negative, returns an empty list if nothing changes
+  // within that many milliseconds.
+  //
+  // If more changes arrive than inotify can queue, some are lost, so every
+  // watched file is reported as changed.
+  ErrorOr<std::vector<std::string>> WaitForChanges(int timeout_ms = -1,
+                                                   int settle_ms = 50);
+
+ private:
+  explicit FileWatcher(int fd) : fd_(fd) {}
+
+  // Waits up to `timeout_ms` for events, and adds the index of each watched
+  // file they name to `changed`.  Returns false on timeout.
+  ErrorOr<bool> ReadEvents(int timeout_ms, std::vector<bool>* changed);
+
+  int fd_;
+  std::vector<std::string> paths_;
+  // Maps a watch descriptor and a file name within its directory to an index
+  // into paths_.
+  std::map<std::pair<int, std::string>, int> watched_;
+};
+
+}  // namespace nsasm
+
+#endif  // NSASM_FILE_WATCHER_H_
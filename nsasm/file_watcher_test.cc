@@ -0,0 +1,86 @@
+#include "nsasm/file_watcher.h"
+
+#include <cstdio>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "nsasm/serialize.h"
+
+namespace nsasm {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+TEST(FileWatcher, ReportsChangedFiles) {
+  const std::string first = testing::TempDir() + "/file_watcher_test_1.asm";
+  const std::string second = testing::TempDir() + "/file_watcher_test_2.asm";
+  const std::string other = testing::TempDir() + "/file_watcher_test.other";
+  NSASM_ASSERT_OK(WriteBinaryFile(first, {1}));
+  NSASM_ASSERT_OK(WriteBinaryFile(second, {2}));
+
+  auto watcher = FileWatcher::Create({first, second});
+  NSASM_ASSERT_OK(watcher);
+  EXPECT_THAT(*(*watcher)->WaitForChanges(0), IsEmpty());
+
+  // Files that aren't watched are ignored.
+  NSASM_ASSERT_OK(WriteBinaryFile(other, {3}));
+  EXPECT_THAT(*(*watcher)->WaitForChanges(100), IsEmpty());
+
+  NSASM_ASSERT_OK(WriteBinaryFile(second, {4}));
+  NSASM_ASSERT_OK(WriteBinaryFile(first, {5}));
+  EXPECT_THAT(*(*watcher)->WaitForChanges(1000), ElementsAre(first, second));
+
+  // A file replaced by a rename is still watched.
+  NSASM_ASSERT_OK(WriteBinaryFile(other, {6}));
+  ASSERT_EQ(std::rename(other.c_str(), second.c_str()), 0);
+  EXPECT_THAT(*(*watcher)->WaitForChanges(1000), ElementsAre(second));
+  NSASM_ASSERT_OK(WriteBinaryFile(second, {7}));
+  EXPECT_THAT(*(*watcher)->WaitForChanges(1000), ElementsAre(second));
+
+  std::remove(first.c_str());
+  std::remove(second.c_str());
+}
+
+TEST(FileWatcher, QueueOverflowReportsEveryFile) {
+  const std::string first = testing::TempDir() + "/file_watcher_test_1.asm";
+  const std::string second = testing::TempDir() + "/file_watcher_test_2.asm";
+  const std::string other = testing::TempDir() + "/file_watcher_test.other";
+  auto watcher = FileWatcher::Create({first, second});
+  NSASM_ASSERT_OK(watcher);
+
+  // Write more events than inotify will queue, touching only the first file
+  // and one that isn't watched.  (Alternating names keeps inotify from
+  // coalescing the events.)
+  int limit = 16384;
+  if (FILE* f = std::fopen("/proc/sys/fs/inotify/max_queued_events", "r")) {
+    if (std::fscanf(f, "%d", &limit) != 1) {
+      limit = 16384;
+    }
+    std::fclose(f);
+  }
+  for (int i = 0; i <= limit / 2; ++i) {
+    NSASM_ASSERT_OK(WriteBinaryFile(other, {1}));
+    NSASM_ASSERT_OK(WriteBinaryFile(first, {2}));
+  }
+  EXPECT_THAT(*(*watcher)->WaitForChanges(1000), ElementsAre(first, second));
+
+  std::remove(first.c_str());
+  std::remove(other.c_str());
+}
+
+TEST(FileWatcher, Errors) {
+  EXPECT_FALSE(
+      FileWatcher::Create({testing::TempDir() + "/no/such/dir/file.asm"}).ok());
+
+  // The same file can't be watched twice, even under another name.
+  const std::string dir = testing::TempDir();
+  auto duplicate = FileWatcher::Create(
+      {dir + "/file_watcher_test.asm", dir + "/./file_watcher_test.asm"});
+  ASSERT_FALSE(duplicate.ok());
+  EXPECT_THAT(duplicate.error().ToString(), testing::HasSubstr("Same file"));
+}
+
+}  // namespace
+}  // namespace nsasm
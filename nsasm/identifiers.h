@@ -1,47 +1,83 @@
 #ifndef NSASM_IDENTIFIERS_H_
 #define NSASM_IDENTIFIERS_H_
 
+#include <compare>
 #include <string>
-#include <tuple>
+#include <string_view>
 
 #include "absl/strings/str_cat.h"
-#include "absl/types/optional.h"
+#include "nsasm/serialize.h"
+#include "nsasm/symbol.h"
 
 namespace nsasm {
 
+// A possibly module-qualified name.  Both parts are interned, so identifiers
+// are cheap to copy, compare and hash.
 class FullIdentifier {
  public:
-  FullIdentifier(std::string mod_name, std::string id_name)
-      : mod_name_(std::move(mod_name)), id_name_(std::move(id_name)) {}
-  explicit FullIdentifier(std::string id_name)
-      : mod_name_(absl::nullopt), id_name_(std::move(id_name)) {}
+  FullIdentifier(Symbol mod_name, Symbol id_name)
+      : mod_name_(mod_name), id_name_(id_name), qualified_(true) {}
+  explicit FullIdentifier(Symbol id_name) : id_name_(id_name) {}
+  FullIdentifier(std::string_view mod_name, std::string_view id_name)
+      : FullIdentifier(Symbol(mod_name), Symbol(id_name)) {}
+  explicit FullIdentifier(std::string_view id_name)
+      : FullIdentifier(Symbol(id_name)) {}
   FullIdentifier(const FullIdentifier&) = default;
   FullIdentifier(FullIdentifier&&) = default;
+  FullIdentifier& operator=(const FullIdentifier&) = default;
+  FullIdentifier& operator=(FullIdentifier&&) = default;
 
-  const absl::optional<std::string>& OptionalModule() const {
-    return mod_name_;
-  }
-  bool Qualified() const { return mod_name_.has_value(); }
-  const std::string& Module() const { return *mod_name_; }
-  const std::string& Identifier() const { return id_name_; }
+  bool Qualified() const { return qualified_; }
+  Symbol Module() const { return mod_name_; }
+  Symbol Identifier() const { return id_name_; }
   const std::string ToString() const {
     if (Qualified()) {
-      return absl::StrCat(*mod_name_, "::", id_name_);
+      return absl::StrCat(mod_name_.str(), "::", id_name_.str());
     } else {
-      return id_name_;
+      return id_name_.str();
+    }
+  }
+
+  bool operator==(const FullIdentifier& rhs) const {
+    return qualified_ == rhs.qualified_ && mod_name_ == rhs.mod_name_ &&
+           id_name_ == rhs.id_name_;
+  }
+  // Unqualified names sort first.
+  std::strong_ordering operator<=>(const FullIdentifier& rhs) const {
+    if (qualified_ != rhs.qualified_) {
+      return qualified_ <=> rhs.qualified_;
+    }
+    if (auto order = mod_name_ <=> rhs.mod_name_; order != 0) {
+      return order;
     }
+    return id_name_ <=> rhs.id_name_;
   }
 
-  auto operator<=>(const FullIdentifier& rhs) const = default;
+  // Writes this identifier to a cache file, or reads it back.
+  void Serialize(ByteWriter* out) const {
+    out->WriteU8(Qualified());
+    if (Qualified()) {
+      out->WriteString(mod_name_.str());
+    }
+    out->WriteString(id_name_.str());
+  }
+  static FullIdentifier Deserialize(ByteReader* in) {
+    if (in->ReadU8()) {
+      std::string mod_name = in->ReadString();
+      return FullIdentifier(mod_name, in->ReadString());
+    }
+    return FullIdentifier(in->ReadString());
+  }
 
   template <typename H>
   friend H AbslHashValue(H h, const FullIdentifier& n) {
-    return H::combine(std::move(h), n.mod_name_, n.id_name_);
+    return H::combine(std::move(h), n.qualified_, n.mod_name_, n.id_name_);
   }
 
  private:
-  absl::optional<std::string> mod_name_;
-  std::string id_name_;
+  Symbol mod_name_;
+  Symbol id_name_;
+  bool qualified_ = false;
 };
 
 // for debugging
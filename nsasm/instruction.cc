@@ -5,6 +5,29 @@
 
 namespace nsasm {
 
+void Instruction::Serialize(ByteWriter* out) const {
+  out->WriteU16(mnemonic);
+  out->WriteU16(suffix);
+  out->WriteU16(addressing_mode);
+  arg1.Serialize(out);
+  arg2.Serialize(out);
+  out->WriteU16(ReturnConventionCode(return_convention));
+  out->WriteU32(location.LineNumber());
+}
+
+Instruction Instruction::Deserialize(ByteReader* in, const Location& file) {
+  Instruction ins;
+  ins.mnemonic = ReadEnum(in, PM_sub);
+  ins.suffix = ReadEnum(in, S_w);
+  ins.addressing_mode = ReadEnum(in, A_imm_fx);
+  ins.arg1 = ExpressionOrNull::Deserialize(in);
+  ins.arg2 = ExpressionOrNull::Deserialize(in);
+  ins.return_convention = ReturnConventionFromCode(in->ReadU16(), in);
+  ins.location = file;
+  ins.location.Update(Location(int(in->ReadU32())));
+  return ins;
+}
+
 std::string Instruction::ToString() const {
   return absl::StrFormat("%s%s%s%s", nsasm::ToString(mnemonic),
                          nsasm::ToString(suffix),
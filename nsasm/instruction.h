@@ -72,6 +72,18 @@ struct Instruction {
                          OutputSink* sink) const;
 
   std::string ToString() const;
+
+  // Binds the names in this instruction's arguments (see Expression::Bind()).
+  void Bind(const BindingContext& context) {
+    arg1.Bind(context);
+    arg2.Bind(context);
+  }
+
+  // Writes this instruction to a cache file, or reads it back.  Only the line
+  // number of `location` is written; Deserialize() takes the path from `file`,
+  // and marks `in` as failed if the data is malformed.
+  void Serialize(ByteWriter* out) const;
+  static Instruction Deserialize(ByteReader* in, const Location& file);
 };
 
 inline bool Instruction::IsExitInstruction() const {
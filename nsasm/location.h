@@ -1,23 +1,26 @@
 #ifndef NSASM_LOCATION_H_
 #define NSASM_LOCATION_H_
 
+#include <cstdint>
 #include <string>
-#include <utility>
+#include <type_traits>
 
 #include "absl/strings/str_format.h"
+#include "nsasm/symbol.h"
 
 namespace nsasm {
 
-// Representation of a position in a file
+// Representation of a position in a file.
+//
+// Paths are interned, so a Location is a small value that can be copied into
+// every token cheaply.  It is only formatted as text when an error is shown.
 class Location {
  public:
   Location() {}
-  Location(std::string path) : path_(std::move(path)) {}
+  Location(const std::string& path) : path_(path) {}
   Location(int line_number) : offset_(line_number), offset_type_(kLineNumber) {}
-  Location(std::string path, int line_number)
-      : path_(std::move(path)),
-        offset_(line_number),
-        offset_type_(kLineNumber) {}
+  Location(const std::string& path, int line_number)
+      : path_(path), offset_(line_number), offset_type_(kLineNumber) {}
   static Location FromAddress(int address) {
     Location loc;
     loc.offset_type_ = kAddress;
@@ -35,6 +38,11 @@ class Location {
     }
   }
 
+  const std::string& Path() const { return path_.str(); }
+
+  // Returns the line number of this location, or 0 if it has none.
+  int LineNumber() const { return offset_type_ == kLineNumber ? offset_ : 0; }
+
   std::string ToString() const {
     if (path_.empty()) {
       return {};
@@ -42,11 +50,11 @@ class Location {
     switch (offset_type_) {
       case kNone:
       default:
-        return path_;
+        return path_.str();
       case kLineNumber:
-        return absl::StrFormat("%s:%d", path_, offset_);
+        return absl::StrFormat("%s:%d", path_, int(offset_));
       case kAddress:
-        return absl::StrFormat("%s:0x%06x", path_, offset_);
+        return absl::StrFormat("%s:0x%06x", path_, int(offset_));
     }
   }
 
@@ -57,11 +65,15 @@ class Location {
     kAddress,
   };
 
-  std::string path_;
-  int offset_ = 0;
-  OffsetType offset_type_ = kNone;
+  Symbol path_;
+  // Line numbers and 24-bit addresses both fit in 30 bits.
+  uint32_t offset_ : 30 = 0;
+  uint32_t offset_type_ : 2 = kNone;
 };
 
+static_assert(sizeof(Location) == 8);
+static_assert(std::is_trivially_copyable_v<Location>);
+
 }  // namespace nsasm
 
 #endif  // NSASM_LOCATION_H_
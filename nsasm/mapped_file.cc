@@ -0,0 +1,44 @@
+#include "nsasm/mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace nsasm {
+
+ErrorOr<std::unique_ptr<MappedFile>> MappedFile::Open(
+    const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return Error("Failed to open file").SetLocation(path);
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= 0) {
+    close(fd);
+    return Error("Failed to read file").SetLocation(path);
+  }
+  const size_t size = info.st_size;
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file.
+  close(fd);
+  if (data == MAP_FAILED) {
+    return Error("Failed to map file").SetLocation(path);
+  }
+  return std::unique_ptr<MappedFile>(
+      new MappedFile(static_cast<uint8_t*>(data), size));
+}
+
+MappedFile::~MappedFile() { munmap(data_, size_); }
+
+ErrorOr<absl::Span<uint8_t>> MappedFile::MutableData() {
+  if (!writable_) {
+    if (mprotect(data_, size_, PROT_READ | PROT_WRITE) != 0) {
+      return Error("Failed to make file mapping writable");
+    }
+    writable_ = true;
+  }
+  return absl::MakeSpan(data_, size_);
+}
+
+}  // namespace nsasm
@@ -0,0 +1,47 @@
+#ifndef NSASM_MAPPED_FILE_H_
+#define NSASM_MAPPED_FILE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/types/span.h"
+#include "nsasm/error.h"
+
+namespace nsasm {
+
+// A binary file mapped into memory, used to load ROM images without reading
+// them into a separate buffer.
+//
+// The file is mapped read-only.  MutableData() makes the mapping writable in
+// place: the mapping is private, so only pages that are actually written
+// become copies, and the file on disk is never modified.
+class MappedFile {
+ public:
+  // Maps the entire file at `path`.  Empty files can't be mapped, and are
+  // reported as an error.
+  static ErrorOr<std::unique_ptr<MappedFile>> Open(const std::string& path);
+
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  absl::Span<const uint8_t> Data() const {
+    return absl::MakeConstSpan(data_, size_);
+  }
+
+  // Returns a writable view of the file's contents.  Writes are private to
+  // this process.
+  ErrorOr<absl::Span<uint8_t>> MutableData();
+
+ private:
+  MappedFile(uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  uint8_t* data_;
+  size_t size_;
+  bool writable_ = false;
+};
+
+}  // namespace nsasm
+
+#endif  // NSASM_MAPPED_FILE_H_
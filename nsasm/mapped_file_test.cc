@@ -0,0 +1,44 @@
+#include "nsasm/mapped_file.h"
+
+#include <cstdio>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "nsasm/serialize.h"
+
+namespace nsasm {
+namespace {
+
+using testing::ElementsAre;
+
+TEST(MappedFile, MapsContents) {
+  const std::string path = testing::TempDir() + "/mapped_file_test.bin";
+  const std::vector<uint8_t> contents = {1, 2, 3, 4, 5};
+  NSASM_ASSERT_OK(WriteBinaryFile(path, contents));
+
+  auto file = MappedFile::Open(path);
+  NSASM_ASSERT_OK(file);
+  EXPECT_THAT((*file)->Data(), ElementsAre(1, 2, 3, 4, 5));
+
+  // Writes are visible through the mapping, but don't reach the file.
+  auto data = (*file)->MutableData();
+  NSASM_ASSERT_OK(data);
+  (*data)[1] = 0xff;
+  EXPECT_THAT((*file)->Data(), ElementsAre(1, 0xff, 3, 4, 5));
+  EXPECT_EQ(*ReadBinaryFile(path), contents);
+
+  std::remove(path.c_str());
+}
+
+TEST(MappedFile, Errors) {
+  const std::string path = testing::TempDir() + "/mapped_file_test.empty";
+  NSASM_ASSERT_OK(WriteBinaryFile(path, {}));
+  EXPECT_FALSE(MappedFile::Open(path).ok());
+  EXPECT_FALSE(MappedFile::Open(testing::TempDir()).ok());
+  std::remove(path.c_str());
+  EXPECT_FALSE(MappedFile::Open(path).ok());
+}
+
+}  // namespace
+}  // namespace nsasm
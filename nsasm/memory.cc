@@ -4,20 +4,27 @@
 
 namespace nsasm {
 
+ErrorOr<ByteView> InputSource::ReadView(nsasm::Address address,
+                                        int length) const {
+  auto read = Read(address, length);
+  NSASM_RETURN_IF_ERROR(read);
+  return ByteView(absl::InlinedVector<uint8_t, 4>(read->begin(), read->end()));
+}
+
 ErrorOr<int> InputSource::ReadByte(nsasm::Address address) const {
-  auto read = Read(address, 1);
+  auto read = ReadView(address, 1);
   NSASM_RETURN_IF_ERROR(read);
   return (*read)[0];
 }
 
 ErrorOr<int> InputSource::ReadWord(nsasm::Address address) const {
-  auto read = Read(address, 2);
+  auto read = ReadView(address, 2);
   NSASM_RETURN_IF_ERROR(read);
   return (*read)[0] + ((*read)[1] * 256);
 }
 
 ErrorOr<int> InputSource::ReadLong(nsasm::Address address) const {
-  auto read = Read(address, 3);
+  auto read = ReadView(address, 3);
   NSASM_RETURN_IF_ERROR(read);
   return (*read)[0] + ((*read)[1] * 256) + ((*read)[2] * 256 * 256);
 }
@@ -3,12 +3,47 @@
 
 #include <cstdint>
 
+#include "absl/container/inlined_vector.h"
 #include "absl/types/span.h"
 #include "nsasm/address.h"
 #include "nsasm/error.h"
 
 namespace nsasm {
 
+// The result of a non-allocating read from an InputSource.
+//
+// In the common case this is a view directly into the backing storage of the
+// source.  Reads that can't be represented that way (for instance, a read that
+// wraps around the end of a bank) instead hold a copy of the bytes, which is
+// stored inline for small reads.
+//
+// A view into backing storage is valid only as long as the InputSource it was
+// read from.
+class ByteView {
+ public:
+  ByteView() = default;
+  explicit ByteView(absl::Span<const uint8_t> view) : view_(view) {}
+  explicit ByteView(absl::InlinedVector<uint8_t, 4> copy)
+      : copy_(std::move(copy)), is_copy_(true) {}
+
+  absl::Span<const uint8_t> span() const {
+    return is_copy_ ? absl::MakeConstSpan(copy_) : view_;
+  }
+  operator absl::Span<const uint8_t>() const { return span(); }
+
+  size_t size() const { return span().size(); }
+  bool empty() const { return span().empty(); }
+  const uint8_t* data() const { return span().data(); }
+  const uint8_t* begin() const { return span().begin(); }
+  const uint8_t* end() const { return span().end(); }
+  uint8_t operator[](size_t i) const { return span()[i]; }
+
+ private:
+  absl::Span<const uint8_t> view_;
+  absl::InlinedVector<uint8_t, 4> copy_;
+  bool is_copy_ = false;
+};
+
 // General interface for reading bytes from a source during disassembly.
 class InputSource {
  public:
@@ -25,6 +60,11 @@ class InputSource {
   virtual ErrorOr<std::vector<uint8_t>> Read(nsasm::Address address,
                                              int length) const = 0;
 
+  // As Read(), but avoids allocation where possible by returning a view into
+  // the source's storage.  The default implementation copies the result of
+  // Read(); sources that hold their data in memory should override this.
+  virtual ErrorOr<ByteView> ReadView(nsasm::Address address, int length) const;
+
   // Helper functions to read 1, 2, or 3-byte long little-endian values from
   // an address.
   ErrorOr<int> ReadByte(nsasm::Address address) const;
@@ -42,6 +82,12 @@ class OutputSink {
   // address, etc.)
   virtual ErrorOr<void> Write(nsasm::Address address,
                               absl::Span<const std::uint8_t> data) = 0;
+
+  // Called by Module::Assemble() with the source location of each statement,
+  // before the statement's output is written.  Sinks that defer their writes
+  // can save it, to report later errors against the statement.  The default
+  // does nothing.
+  virtual void SetStatementLocation(const nsasm::Location& location) {}
 };
 
 }  // namespace nsasm
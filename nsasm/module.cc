@@ -1,7 +1,10 @@
 #include "nsasm/module.h"
 
 #include <fstream>
+#include <set>
+#include <utility>
 
+#include "absl/container/inlined_vector.h"
 #include "absl/strings/str_format.h"
 #include "nsasm/parse.h"
 #include "nsasm/token.h"
@@ -37,16 +40,58 @@ class ModuleLookupContext : public LookupContext {
         NSASM_RETURN_IF_ERROR(val);
         return val->ToInt();
       }
-      return externs_.Lookup(FullIdentifier("", id.Identifier()));
+      return externs_.Lookup(FullIdentifier(Symbol(), id.Identifier()));
     }
   }
 
+  ErrorOr<int> LookupBound(const FullIdentifier& id,
+                           const ValueSlot* slot) const override {
+    if (!slot) {
+      return Lookup(id);
+    }
+    if (slot->has_value()) {
+      return (*slot)->ToInt();
+    }
+    return Error("Value '%s' accessed before definition", id.ToString());
+  }
+
  private:
   Module* module_;
   const std::vector<int>& active_scopes_;
   const LookupContext& externs_;
 };
 
+// Resolves names as ModuleLookupContext does, but to the slots holding their
+// values.
+class ModuleBindingContext : public BindingContext {
+ public:
+  ModuleBindingContext(Module* module, const std::vector<int>& active_scopes,
+                       const BindingContext& extern_vars)
+      : module_(module), active_scopes_(active_scopes), externs_(extern_vars) {}
+
+  const ValueSlot* Bind(const FullIdentifier& id) const override {
+    if (id.Qualified()) {
+      if (id.Module() == module_->module_name_) {
+        auto li = module_->LocalIndex(id.Identifier(), {});
+        if (li.ok()) {
+          return &module_->lines_[*li].value;
+        }
+      }
+      return externs_.Bind(id);
+    }
+    auto li = module_->LocalIndex(id.Identifier(), active_scopes_);
+    if (li.ok()) {
+      return &module_->lines_[*li].value;
+    }
+    return externs_.Bind(FullIdentifier(Symbol(), id.Identifier()));
+  }
+
+ private:
+  Module* module_;
+  const std::vector<int>& active_scopes_;
+  const BindingContext& externs_;
+};
+
 class ModuleIsLocalContext : public IsLocalContext {
  public:
   ModuleIsLocalContext(Module* module, const std::vector<int>& active_scopes)
@@ -89,7 +134,7 @@ ErrorOr<Module> Module::LoadAsmFile(const File& file) {
     if (label.IsPlusOrMinus()) {
       return {};  // +/- labels don't participate in scoping and exporting
     }
-    absl::flat_hash_map<std::string, int>* scope;
+    absl::flat_hash_map<Symbol, int>* scope;
     if (active_scopes.empty() || label.IsExported()) {
       scope = &m.global_to_line_;
     } else {
@@ -173,66 +218,218 @@ ErrorOr<Module> Module::LoadAsmFile(const File& file) {
   return m;
 }
 
-ErrorOr<void> Module::RunFirstPass() {
-  // Map of lines to evaluate next, and the flag state on entry
-  std::map<size_t, ExecutionState> decode_stack;
-  auto add_to_decode_stack = [&decode_stack](size_t line,
-                                             const ExecutionState& state) {
-    auto it = decode_stack.find(line);
-    if (it == decode_stack.end()) {
-      decode_stack[line] = state;
-    } else {
-      it->second |= state;
+void Module::Serialize(ByteWriter* out) const {
+  out->WriteString(module_name_.str());
+  out->WriteU32(lines_.size());
+  for (const Line& line : lines_) {
+    line.statement.Serialize(out);
+    out->WriteU32(line.identifier_labels.size());
+    for (Symbol label : line.identifier_labels) {
+      out->WriteString(label.str());
     }
-  };
-  // Find all .entry points in the module to begin static analysis.
-  for (size_t i = 0; i < lines_.size(); ++i) {
-    Line& line = lines_[i];
-    if (line.statement == D_entry) {
-      add_to_decode_stack(i + 1,
-                          line.statement.Directive()->flag_state_argument);
+    out->WriteU32(line.plus_minus_labels.size());
+    for (Punctuation label : line.plus_minus_labels) {
+      out->WriteU16(label);
+    }
+    out->WriteU32(line.active_scopes.size());
+    for (int scope : line.active_scopes) {
+      out->WriteU32(scope);
+    }
+    out->WriteU32(line.scoped_locals.size());
+    for (const auto& node : line.scoped_locals) {
+      out->WriteString(node.first.str());
+      out->WriteU32(node.second);
     }
   }
+  out->WriteU32(dependencies_.size());
+  for (const FullIdentifier& dependency : dependencies_) {
+    dependency.Serialize(out);
+  }
+  out->WriteU32(global_to_line_.size());
+  for (const auto& node : global_to_line_) {
+    out->WriteString(node.first.str());
+    out->WriteU32(node.second);
+  }
+}
+
+ErrorOr<Module> Module::Deserialize(ByteReader* in, const std::string& path) {
+  Module m;
+  m.path_ = path;
+  m.module_name_ = Symbol(in->ReadString());
+  const Location file(path);
 
-  while (!decode_stack.empty()) {
-    // Consider the earliest statement that needs processing.
-    auto& node = *decode_stack.begin();
-    if (node.first == lines_.size()) {
-      return Error("Execution continues past end of file");
+  // Line indices are checked against the line count once everything is read.
+  std::vector<uint32_t> line_indices;
+  for (uint32_t n = in->ReadU32(); n > 0 && in->ok(); --n) {
+    m.lines_.emplace_back(Statement::Deserialize(in, file));
+    Line& line = m.lines_.back();
+    for (uint32_t i = in->ReadU32(); i > 0 && in->ok(); --i) {
+      line.identifier_labels.push_back(Symbol(in->ReadString()));
     }
-    Line& line = lines_[node.first];
-    const ExecutionState& current_state = node.second;
-    if (line.reached && line.incoming_state == current_state) {
-      // we've been here before under these conditions; nothing more to do
-      decode_stack.erase(decode_stack.begin());
-      continue;
+    for (uint32_t i = in->ReadU32(); i > 0 && in->ok(); --i) {
+      line.plus_minus_labels.insert(Punctuation(in->ReadU16()));
+    }
+    for (uint32_t i = in->ReadU32(); i > 0 && in->ok(); --i) {
+      line_indices.push_back(in->ReadU32());
+      line.active_scopes.push_back(line_indices.back());
+    }
+    for (uint32_t i = in->ReadU32(); i > 0 && in->ok(); --i) {
+      Symbol name(in->ReadString());
+      line_indices.push_back(in->ReadU32());
+      line.scoped_locals[name] = line_indices.back();
     }
+  }
+  for (uint32_t n = in->ReadU32(); n > 0 && in->ok(); --n) {
+    m.dependencies_.insert(FullIdentifier::Deserialize(in));
+  }
+  for (uint32_t n = in->ReadU32(); n > 0 && in->ok(); --n) {
+    Symbol name(in->ReadString());
+    line_indices.push_back(in->ReadU32());
+    m.global_to_line_[name] = line_indices.back();
+  }
+  for (uint32_t index : line_indices) {
+    if (index >= m.lines_.size()) {
+      in->Fail();
+    }
+  }
+  if (!in->ok()) {
+    return Error("Malformed module cache for %s", path);
+  }
+  return m;
+}
 
+ErrorOr<void> Module::RunFirstPass() {
+  first_pass_stats_ = DataflowStats();
+
+  // Build the line-level control flow graph, from every .entry point.  Each
+  // reachable line falls through to the next unless it is an exit, and local
+  // branches also continue at their target.
+  std::vector<int> branch_target(lines_.size(), -1);
+  std::vector<int> entries;
+  for (size_t i = 0; i < lines_.size(); ++i) {
+    if (lines_[i].statement == D_entry) {
+      entries.push_back(i + 1);
+    }
+  }
+  auto successors = [this, &branch_target](int index) {
+    absl::InlinedVector<int, 2> result;
+    if (!lines_[index].statement.IsExitInstruction()) {
+      result.push_back(index + 1);
+    }
+    if (branch_target[index] >= 0) {
+      result.push_back(branch_target[index]);
+    }
+    return result;
+  };
+
+  // Number the reachable lines in reverse postorder, so that the solver below
+  // visits a line after its predecessors wherever the graph allows.
+  std::vector<int> postorder;
+  std::vector<bool> visited(lines_.size());
+  for (int entry : entries) {
+    // Depth-first search, holding each line with the number of its successors
+    // already explored.
+    std::vector<std::pair<int, size_t>> stack;
+    auto visit = [&](int index) -> ErrorOr<void> {
+      if (index == static_cast<int>(lines_.size())) {
+        return Error("Execution continues past end of file");
+      }
+      if (visited[index]) {
+        return {};
+      }
+      visited[index] = true;
+      const Line& line = lines_[index];
+      if (line.statement.IsLocalBranch()) {
+        const Instruction& ins = *line.statement.Instruction();
+        auto target = ins.arg1.SimpleIdentifier();
+        if (!target) {
+          return Error("logic error: branch instruction argument missing?");
+        }
+        auto target_index = LocalIndex(*target, line.active_scopes);
+        if (!target_index.ok()) {
+          return Error("Target for `%s %s` not found",
+                       nsasm::ToString(ins.mnemonic), *target)
+              .SetLocation(ins.location);
+        }
+        branch_target[index] = *target_index;
+      }
+      stack.emplace_back(index, 0);
+      return {};
+    };
+    NSASM_RETURN_IF_ERROR(visit(entry));
+    while (!stack.empty()) {
+      const int index = stack.back().first;
+      const auto next = successors(index);
+      if (stack.back().second < next.size()) {
+        const int successor = next[stack.back().second++];
+        NSASM_RETURN_IF_ERROR(visit(successor));
+      } else {
+        postorder.push_back(index);
+        stack.pop_back();
+      }
+    }
+  }
+  std::vector<int> rpo_position(lines_.size());
+  for (size_t i = 0; i < postorder.size(); ++i) {
+    rpo_position[postorder[i]] = postorder.size() - 1 - i;
+  }
+  first_pass_stats_.reachable_lines = postorder.size();
+
+  // Monotone worklist solver.  A line's incoming state is the merge of every
+  // state that reaches it, and a line is executed again only when that merge
+  // changes.  Once a line's state has changed kWideningThreshold times, it is
+  // widened instead, to bound the work done on loops.  The worklist holds
+  // reverse postorder positions.
+  std::set<int> worklist;
+  std::vector<int> changes(lines_.size());
+  auto propagate = [this, &worklist, &rpo_position, &changes](
+                       int index, StateHandle state) {
+    ++first_pass_stats_.propagations;
+    Line& line = lines_[index];
+    if (line.reached) {
+      if (changes[index] < kWideningThreshold) {
+        state = states_.Merge(line.incoming_state, state);
+      } else {
+        ++first_pass_stats_.widenings;
+        ExecutionState widened = states_.Get(line.incoming_state);
+        widened.WidenWith(states_.Get(state));
+        state = states_.Intern(widened);
+      }
+      if (state == line.incoming_state) {
+        return;
+      }
+      ++changes[index];
+    }
     line.reached = true;
-    line.incoming_state = current_state;
+    line.incoming_state = state;
+    worklist.insert(rpo_position[index]);
+  };
+  for (size_t i = 0; i < entries.size(); ++i) {
+    ExecutionState entry_state(
+        lines_[entries[i] - 1].statement.Directive()->flag_state_argument);
+    propagate(entries[i], states_.Intern(entry_state));
+  }
 
-    ExecutionState next_state = current_state;
+  const std::vector<int> rpo(postorder.rbegin(), postorder.rend());
+  while (!worklist.empty()) {
+    const int index = rpo[*worklist.begin()];
+    worklist.erase(worklist.begin());
+    ++first_pass_stats_.executions;
+
+    const Line& line = lines_[index];
+    const StateHandle current_state = line.incoming_state;
+    ExecutionState next_state = states_.Get(current_state);
     NSASM_RETURN_IF_ERROR_WITH_LOCATION(line.statement.Execute(&next_state),
                                         line.statement.Location());
     if (!line.statement.IsExitInstruction()) {
-      add_to_decode_stack(node.first + 1, next_state);
+      propagate(index + 1, states_.Intern(next_state));
     }
-    if (line.statement.IsLocalBranch()) {
-      const Instruction& ins = *line.statement.Instruction();
-      auto target = ins.arg1.SimpleIdentifier();
-      if (!target) {
-        return Error("logic error: branch instruction argument missing?");
-      }
-      auto target_index = LocalIndex(*target, line.active_scopes);
-      if (!target_index.ok()) {
-        return Error("Target for `%s %s` not found",
-                     nsasm::ToString(ins.mnemonic), *target)
-            .SetLocation(ins.location);
-      }
-      next_state = current_state;
-      NSASM_RETURN_IF_ERROR_WITH_LOCATION(ins.ExecuteBranch(&next_state),
-                                          line.statement.Location());
-      add_to_decode_stack(*target_index, next_state);
+    if (branch_target[index] >= 0) {
+      next_state = states_.Get(current_state);
+      NSASM_RETURN_IF_ERROR_WITH_LOCATION(
+          line.statement.Instruction()->ExecuteBranch(&next_state),
+          line.statement.Location());
+      propagate(branch_target[index], states_.Intern(next_state));
     }
   }
 
@@ -246,7 +443,8 @@ ErrorOr<void> Module::RunFirstPass() {
     }
     if (ins) {
       NSASM_RETURN_IF_ERROR_WITH_LOCATION(
-          ins->FixAddressingMode(line.incoming_state.Flags()), ins->location);
+          ins->FixAddressingMode(states_.Get(line.incoming_state).Flags()),
+          ins->location);
     }
   }
 
@@ -275,21 +473,21 @@ ErrorOr<void> Module::RunFirstPass() {
   return {};
 }
 
-ErrorOr<int> Module::LocalIndex(std::string_view sv,
+ErrorOr<int> Module::LocalIndex(Symbol name,
                                 const std::vector<int>& active_scopes) const {
-  std::vector<const absl::flat_hash_map<std::string, int>*> scopes;
+  std::vector<const absl::flat_hash_map<Symbol, int>*> scopes;
   for (auto it = active_scopes.rbegin(); it != active_scopes.rend(); ++it) {
     scopes.push_back(&lines_[*it].scoped_locals);
   }
   scopes.push_back(&global_to_line_);
   for (auto scope : scopes) {
-    auto line_it = scope->find(sv);
+    auto line_it = scope->find(name);
     if (line_it == scope->end()) {
       continue;
     }
     return line_it->second;
   }
-  return Error("Reference to undefined name '%s'", sv);
+  return Error("Reference to undefined name '%s'", name);
 }
 
 ErrorOr<LabelValue> Module::LocalLookup(int index,
@@ -301,11 +499,24 @@ ErrorOr<LabelValue> Module::LocalLookup(int index,
   return Error("Value '%s' accessed before definition", id.ToString());
 }
 
+void Module::Bind(const BindingContext& extern_context) {
+  for (Line& line : lines_) {
+    ModuleBindingContext context(this, line.active_scopes, extern_context);
+    line.statement.Bind(context);
+  }
+}
+
 ErrorOr<void> Module::RunSecondPass(const LookupContext& lookup_context) {
-  // Second pass is for evaluating .equ expressions only.
+  // Second pass is for evaluating .equ expressions only.  Forget the values
+  // from any earlier run first, so that stale values can't be read.
+  for (Line& line : lines_) {
+    if (line.statement == D_equ) {
+      line.value.reset();
+    }
+  }
   for (Line& line : lines_) {
     const Directive* dir = line.statement.Directive();
-    if (dir && dir->name == D_equ && !line.value.has_value()) {
+    if (dir && dir->name == D_equ) {
       ModuleLookupContext context(this, line.active_scopes, lookup_context);
       auto value = dir->argument.Evaluate(context);
       NSASM_RETURN_IF_ERROR_WITH_LOCATION(value, line.statement.Location());
@@ -327,6 +538,10 @@ const std::map<FullIdentifier, Location> Module::ExportedNames() const {
 
 ErrorOr<void> Module::Assemble(OutputSink* sink,
                                const LookupContext& lookup_context) {
+  owned_bytes_ = DataRange();
+  address_to_global_.clear();
+  unnamed_targets_.clear();
+  return_conventions_.clear();
   for (Line& line : lines_) {
     auto* directive = line.statement.Directive();
     auto* instruction = line.statement.Instruction();
@@ -338,6 +553,7 @@ ErrorOr<void> Module::Assemble(OutputSink* sink,
             .SetLocation(line.statement.Location());
       }
       Address address = line.value->ToAddress();
+      sink->SetStatementLocation(line.statement.Location());
       NSASM_RETURN_IF_ERROR_WITH_LOCATION(
           line.statement.Assemble(address, context, sink),
           line.statement.Location());
@@ -376,11 +592,12 @@ ErrorOr<void> Module::Assemble(OutputSink* sink,
       if (branch_target.has_value()) {
         // FarBranchTarget() does not perform lookup, so if we have a value,
         // this is our branch target.
+        const StatusFlags& flags = states_.Get(line.incoming_state).Flags();
         auto it = unnamed_targets_.find(*branch_target);
         if (it == unnamed_targets_.end()) {
-          unnamed_targets_[*branch_target] = line.incoming_state.Flags();
+          unnamed_targets_[*branch_target] = flags;
         } else {
-          it->second |= line.incoming_state.Flags();
+          it->second |= flags;
         }
       }
     }
@@ -401,7 +618,7 @@ ErrorOr<void> Module::Assemble(OutputSink* sink,
 
 void Module::DebugPrint() const {
   for (const auto& line : lines_) {
-    for (const std::string& label : line.identifier_labels) {
+    for (Symbol label : line.identifier_labels) {
       absl::PrintF("       %s:\n", label);
     }
     for (Punctuation punct : line.plus_minus_labels) {
@@ -433,6 +650,17 @@ ErrorOr<LabelValue> Module::ValueForName(const FullIdentifier& id) const {
   return Error("logic error: No value at label %s", id.ToString());
 }
 
+const ValueSlot* Module::SlotForName(const FullIdentifier& id) const {
+  if (!id.Qualified() || id.Module() != module_name_) {
+    return nullptr;
+  }
+  auto line_loc = global_to_line_.find(id.Identifier());
+  if (line_loc == global_to_line_.end()) {
+    return nullptr;
+  }
+  return &lines_[line_loc->second].value;
+}
+
 absl::optional<FullIdentifier> Module::NameForAddress(
     nsasm::Address address) const {
   if (module_name_.empty()) {
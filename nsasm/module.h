@@ -6,14 +6,18 @@
 #include "absl/container/flat_hash_map.h"
 #include "nsasm/address.h"
 #include "nsasm/error.h"
+#include "nsasm/execution_state_pool.h"
 #include "nsasm/file.h"
 #include "nsasm/identifiers.h"
 #include "nsasm/parse.h"
 #include "nsasm/ranges.h"
+#include "nsasm/serialize.h"
 #include "nsasm/statement.h"
+#include "nsasm/symbol.h"
 
 namespace nsasm {
 
+class ModuleBindingContext;
 class ModuleLookupContext;
 class ModuleIsLocalContext;
 
@@ -22,13 +26,22 @@ class Module {
   // movable but not copiable
   Module(const Module&) = delete;
   Module(Module&&) = default;
+  Module& operator=(Module&&) = default;
 
   // Takes a given File, and either returns the Module parsed from it, or an
   // error.
   static ErrorOr<Module> LoadAsmFile(const File& file);
 
+  // Writes the parsed contents of this module to a cache file.  Call this
+  // only on a module returned by LoadAsmFile(), before RunFirstPass().
+  void Serialize(ByteWriter* out) const;
+
+  // Reads back a module written by Serialize().  `path` is the path of the
+  // source file the module was parsed from.
+  static ErrorOr<Module> Deserialize(ByteReader* in, const std::string& path);
+
   std::string Path() const { return path_; }
-  std::string Name() const { return module_name_; }
+  const std::string& Name() const { return module_name_.str(); }
 
   // Returns a map from qualified identifiers that this module exports to the
   // locations where these entities are defined.  (The locations are intended
@@ -38,16 +51,44 @@ class Module {
   // Returns the set of qualified identifiers that this module depends on. (This
   // is not every reference, but only for references that require early
   // evaluation, i.e., .EQU arguments.)
-  const std::set<FullIdentifier> Dependencies() const { return dependencies_; }
+  const std::set<FullIdentifier>& Dependencies() const { return dependencies_; }
 
   // Run the first pass of this module.  This determines the size of each
   // instruction and assigns an address to each non-.equ label, but will not
   // evaluate any expressions.
   ErrorOr<void> RunFirstPass();
 
+  // Counters describing the work done by the flag state analysis in the last
+  // call to RunFirstPass().
+  struct DataflowStats {
+    // Lines reachable from an .entry point.
+    int reachable_lines = 0;
+    // Statements executed.  Each reachable line is executed once, and again
+    // each time its merged incoming state changes.
+    int executions = 0;
+    // States passed along control flow edges.
+    int propagations = 0;
+    // Propagations that widened, rather than merged, a line's state.
+    int widenings = 0;
+  };
+  const DataflowStats& FirstPassStats() const { return first_pass_stats_; }
+
+  // Resolves every name used in this module's expressions to the slot that
+  // will hold its value, so that later passes read values directly rather
+  // than looking them up by name.  Names that aren't local are bound through
+  // `extern_context`; names that can't be bound are looked up, and reported
+  // if missing, during evaluation as before.
+  //
+  // Call this after RunFirstPass().  Bindings into another module are left
+  // dangling if that module is destroyed or replaced.
+  void Bind(const BindingContext& extern_context);
+
   // Run the .equ evaluation pass.  This determines the value of each .equ
   // expression.  Evaluation of other expressions in the module aren't performed
   // this pass.
+  //
+  // This may be run again after other modules change, to re-evaluate every
+  // .equ expression.
   ErrorOr<void> RunSecondPass(const LookupContext& lookup_context);
 
   // Returns the value for the given qualified name, or nullopt if that name is
@@ -55,6 +96,12 @@ class Module {
   // successfully returned.
   ErrorOr<LabelValue> ValueForName(const FullIdentifier& sv) const;
 
+  // Returns the slot holding the value for the given qualified name, or
+  // nullptr if that name is not defined by this module.
+  const ValueSlot* SlotForName(const FullIdentifier& id) const;
+
+  // Assemble this module into `sink`.  This may be run again after
+  // RunSecondPass(), replacing the results of the previous run.
   ErrorOr<void> Assemble(OutputSink* sink, const LookupContext& lookup_context);
 
   // Post-assembly queries
@@ -85,7 +132,7 @@ class Module {
   // Perform an internal lookup for a given label.  Returns an error if the
   // name does not exist.  Otherwise returns the index into lines_ where this
   // label points.
-  ErrorOr<int> LocalIndex(std::string_view sv,
+  ErrorOr<int> LocalIndex(Symbol name,
                           const std::vector<int>& active_scopes) const;
 
   // Perform an internal lookup for a given label index (as returned from
@@ -93,6 +140,7 @@ class Module {
   // necessary.
   ErrorOr<LabelValue> LocalLookup(int index, const FullIdentifier& id) const;
 
+  friend class nsasm::ModuleBindingContext;
   friend class nsasm::ModuleLookupContext;
   friend class nsasm::ModuleIsLocalContext;
 
@@ -101,25 +149,28 @@ class Module {
     Line(Statement statement)
         : statement(std::move(statement)), incoming_state() {}
     Statement statement;
-    std::vector<std::string> identifier_labels;
+    std::vector<Symbol> identifier_labels;
     std::set<Punctuation> plus_minus_labels;
     bool reached = false;
-    ExecutionState incoming_state;
+    // Handle into states_.
+    StateHandle incoming_state;
     absl::optional<LabelValue> value;
     std::vector<int> active_scopes;
-    absl::flat_hash_map<std::string, int> scoped_locals;
+    absl::flat_hash_map<Symbol, int> scoped_locals;
   };
 
   std::string path_;
-  std::string module_name_;
+  Symbol module_name_;
   std::vector<Line> lines_;
   std::set<FullIdentifier> dependencies_;
-  absl::flat_hash_map<std::string, int> global_to_line_;
+  absl::flat_hash_map<Symbol, int> global_to_line_;
 
   DataRange owned_bytes_;
-  absl::flat_hash_map<nsasm::Address, std::string> address_to_global_;
+  absl::flat_hash_map<nsasm::Address, Symbol> address_to_global_;
   std::map<nsasm::Address, StatusFlags> unnamed_targets_;
   std::map<nsasm::Address, ReturnConvention> return_conventions_;
+  ExecutionStatePool states_;
+  DataflowStats first_pass_stats_;
 };
 
 }  // namespace nsasm
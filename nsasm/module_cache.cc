@@ -0,0 +1,57 @@
+#include "nsasm/module_cache.h"
+
+#include "absl/strings/str_format.h"
+#include "nsasm/serialize.h"
+
+namespace nsasm {
+
+namespace {
+
+constexpr uint32_t kCacheMagic = 0x434d534e;  // "NSMC"
+constexpr uint32_t kCacheVersion = 1;
+
+}  // namespace
+
+uint64_t ModuleCacheKey(const File& file) {
+  uint64_t key = kFnvOffsetBasis;
+  for (const std::string& line : file) {
+    key = Fnv1a(line, key);
+    key = Fnv1a("\n", key);
+  }
+  return key;
+}
+
+std::string ModuleCachePath(const std::string& cache_dir, uint64_t key) {
+  return absl::StrFormat("%s/%016x.nsmod", cache_dir, key);
+}
+
+ErrorOr<Module> CachedLoadAsmFile(const std::string& cache_dir,
+                                  const File& file) {
+  const uint64_t key = ModuleCacheKey(file);
+  const std::string cache_path = ModuleCachePath(cache_dir, key);
+
+  auto data = ReadBinaryFile(cache_path);
+  if (data.ok()) {
+    ByteReader in(*data);
+    if (in.ReadU32() == kCacheMagic && in.ReadU32() == kCacheVersion &&
+        in.ReadU64() == key) {
+      auto module = Module::Deserialize(&in, file.path());
+      if (module.ok() && in.AtEnd()) {
+        return module;
+      }
+    }
+  }
+
+  auto module = Module::LoadAsmFile(file);
+  NSASM_RETURN_IF_ERROR(module);
+  ByteWriter out;
+  out.WriteU32(kCacheMagic);
+  out.WriteU32(kCacheVersion);
+  out.WriteU64(key);
+  module->Serialize(&out);
+  // The cache only saves time; a failed write costs nothing else.
+  (void)WriteBinaryFile(cache_path, out.Data());
+  return module;
+}
+
+}  // namespace nsasm
@@ -0,0 +1,32 @@
+#ifndef NSASM_MODULE_CACHE_H_
+#define NSASM_MODULE_CACHE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "nsasm/error.h"
+#include "nsasm/file.h"
+#include "nsasm/module.h"
+
+namespace nsasm {
+
+// Returns a key identifying the contents of `file`.  The file's path is not
+// included, so identical files share a cache entry.
+uint64_t ModuleCacheKey(const File& file);
+
+// Returns the cache file path to use for the given key inside `cache_dir`.
+std::string ModuleCachePath(const std::string& cache_dir, uint64_t key);
+
+// As Module::LoadAsmFile(), but reuses the parsed module stored in
+// `cache_dir` by an earlier call on a file with the same contents.  On a cache
+// miss, the file is parsed and the result is stored for next time.
+//
+// A missing, stale or corrupt cache file just means parsing from scratch, and
+// failing to write one is not an error.  Files that fail to parse are not
+// cached.
+ErrorOr<Module> CachedLoadAsmFile(const std::string& cache_dir,
+                                  const File& file);
+
+}  // namespace nsasm
+
+#endif  // NSASM_MODULE_CACHE_H_
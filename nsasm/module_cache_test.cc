@@ -0,0 +1,134 @@
+#include "nsasm/module_cache.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "nsasm/assembler.h"
+#include "nsasm/file.h"
+#include "nsasm/serialize.h"
+#include "test/test_sink.h"
+
+namespace nsasm {
+namespace {
+
+std::vector<File> MakeFiles() {
+  return {
+      MakeFakeFile("main.asm",
+                   ".module main\n"
+                   ".org $808000\n"
+                   ".entry m8x8\n"
+                   "entry:\n"
+                   "LDA #<consts::v\n"
+                   "{\n"
+                   "LDX #$04\n"
+                   "loop:\n"
+                   "DEX\n"
+                   "BNE loop\n"
+                   "}\n"
+                   "JSL $818000\n"
+                   "RTL\n"
+                   "table: .db 1, -2, <entry, >table\n"
+                   "size .equ consts::v * 2\n"),
+      MakeFakeFile("consts.asm",
+                   ".module consts\n"
+                   "v .equ (3 + 4) / 1\n"),
+  };
+}
+
+class ModuleCacheTest : public testing::Test {
+ protected:
+  void TearDown() override {
+    for (const File& file : written_) {
+      std::remove(ModuleCachePath(cache_dir_, ModuleCacheKey(file)).c_str());
+    }
+  }
+
+  // Assembles `files`, through the cache if `cached` is true.
+  ErrorOr<Assembler> Run(const std::vector<File>& files, bool cached,
+                         RecordingSink* sink) {
+    Assembler assembler;
+    if (cached) {
+      written_.insert(written_.end(), files.begin(), files.end());
+    }
+    NSASM_RETURN_IF_ERROR(
+        assembler.AddAsmFiles(files, nullptr, cached ? cache_dir_ : ""));
+    NSASM_RETURN_IF_ERROR(assembler.Assemble(sink));
+    return assembler;
+  }
+
+  const std::string cache_dir_ = testing::TempDir();
+  std::vector<File> written_;
+};
+
+TEST_F(ModuleCacheTest, WarmRunMatchesColdRun) {
+  const std::vector<File> files = MakeFiles();
+  RecordingSink uncached_sink;
+  auto uncached = Run(files, false, &uncached_sink);
+  NSASM_ASSERT_OK(uncached);
+  ASSERT_FALSE(uncached_sink.Bytes().empty());
+
+  RecordingSink cold_sink;
+  auto cold = Run(files, true, &cold_sink);
+  NSASM_ASSERT_OK(cold);
+  EXPECT_EQ(cold_sink.Bytes(), uncached_sink.Bytes());
+  auto cache_file =
+      ReadBinaryFile(ModuleCachePath(cache_dir_, ModuleCacheKey(files[0])));
+  ASSERT_TRUE(cache_file.ok());
+
+  RecordingSink warm_sink;
+  auto warm = Run(files, true, &warm_sink);
+  NSASM_ASSERT_OK(warm);
+  EXPECT_EQ(warm_sink.Bytes(), uncached_sink.Bytes());
+  EXPECT_EQ(warm->JumpTargets(), uncached->JumpTargets());
+  EXPECT_EQ(warm->NameForAddress(Address(0x808000)),
+            uncached->NameForAddress(Address(0x808000)));
+}
+
+TEST_F(ModuleCacheTest, LocationsUseCurrentPath) {
+  // This parses, so is cached, but fails during assembly.
+  const char kContents[] =
+      ".org $808000\n"
+      ".entry m8x8\n"
+      "RTL\n"
+      "NOP\n";
+  RecordingSink sink;
+  auto cold = Run({MakeFakeFile("first.asm", kContents)}, true, &sink);
+  ASSERT_FALSE(cold.ok());
+  EXPECT_THAT(cold.error().ToString(), testing::HasSubstr("first.asm:4"));
+
+  auto warm = Run({MakeFakeFile("second.asm", kContents)}, true, &sink);
+  ASSERT_FALSE(warm.ok());
+  EXPECT_THAT(warm.error().ToString(), testing::HasSubstr("second.asm:4"));
+}
+
+TEST_F(ModuleCacheTest, IgnoresCorruptCache) {
+  const std::vector<File> files = MakeFiles();
+  RecordingSink expected;
+  NSASM_ASSERT_OK(Run(files, true, &expected));
+
+  const std::string path =
+      ModuleCachePath(cache_dir_, ModuleCacheKey(files[0]));
+  auto data = ReadBinaryFile(path);
+  ASSERT_TRUE(data.ok());
+  data->resize(data->size() - 3);
+  ASSERT_TRUE(WriteBinaryFile(path, *data).ok());
+
+  RecordingSink sink;
+  NSASM_ASSERT_OK(Run(files, true, &sink));
+  EXPECT_EQ(sink.Bytes(), expected.Bytes());
+  // The corrupt file is replaced.
+  EXPECT_GT(ReadBinaryFile(path)->size(), data->size());
+}
+
+TEST(ModuleCacheKey, DependsOnContentsOnly) {
+  EXPECT_EQ(ModuleCacheKey(MakeFakeFile("a.asm", "NOP\nRTL\n")),
+            ModuleCacheKey(MakeFakeFile("b.asm", "NOP\nRTL\n")));
+  EXPECT_NE(ModuleCacheKey(MakeFakeFile("a.asm", "NOP\nRTL\n")),
+            ModuleCacheKey(MakeFakeFile("a.asm", "NOPRTL\n")));
+}
+
+}  // namespace
+}  // namespace nsasm
@@ -0,0 +1,161 @@
+#include "nsasm/module.h"
+
+#include <string>
+
+#include "absl/strings/str_format.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "nsasm/file.h"
+#include "nsasm/memory.h"
+#include "test/test_sink.h"
+
+namespace nsasm {
+namespace {
+
+ErrorOr<Module> FirstPass(std::string_view contents) {
+  auto module = Module::LoadAsmFile(MakeFakeFile("test.asm", contents));
+  NSASM_RETURN_IF_ERROR(module);
+  NSASM_RETURN_IF_ERROR(module->RunFirstPass());
+  return module;
+}
+
+TEST(Module, FirstPassMergesLoopStates) {
+  // The loop head is reached with the m flag both set and clear, so the size
+  // of the immediate argument can't be known.
+  auto module = FirstPass(
+      ".org $008000\n"
+      ".entry m8x8\n"
+      "loop:\n"
+      "LDA #$12\n"
+      "REP #$20\n"
+      "BNE loop\n"
+      "RTS\n");
+  ASSERT_FALSE(module.ok());
+  EXPECT_THAT(module.error().ToString(),
+              testing::HasSubstr("depends on `m` flag state"));
+}
+
+TEST(Module, FirstPassConverges) {
+  // X holds a different known value on every trip around the loop; merging
+  // states at the loop head makes it unknown after one trip.
+  auto module = FirstPass(
+      ".org $008000\n"
+      ".entry m8x8\n"
+      "LDX #$00\n"
+      "loop:\n"
+      "INX\n"
+      "CPX #$10\n"
+      "BNE loop\n"
+      "RTS\n");
+  NSASM_ASSERT_OK(module);
+  const Module::DataflowStats& stats = module->FirstPassStats();
+  EXPECT_EQ(stats.reachable_lines, 5);
+  EXPECT_EQ(stats.executions, 8);
+}
+
+TEST(Module, WideningKeepsUnchangedStackSlots) {
+  // Each back edge overwrites some of the bytes pushed before the loop, and
+  // each is reached before the one that overwrites a byte more, so the loop
+  // head's state changes often enough to be widened.  The flags pushed by PHP are the same on every trip, so PLP must
+  // still restore the m flag.
+  const int back_edges = kWideningThreshold + 2;
+  std::string contents = ".org $008000\n.entry m8x8\nLDA #$01\n";
+  for (int i = 0; i < back_edges; ++i) {
+    contents += "PHA\n";
+  }
+  contents +=
+      "loop:\n"
+      "PHP\n"
+      "REP #$20\n"
+      "LDA #$1234\n"
+      "PLP\n"
+      "LDA #$12\n"
+      "BCS done\n";
+  for (int i = 1; i <= back_edges; ++i) {
+    absl::StrAppendFormat(&contents, "path%d:\nBEQ path%d\n", i, i + 1);
+    for (int j = i; j <= back_edges; ++j) {
+      contents += "PLA\n";
+    }
+    absl::StrAppendFormat(&contents, "LDA #$%02x\n", 0x10 * i);
+    for (int j = i; j <= back_edges; ++j) {
+      contents += "PHA\n";
+    }
+    contents += "BRA loop\n";
+  }
+  absl::StrAppendFormat(&contents, "path%d:\ndone:\n", back_edges + 1);
+  for (int i = 0; i < back_edges; ++i) {
+    contents += "PLA\n";
+  }
+  contents += "RTS\n";
+
+  auto module = FirstPass(contents);
+  NSASM_ASSERT_OK(module);
+  EXPECT_GT(module->FirstPassStats().widenings, 0);
+}
+
+TEST(Module, FirstPassErrors) {
+  EXPECT_THAT(FirstPass(".org $008000\n.entry m8x8\nNOP\n").error().ToString(),
+              testing::HasSubstr("Execution continues past end of file"));
+  EXPECT_THAT(
+      FirstPass(".org $008000\n.entry m8x8\nBRA nowhere\n").error().ToString(),
+      testing::HasSubstr("Target for `bra nowhere` not found"));
+  EXPECT_THAT(
+      FirstPass(".org $008000\n.entry m8x8\nRTS\nNOP\n").error().ToString(),
+      testing::HasSubstr("Line not reached"));
+}
+
+// Binds the single external name `other::v` to a given slot.
+class FakeBindingContext : public BindingContext {
+ public:
+  explicit FakeBindingContext(const ValueSlot* slot) : slot_(slot) {}
+
+  const ValueSlot* Bind(const FullIdentifier& id) const override {
+    return id == FullIdentifier("other", "v") ? slot_ : nullptr;
+  }
+
+ private:
+  const ValueSlot* slot_;
+};
+
+TEST(Module, BoundNamesFollowScopes) {
+  auto module = FirstPass(
+      ".module test\n"
+      "v .equ 1\n"
+      "w .equ other::v + 1\n"
+      ".org $008000\n"
+      ".begin\n"
+      "v .equ 2\n"
+      ".db v, w, other::v\n"
+      ".end\n"
+      ".db v, test::v\n");
+  NSASM_ASSERT_OK(module);
+  ValueSlot other_v = LabelValue::FromInt(5);
+  module->Bind(FakeBindingContext(&other_v));
+
+  // Every name is bound, so nothing is looked up through the context.
+  NullLookupContext null_context;
+  NSASM_ASSERT_OK(module->RunSecondPass(null_context));
+  RecordingSink sink;
+  NSASM_ASSERT_OK(module->Assemble(&sink, null_context));
+  EXPECT_THAT(sink.Bytes(),
+              testing::ElementsAre(testing::Pair(Address(0x008000), 2),
+                                   testing::Pair(Address(0x008001), 6),
+                                   testing::Pair(Address(0x008002), 5),
+                                   testing::Pair(Address(0x008003), 1),
+                                   testing::Pair(Address(0x008004), 1)));
+
+  // Bound values are read when evaluated, not when bound.
+  other_v = LabelValue::FromInt(7);
+  NSASM_ASSERT_OK(module->RunSecondPass(null_context));
+  NSASM_ASSERT_OK(module->Assemble(&sink, null_context));
+  EXPECT_EQ(sink.Bytes().at(Address(0x008001)), 8);
+
+  other_v.reset();
+  auto result = module->RunSecondPass(null_context);
+  ASSERT_FALSE(result.ok());
+  EXPECT_THAT(result.error().ToString(),
+              testing::HasSubstr("Value 'other::v' accessed before definition"));
+}
+
+}  // namespace
+}  // namespace nsasm
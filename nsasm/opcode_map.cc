@@ -276,6 +276,62 @@ constexpr DecodeMapEntry decode_map[256] = {
     {M_sbc, A_dir_lx, F_65816},  // 0xff
 };
 
+constexpr OpcodeInfo MakeOpcodeInfo(uint8_t opcode, BitState m_bit,
+                                    BitState x_bit) {
+  const Mnemonic mnemonic = decode_map[opcode].mnemonic;
+  AddressingMode mode = decode_map[opcode].mode;
+  if (mode == A_imm_fm || mode == A_imm_fx) {
+    BitState narrow_register = (mode == A_imm_fm) ? m_bit : x_bit;
+    if (narrow_register == B_on) {
+      mode = A_imm_b;
+    } else if (narrow_register == B_off) {
+      mode = A_imm_w;
+    }
+  }
+  const int length = InstructionLength(mode);
+  NumericType operand_type = T_unknown;
+  if (mode == A_rel8) {
+    operand_type = T_signed_byte;
+  } else if (mode == A_rel16) {
+    operand_type = T_signed_word;
+  } else if (length == 2 || mode == A_mov) {
+    operand_type = T_byte;
+  } else if (length == 3) {
+    operand_type = T_word;
+  } else if (length == 4) {
+    operand_type = T_long;
+  }
+  const bool is_local_branch =
+      (mode == A_rel8 || mode == A_rel16) && mnemonic != M_per;
+  const bool is_exit = mnemonic == M_jmp || mnemonic == M_rtl ||
+                       mnemonic == M_rts || mnemonic == M_rti ||
+                       mnemonic == M_stp || mnemonic == M_bra ||
+                       mnemonic == M_brl;
+  return OpcodeInfo{mnemonic,     mode,           uint8_t(length),
+                    operand_type, is_local_branch, is_exit};
+}
+
+constexpr DecodeTable MakeDecodeTable(BitState m_bit, BitState x_bit) {
+  DecodeTable table = {};
+  for (int i = 0; i < 256; ++i) {
+    table[i] = MakeOpcodeInfo(i, m_bit, x_bit);
+  }
+  return table;
+}
+
+// Decode tables, indexed by FlagTableIndex(m_bit) * 3 + FlagTableIndex(x_bit).
+constexpr DecodeTable decode_tables[9] = {
+    MakeDecodeTable(B_on, B_on),       MakeDecodeTable(B_on, B_off),
+    MakeDecodeTable(B_on, B_unknown),  MakeDecodeTable(B_off, B_on),
+    MakeDecodeTable(B_off, B_off),     MakeDecodeTable(B_off, B_unknown),
+    MakeDecodeTable(B_unknown, B_on),  MakeDecodeTable(B_unknown, B_off),
+    MakeDecodeTable(B_unknown, B_unknown),
+};
+
+constexpr int FlagTableIndex(BitState bit) {
+  return (bit == B_on) ? 0 : (bit == B_off) ? 1 : 2;
+}
+
 absl::flat_hash_map<EncodeMapKey, uint8_t> MakeReverseOpcodeMap() {
   absl::flat_hash_map<EncodeMapKey, uint8_t> reverse;
   for (int i = 0; i < 256; ++i) {
@@ -317,6 +373,11 @@ std::pair<Mnemonic, AddressingMode> DecodeOpcode(uint8_t opcode) {
   return {decode_map[opcode].mnemonic, decode_map[opcode].mode};
 }
 
+const DecodeTable& DecodeTableFor(const StatusFlags& flags) {
+  return decode_tables[FlagTableIndex(flags.MBit()) * 3 +
+                       FlagTableIndex(flags.XBit())];
+}
+
 Family FamilyForOpcode(uint8_t opcode) { return decode_map[opcode].family; }
 
 absl::optional<std::uint8_t> EncodeOpcode(Mnemonic m, AddressingMode a) {
@@ -2,11 +2,14 @@
 #define NSASM_OPCODE_MAP_H_
 
 #include <algorithm>
+#include <array>
 #include <cstdint>
 
 #include "absl/types/optional.h"
 #include "nsasm/addressing_mode.h"
+#include "nsasm/execution_state.h"
 #include "nsasm/mnemonic.h"
+#include "nsasm/numeric_type.h"
 
 namespace nsasm {
 
@@ -19,6 +22,33 @@ enum Family {
 
 std::pair<Mnemonic, AddressingMode> DecodeOpcode(uint8_t opcode);
 
+// Everything needed to decode an opcode under a particular processor flag
+// state.
+struct OpcodeInfo {
+  Mnemonic mnemonic;
+  // The definite addressing mode.  This is only a flag-dependent sentinel mode
+  // if the controlling flag is unknown, in which case `length` is 0.
+  AddressingMode addressing_mode;
+  // Size of the instruction in bytes, including the opcode, or 0 if this
+  // opcode can't be decoded in this flag state.
+  uint8_t length;
+  // Type of the first operand, or T_unknown if there is none.  Relative branch
+  // offsets are signed.
+  NumericType operand_type;
+  // True for relative branches (but not PER, which merely takes an offset.)
+  bool is_local_branch;
+  // True if control never continues to the next instruction.  (This does not
+  // account for subroutine calls with exiting return conventions.)
+  bool is_exit;
+};
+
+using DecodeTable = std::array<OpcodeInfo, 256>;
+
+// Returns the table for decoding opcodes under the given flag state.  Only the
+// M and X bits are consulted; tables are precomputed for each combination of
+// on, off and unknown.
+const DecodeTable& DecodeTableFor(const StatusFlags& flags);
+
 Family FamilyForOpcode(uint8_t opcode);
 
 absl::optional<std::uint8_t> EncodeOpcode(Mnemonic m, AddressingMode a);
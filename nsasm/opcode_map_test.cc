@@ -2,6 +2,7 @@
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "nsasm/instruction.h"
 
 using ::testing::IsEmpty;
 
@@ -402,4 +403,48 @@ TEST(OpcodeMap, processor_family) {
   }
 }
 
+TEST(OpcodeMap, decode_tables) {
+  // Check the precomputed decode tables against DecodeOpcode() and the
+  // addressing mode helpers, for every M and X flag state.
+  for (BitState m_bit : {B_on, B_off, B_original, B_unknown}) {
+    for (BitState x_bit : {B_on, B_off, B_original, B_unknown}) {
+      const StatusFlags flags(B_off, m_bit, x_bit);
+      const DecodeTable& table = DecodeTableFor(flags);
+      for (int i = 0; i < 256; ++i) {
+        SCOPED_TRACE(i);
+        SCOPED_TRACE(flags.ToString());
+        const OpcodeInfo& info = table[i];
+        auto decoded = DecodeOpcode(i);
+        EXPECT_EQ(info.mnemonic, decoded.first);
+
+        AddressingMode expected_mode = decoded.second;
+        if (expected_mode == A_imm_fm || expected_mode == A_imm_fx) {
+          BitState bit = (expected_mode == A_imm_fm) ? m_bit : x_bit;
+          if (bit == B_on) {
+            expected_mode = A_imm_b;
+          } else if (bit == B_off) {
+            expected_mode = A_imm_w;
+          }
+        }
+        EXPECT_EQ(ToString(info.addressing_mode), ToString(expected_mode));
+        EXPECT_EQ(info.length, InstructionLength(expected_mode));
+
+        NumericType expected_type = Arg1Type(expected_mode);
+        if (expected_mode == A_rel8) {
+          expected_type = T_signed_byte;
+        } else if (expected_mode == A_rel16) {
+          expected_type = T_signed_word;
+        }
+        EXPECT_EQ(info.operand_type, expected_type);
+
+        Instruction instruction;
+        instruction.mnemonic = decoded.first;
+        instruction.addressing_mode = expected_mode;
+        EXPECT_EQ(info.is_local_branch, instruction.IsLocalBranch());
+        EXPECT_EQ(info.is_exit, instruction.IsExitInstruction());
+      }
+    }
+  }
+}
+
 }  // namespace nsasm
@@ -79,7 +79,7 @@ ErrorOr<StatusFlags> Mode(TokenSpan* pos) {
     return Error("Expected mode name, found %s", pos->front().ToString())
         .SetLocation(loc);
   }
-  std::string flag_name = *pos->front().Identifier();
+  const std::string& flag_name = pos->front().Identifier()->str();
   pos->remove_prefix(1);
   auto status_flags = StatusFlags::FromName(flag_name);
   if (!status_flags.has_value()) {
@@ -182,13 +182,13 @@ ErrorOr<ExpressionOrNull> Comp(TokenSpan* pos) {
                    pos->front().ToString())
           .SetLocation(Loc(pos));
     }
-    std::string s = *pos->front().Identifier();
+    Symbol s = *pos->front().Identifier();
     pos->remove_prefix(1);
     return {absl::make_unique<IdentifierExpression>(
-        FullIdentifier("", s), long_identifier ? T_long : T_word)};
+        FullIdentifier(Symbol(), s), long_identifier ? T_long : T_word)};
   }
   if (pos->front().Identifier()) {
-    std::string s1 = *pos->front().Identifier();
+    Symbol s1 = *pos->front().Identifier();
     pos->remove_prefix(1);
     if (pos->front() == P_scope) {
       pos->remove_prefix(1);
@@ -197,7 +197,7 @@ ErrorOr<ExpressionOrNull> Comp(TokenSpan* pos) {
                      pos->front().ToString())
             .SetLocation(Loc(pos));
       }
-      const std::string s2 = *pos->front().Identifier();
+      Symbol s2 = *pos->front().Identifier();
       pos->remove_prefix(1);
       return {absl::make_unique<IdentifierExpression>(
           FullIdentifier(s1, s2), long_identifier ? T_long : T_word)};
@@ -508,9 +508,9 @@ std::string ParsedLabel::ToString() const {
     return nsasm::ToString(plus_or_minus_);
   }
   if (exported_) {
-    return absl::StrCat("export ", name_);
+    return absl::StrCat("export ", name_.str());
   }
-  return name_;
+  return name_.str();
 }
 
 ErrorOr<std::vector<absl::variant<Statement, ParsedLabel>>> Parse(
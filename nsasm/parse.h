@@ -4,6 +4,7 @@
 #include "absl/types/variant.h"
 #include "nsasm/error.h"
 #include "nsasm/statement.h"
+#include "nsasm/symbol.h"
 #include "nsasm/token.h"
 
 namespace nsasm {
@@ -12,19 +13,19 @@ class ParsedLabel {
  public:
   ParsedLabel() {}
   ParsedLabel(nsasm::Punctuation p) : plus_or_minus_(p){};
-  ParsedLabel(std::string n, bool e) : name_(std::move(n)), exported_(e){};
+  ParsedLabel(Symbol n, bool e) : name_(n), exported_(e){};
 
   bool IsPlusOrMinus() const { return plus_or_minus_ != P_none; }
   bool IsIdentifier() const { return plus_or_minus_ == P_none; }
   bool IsExported() const { return exported_; }
   Punctuation PlusOrMinus() const { return plus_or_minus_; }
-  const std::string Identifier() const { return name_; }
+  Symbol Identifier() const { return name_; }
 
   std::string ToString() const;
 
  private:
   nsasm::Punctuation plus_or_minus_ = P_none;
-  std::string name_;
+  Symbol name_;
   bool exported_ = false;
 };
 
@@ -0,0 +1,210 @@
+#include "nsasm/patch.h"
+
+#include <algorithm>
+
+#include "nsasm/serialize.h"
+
+namespace nsasm {
+
+namespace {
+
+// IPS records hold a 24-bit offset and a 16-bit length.
+constexpr size_t kIpsMaxOffset = 0xffffff;
+constexpr size_t kIpsMaxRecordSize = 0xffff;
+// A record at this offset would be read back as the "EOF" marker.
+constexpr size_t kIpsEofOffset = 0x454f46;
+
+void WriteBytes(absl::Span<const uint8_t> data, ByteWriter* out) {
+  for (uint8_t byte : data) {
+    out->WriteU8(byte);
+  }
+}
+
+void WriteBigEndian(uint32_t value, int size, ByteWriter* out) {
+  for (int i = size - 1; i >= 0; --i) {
+    out->WriteU8(value >> (i * 8));
+  }
+}
+
+// Writes a BPS variable-length number.
+void WriteBpsNumber(uint64_t value, ByteWriter* out) {
+  while (true) {
+    uint8_t low_bits = value & 0x7f;
+    value >>= 7;
+    if (value == 0) {
+      out->WriteU8(0x80 | low_bits);
+      return;
+    }
+    out->WriteU8(low_bits);
+    --value;
+  }
+}
+
+enum BpsAction {
+  kSourceRead = 0,
+  kTargetRead = 1,
+};
+
+void WriteBpsAction(BpsAction action, size_t length, ByteWriter* out) {
+  WriteBpsNumber(((length - 1) << 2) | action, out);
+}
+
+}  // namespace
+
+ErrorOr<void> PatchWriter::Write(nsasm::Address address,
+                                 absl::Span<const std::uint8_t> data) {
+  // Nothing is recorded unless the whole write is valid.
+  auto runs =
+      rom_->AddressMap().ToRomRuns(address, data, rom_->Data().size());
+  NSASM_RETURN_IF_ERROR(runs);
+  for (const RomAddressMap::RomRun& run : *runs) {
+    AddRange(run.offset, run.data);
+  }
+  return {};
+}
+
+void PatchWriter::AddRange(size_t offset, absl::Span<const uint8_t> data) {
+  size_t begin = offset;
+  size_t end = offset + data.size();
+  // Find every existing range that overlaps or touches the new one.
+  auto first = ranges_.upper_bound(begin);
+  if (first != ranges_.begin()) {
+    auto previous = std::prev(first);
+    if (previous->first + previous->second.size() >= begin) {
+      first = previous;
+    }
+  }
+  auto last = first;
+  while (last != ranges_.end() && last->first <= end) {
+    begin = std::min(begin, last->first);
+    end = std::max(end, last->first + last->second.size());
+    ++last;
+  }
+  std::vector<uint8_t> merged(end - begin);
+  for (auto it = first; it != last; ++it) {
+    std::copy(it->second.begin(), it->second.end(),
+              merged.begin() + (it->first - begin));
+  }
+  std::copy(data.begin(), data.end(), merged.begin() + (offset - begin));
+  ranges_.erase(first, last);
+  ranges_.emplace(begin, std::move(merged));
+}
+
+std::map<size_t, std::vector<uint8_t>> PatchWriter::Changes() const {
+  absl::Span<const uint8_t> original = rom_->Data();
+  std::map<size_t, std::vector<uint8_t>> changes;
+  for (const auto& range : ranges_) {
+    const std::vector<uint8_t>& bytes = range.second;
+    size_t i = 0;
+    while (i < bytes.size()) {
+      if (bytes[i] == original[range.first + i]) {
+        ++i;
+        continue;
+      }
+      size_t run_end = i + 1;
+      while (run_end < bytes.size() &&
+             bytes[run_end] != original[range.first + run_end]) {
+        ++run_end;
+      }
+      changes.emplace(range.first + i, std::vector<uint8_t>(
+                                           bytes.begin() + i,
+                                           bytes.begin() + run_end));
+      i = run_end;
+    }
+  }
+  return changes;
+}
+
+ErrorOr<std::vector<uint8_t>> PatchWriter::IpsPatch() const {
+  absl::Span<const uint8_t> original = rom_->Data();
+  const size_t header_size = rom_->Header().size();
+  ByteWriter out;
+  WriteBytes({'P', 'A', 'T', 'C', 'H'}, &out);
+  for (const auto& change : Changes()) {
+    size_t offset = change.first;
+    absl::Span<const uint8_t> bytes = change.second;
+    // Move a record that would start at the EOF marker's offset back by one
+    // byte, repeating the unchanged byte before it.
+    std::vector<uint8_t> extended;
+    if (header_size + offset == kIpsEofOffset) {
+      --offset;
+      extended.push_back(original[offset]);
+      extended.insert(extended.end(), bytes.begin(), bytes.end());
+      bytes = extended;
+    }
+    while (!bytes.empty()) {
+      size_t size = std::min(bytes.size(), kIpsMaxRecordSize);
+      const size_t file_offset = header_size + offset;
+      if (size < bytes.size() && file_offset + size == kIpsEofOffset) {
+        // Don't let the next record start at the EOF marker's offset either.
+        --size;
+      }
+      if (file_offset > kIpsMaxOffset) {
+        return Error("Change at ROM offset 0x%06x is too far for IPS", offset);
+      }
+      WriteBigEndian(file_offset, 3, &out);
+      WriteBigEndian(size, 2, &out);
+      WriteBytes(bytes.subspan(0, size), &out);
+      offset += size;
+      bytes.remove_prefix(size);
+    }
+  }
+  WriteBytes({'E', 'O', 'F'}, &out);
+  return out.Data();
+}
+
+std::vector<uint8_t> PatchWriter::BpsPatch() const {
+  absl::Span<const uint8_t> original = rom_->Data();
+  absl::Span<const uint8_t> header = rom_->Header();
+  const size_t file_size = header.size() + original.size();
+  const uint32_t source_crc = Crc32(original, Crc32(header));
+
+  ByteWriter out;
+  WriteBytes({'B', 'P', 'S', '1'}, &out);
+  WriteBpsNumber(file_size, &out);  // source size
+  WriteBpsNumber(file_size, &out);  // target size
+  WriteBpsNumber(0, &out);          // metadata size
+
+  // The target is the source with the changed runs replaced.  Alternate
+  // between copying unchanged source bytes and inserting changed bytes,
+  // computing the target's checksum along the way.
+  uint32_t target_crc = Crc32(header);
+  size_t position = 0;
+  size_t unchanged = header.size();
+  for (const auto& change : Changes()) {
+    const std::vector<uint8_t>& bytes = change.second;
+    unchanged += change.first - position;
+    if (unchanged > 0) {
+      WriteBpsAction(kSourceRead, unchanged, &out);
+    }
+    target_crc = Crc32(original.subspan(position, change.first - position),
+                       target_crc);
+    WriteBpsAction(kTargetRead, bytes.size(), &out);
+    WriteBytes(bytes, &out);
+    target_crc = Crc32(bytes, target_crc);
+    position = change.first + bytes.size();
+    unchanged = 0;
+  }
+  unchanged += original.size() - position;
+  if (unchanged > 0) {
+    WriteBpsAction(kSourceRead, unchanged, &out);
+  }
+  target_crc = Crc32(original.subspan(position), target_crc);
+
+  out.WriteU32(source_crc);
+  out.WriteU32(target_crc);
+  out.WriteU32(Crc32(out.Data()));
+  return out.Data();
+}
+
+ErrorOr<void> PatchWriter::CreateIpsFile(const std::string& path) const {
+  auto patch = IpsPatch();
+  NSASM_RETURN_IF_ERROR(patch);
+  return WriteBinaryFile(path, *patch);
+}
+
+ErrorOr<void> PatchWriter::CreateBpsFile(const std::string& path) const {
+  return WriteBinaryFile(path, BpsPatch());
+}
+
+}  // namespace nsasm
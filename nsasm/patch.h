@@ -0,0 +1,57 @@
+#ifndef NSASM_PATCH_H_
+#define NSASM_PATCH_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "nsasm/error.h"
+#include "nsasm/memory.h"
+#include "nsasm/rom.h"
+
+namespace nsasm {
+
+// Sink for assembling a patch against an existing ROM file.
+//
+// Written bytes are recorded as ranges over the original ROM, which is never
+// copied or modified.  The result can be emitted as an IPS or BPS patch,
+// which holds only the bytes that actually changed.  Patch offsets are
+// relative to the ROM file as loaded, including any copier header.
+class PatchWriter : public OutputSink {
+ public:
+  PatchWriter(std::unique_ptr<Rom> rom) : rom_(std::move(rom)) {}
+
+  ErrorOr<void> Write(nsasm::Address address,
+                      absl::Span<const std::uint8_t> data) override;
+
+  // Returns the patch in IPS format.  Returns an error if a change lies past
+  // the 16MiB that IPS can address.
+  ErrorOr<std::vector<uint8_t>> IpsPatch() const;
+
+  // Returns the patch in BPS format, including the CRC-32 checksums of the
+  // source file, target file and patch.
+  std::vector<uint8_t> BpsPatch() const;
+
+  ErrorOr<void> CreateIpsFile(const std::string& path) const;
+  ErrorOr<void> CreateBpsFile(const std::string& path) const;
+
+ private:
+  // Records `data` as written at ROM offset `offset`, merging it with any
+  // overlapping or adjacent ranges.
+  void AddRange(size_t offset, absl::Span<const uint8_t> data);
+
+  // Returns the runs of bytes that differ from the original ROM, keyed by ROM
+  // offset.
+  std::map<size_t, std::vector<uint8_t>> Changes() const;
+
+  std::unique_ptr<Rom> rom_;
+  // Written data, keyed by ROM offset.  Ranges never overlap or touch.
+  std::map<size_t, std::vector<uint8_t>> ranges_;
+};
+
+}  // namespace nsasm
+
+#endif  // NSASM_PATCH_H_
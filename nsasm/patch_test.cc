@@ -0,0 +1,198 @@
+#include "nsasm/patch.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "nsasm/serialize.h"
+
+namespace nsasm {
+namespace {
+
+using testing::ElementsAre;
+
+std::vector<uint8_t> MakeRomData(size_t size = 0x10000) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = (i & 0xff) ^ (i >> 8);
+  }
+  return data;
+}
+
+std::unique_ptr<Rom> MakeHiRom(std::vector<uint8_t> header = {}) {
+  return std::make_unique<Rom>(kHiRom, "test.sfc", std::move(header),
+                               MakeRomData());
+}
+
+// Applies an IPS patch, as a patching tool would.
+std::vector<uint8_t> ApplyIps(std::vector<uint8_t> file,
+                              const std::vector<uint8_t>& patch) {
+  EXPECT_THAT(std::vector<uint8_t>(patch.begin(), patch.begin() + 5),
+              ElementsAre('P', 'A', 'T', 'C', 'H'));
+  size_t pos = 5;
+  while (true) {
+    size_t offset = (patch[pos] << 16) | (patch[pos + 1] << 8) | patch[pos + 2];
+    if (offset == 0x454f46) {
+      EXPECT_EQ(pos + 3, patch.size());
+      return file;
+    }
+    size_t size = (patch[pos + 3] << 8) | patch[pos + 4];
+    pos += 5;
+    EXPECT_GT(size, 0u);
+    EXPECT_LE(offset + size, file.size());
+    std::copy(patch.begin() + pos, patch.begin() + pos + size,
+              file.begin() + offset);
+    pos += size;
+  }
+}
+
+// Applies a BPS patch that uses only SourceRead and TargetRead actions,
+// checking all three checksums.
+std::vector<uint8_t> ApplyBps(const std::vector<uint8_t>& source,
+                              const std::vector<uint8_t>& patch) {
+  EXPECT_THAT(std::vector<uint8_t>(patch.begin(), patch.begin() + 4),
+              ElementsAre('B', 'P', 'S', '1'));
+  size_t pos = 4;
+  auto read_number = [&] {
+    uint64_t value = 0;
+    uint64_t shift = 1;
+    while (true) {
+      uint8_t byte = patch[pos++];
+      value += (byte & 0x7f) * shift;
+      if (byte & 0x80) {
+        return value;
+      }
+      shift <<= 7;
+      value += shift;
+    }
+  };
+  EXPECT_EQ(read_number(), source.size());
+  const uint64_t target_size = read_number();
+  EXPECT_EQ(read_number(), 0u);
+  std::vector<uint8_t> target;
+  const size_t footer = patch.size() - 12;
+  while (pos < footer) {
+    uint64_t action = read_number();
+    size_t length = (action >> 2) + 1;
+    if ((action & 3) == 0) {
+      size_t start = target.size();
+      target.insert(target.end(), source.begin() + start,
+                    source.begin() + start + length);
+    } else {
+      EXPECT_EQ(action & 3, 1u);
+      target.insert(target.end(), patch.begin() + pos,
+                    patch.begin() + pos + length);
+      pos += length;
+    }
+  }
+  EXPECT_EQ(pos, footer);
+  EXPECT_EQ(target.size(), target_size);
+  ByteReader checksums(absl::MakeConstSpan(patch).subspan(footer));
+  EXPECT_EQ(checksums.ReadU32(), Crc32(source));
+  EXPECT_EQ(checksums.ReadU32(), Crc32(target));
+  EXPECT_EQ(checksums.ReadU32(),
+            Crc32(absl::MakeConstSpan(patch).subspan(0, footer + 8)));
+  return target;
+}
+
+TEST(PatchWriter, RecordsOnlyChangedBytes) {
+  PatchWriter writer(MakeHiRom());
+  std::vector<uint8_t> expected = MakeRomData();
+  // Unchanged bytes are dropped, even inside a write.
+  std::vector<uint8_t> bytes = {0x10, 0x00, 0x00, 0x13};
+  NSASM_ASSERT_OK(writer.Write(Address(0xc01000), bytes));
+  expected[0x1001] = 0x00;
+  expected[0x1002] = 0x00;
+  // A write that wraps around the bank.
+  NSASM_ASSERT_OK(writer.Write(Address(0xc0ffff), {0xaa, 0xbb}));
+  expected[0xffff] = 0xaa;
+  expected[0x0000] = 0xbb;
+
+  auto ips = writer.IpsPatch();
+  NSASM_ASSERT_OK(ips);
+  EXPECT_THAT(*ips, ElementsAre('P', 'A', 'T', 'C', 'H',     //
+                                0x00, 0x00, 0x00, 0x00, 0x01,  //
+                                0xbb,                          //
+                                0x00, 0x10, 0x01, 0x00, 0x02,  //
+                                0x00, 0x00,                    //
+                                0x00, 0xff, 0xff, 0x00, 0x01,  //
+                                0xaa,                          //
+                                'E', 'O', 'F'));
+  EXPECT_EQ(ApplyIps(MakeRomData(), *ips), expected);
+  EXPECT_EQ(ApplyBps(MakeRomData(), writer.BpsPatch()), expected);
+}
+
+TEST(PatchWriter, LaterWritesWin) {
+  PatchWriter writer(MakeHiRom());
+  std::vector<uint8_t> expected = MakeRomData();
+  NSASM_ASSERT_OK(writer.Write(Address(0xc02000), {1, 2, 3, 4}));
+  NSASM_ASSERT_OK(writer.Write(Address(0xc02006), {7, 8}));
+  // Bridges and overlaps both earlier writes.
+  NSASM_ASSERT_OK(writer.Write(Address(0xc02002), {9, 9, 9, 9, 9}));
+  // Restores an original byte.
+  NSASM_ASSERT_OK(writer.Write(Address(0xc02003), {expected[0x2003]}));
+  const std::vector<uint8_t> written = {1, 2, 9, expected[0x2003], 9, 9, 9, 8};
+  std::copy(written.begin(), written.end(), expected.begin() + 0x2000);
+
+  auto ips = writer.IpsPatch();
+  NSASM_ASSERT_OK(ips);
+  EXPECT_EQ(ApplyIps(MakeRomData(), *ips), expected);
+  EXPECT_EQ(ApplyBps(MakeRomData(), writer.BpsPatch()), expected);
+}
+
+TEST(PatchWriter, EmptyPatch) {
+  PatchWriter writer(MakeHiRom());
+  NSASM_ASSERT_OK(writer.Write(Address(0xc01000), {0x10, 0x11}));
+  auto ips = writer.IpsPatch();
+  NSASM_ASSERT_OK(ips);
+  EXPECT_THAT(*ips, ElementsAre('P', 'A', 'T', 'C', 'H', 'E', 'O', 'F'));
+  EXPECT_EQ(ApplyBps(MakeRomData(), writer.BpsPatch()), MakeRomData());
+}
+
+TEST(PatchWriter, OffsetsIncludeCopierHeader) {
+  const std::vector<uint8_t> header(0x200, 0xee);
+  PatchWriter writer(MakeHiRom(header));
+  NSASM_ASSERT_OK(writer.Write(Address(0xc00010), {0xff}));
+
+  std::vector<uint8_t> source = header;
+  std::vector<uint8_t> data = MakeRomData();
+  source.insert(source.end(), data.begin(), data.end());
+  std::vector<uint8_t> expected = source;
+  expected[0x210] = 0xff;
+
+  auto ips = writer.IpsPatch();
+  NSASM_ASSERT_OK(ips);
+  EXPECT_EQ(ApplyIps(source, *ips), expected);
+  EXPECT_EQ(ApplyBps(source, writer.BpsPatch()), expected);
+}
+
+TEST(PatchWriter, AvoidsIpsEofOffset) {
+  PatchWriter writer(std::make_unique<Rom>(
+      kExHiRom, "test.sfc", std::vector<uint8_t>(), MakeRomData(0x460000)));
+  std::vector<uint8_t> expected = MakeRomData(0x460000);
+  NSASM_ASSERT_OK(writer.Write(Address(0x454f46), {0x00, 0x00}));
+  expected[0x454f46] = 0x00;
+  expected[0x454f47] = 0x00;
+
+  auto ips = writer.IpsPatch();
+  NSASM_ASSERT_OK(ips);
+  EXPECT_THAT(*ips, ElementsAre('P', 'A', 'T', 'C', 'H',     //
+                                0x45, 0x4f, 0x45, 0x00, 0x03,  //
+                                0x0a, 0x00, 0x00,              //
+                                'E', 'O', 'F'));
+  EXPECT_EQ(ApplyIps(MakeRomData(0x460000), *ips), expected);
+}
+
+TEST(PatchWriter, Errors) {
+  PatchWriter writer(MakeHiRom());
+  EXPECT_FALSE(writer.Write(Address(0xc10000), {1}).ok());
+  EXPECT_FALSE(writer.Write(Address(0x7e0000), {1}).ok());
+  // A write that fails partway records nothing.
+  EXPECT_FALSE(writer.Write(Address(0x00ffff), {0xaa, 0xbb}).ok());
+  auto ips = writer.IpsPatch();
+  NSASM_ASSERT_OK(ips);
+  EXPECT_THAT(*ips, ElementsAre('P', 'A', 'T', 'C', 'H', 'E', 'O', 'F'));
+}
+
+}  // namespace
+}  // namespace nsasm
@@ -1,66 +1,136 @@
 #include "nsasm/rom.h"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <memory>
+#include <tuple>
+#include <vector>
 
 #include "nsasm/error.h"
+#include "nsasm/serialize.h"
 
 namespace nsasm {
 
-ErrorOr<size_t> SnesToROMAddress(nsasm::Address snes_address, Mapping mapping) {
-  int bank_address = snes_address.BankAddress();
-  int bank = snes_address.Bank();
-  if (bank == 0x7e || bank == 0x7f) {
+RomAddressMap::RomAddressMap(Mapping mapping) {
+  for (int bank = 0; bank < 256; ++bank) {
+    BankMapping& entry = banks_[bank];
+    if (bank == 0x7e || bank == 0x7f) {
+      entry.flags = kWram;
+      entry.first_valid = 0x10000;
+      continue;
+    }
+    if ((bank >= 0x00 && bank < 0x40) || (bank >= 0x80 && bank < 0xc0)) {
+      entry.flags = kNonCartLowHalf;
+      entry.first_valid = 0x8000;
+    }
+    if (mapping == kLoRom) {
+      entry.first_valid = 0x8000;
+      entry.mask = 0x7fff;
+      entry.base = (bank & 0x7f) << 15;
+    } else if (mapping == kHiRom) {
+      entry.base = (bank & 0x3f) << 16;
+    } else if (mapping == kExHiRom) {
+      entry.base = (bank & 0x3f) << 16;
+      // address bit 23 is inverted and used as bit 22 of the CART address
+      if ((bank & 0x80) == 0) {
+        entry.base |= 0x400000;
+      }
+    }
+  }
+}
+
+Error RomAddressMap::MappingError(nsasm::Address snes_address) const {
+  const BankMapping& bank = banks_[snes_address.Bank()];
+  if (bank.flags & kWram) {
     return Error("Address in WRAM").SetLocation(snes_address);
   }
-  if (bank_address < 0x8000 &&
-      ((bank >= 0x00 && bank < 0x40) || (bank >= 0x80 && bank < 0xc0))) {
+  if (bank.flags & kNonCartLowHalf) {
     return Error("Address in non-CART memory").SetLocation(snes_address);
   }
-  if (mapping == kLoRom) {
-    if (bank_address < 0x8000) {
-      return Error("Invalid LoRom ROM address").SetLocation(snes_address);
-    };
-    return (bank_address & 0x7fff) | ((bank & 0x7f) << 15);
-  } else if (mapping == kHiRom) {
-    return bank_address | ((bank & 0x3f) << 16);
-  } else if (mapping == kExHiRom) {
-    int result = bank_address | ((bank & 0x3f) << 16);
-    // address bit 23 is inverted and used as bit 22 of the CART address
-    if ((result & 0x800000) == 0) {
-      result |= 0x400000;
+  return Error("Invalid LoRom ROM address").SetLocation(snes_address);
+}
+
+ErrorOr<RomAddressMap::RomRuns> RomAddressMap::ToRomRuns(
+    nsasm::Address address, absl::Span<const uint8_t> data,
+    size_t rom_size) const {
+  RomRuns runs;
+  if (data.empty()) {
+    return runs;
+  }
+  auto first_index = ToRomOffset(address);
+  auto last_index = ToRomOffset(address.AddWrapped(data.size() - 1));
+  if (first_index.ok() && last_index.ok() && *last_index >= *first_index &&
+      *last_index - *first_index == data.size() - 1 && *last_index < rom_size) {
+    // The write lands in a single contiguous run of ROM.
+    runs.push_back({*first_index, data});
+    return runs;
+  }
+  // Otherwise translate byte by byte, which also finds the offending address
+  // if the write is invalid.
+  size_t run_start = 0;
+  size_t run_offset = 0;
+  for (size_t i = 0; i < data.size(); ++i) {
+    auto rom_index = ToRomOffset(address.AddWrapped(i));
+    NSASM_RETURN_IF_ERROR(rom_index);
+    if (*rom_index >= rom_size) {
+      return Error("Attempt to write at %s, past end of file",
+                   address.AddWrapped(i).ToString());
+    }
+    if (i == 0 || *rom_index != run_offset + (i - run_start)) {
+      if (i > 0) {
+        runs.push_back({run_offset, data.subspan(run_start, i - run_start)});
+      }
+      run_start = i;
+      run_offset = *rom_index;
     }
-    return result;
   }
-  return Error("LOGIC ERROR: Mapping mode %d unknown", mapping);
+  runs.push_back({run_offset, data.subspan(run_start)});
+  return runs;
+}
+
+ErrorOr<size_t> SnesToROMAddress(nsasm::Address snes_address, Mapping mapping) {
+  static const auto* maps = new std::array<RomAddressMap, 3>{
+      RomAddressMap(kLoRom), RomAddressMap(kHiRom), RomAddressMap(kExHiRom)};
+  if (mapping < kLoRom || mapping > kExHiRom) {
+    return Error("LOGIC ERROR: Mapping mode %d unknown", mapping);
+  }
+  return (*maps)[mapping].ToRomOffset(snes_address);
 }
 
 ErrorOr<std::vector<uint8_t>> Rom::Read(nsasm::Address address,
                                         int length) const {
+  auto view = ReadView(address, length);
+  NSASM_RETURN_IF_ERROR(view);
+  return std::vector<uint8_t>(view->begin(), view->end());
+}
+
+ErrorOr<ByteView> Rom::ReadView(nsasm::Address address, int length) const {
   if (length == 0) {
-    return std::vector<uint8_t>();
+    return ByteView();
   }
   if (length < 0) {
     return Error("LOGIC ERROR: Negative read size %d", length);
   }
-  auto first_address = SnesToROMAddress(address, mapping_mode_);
+  auto first_address = address_map_.ToRomOffset(address);
   auto last_address =
-      SnesToROMAddress(address.AddWrapped(length - 1), mapping_mode_);
+      address_map_.ToRomOffset(address.AddWrapped(length - 1));
   NSASM_RETURN_IF_ERROR_WITH_LOCATION(first_address, path_);
   NSASM_RETURN_IF_ERROR_WITH_LOCATION(last_address, path_);
-  if (*last_address > *first_address) {
+  if (*last_address >= *first_address &&
+      *last_address - *first_address == size_t(length - 1)) {
     // Normal read -- does not wrap around a bank.  This is by far the common
     // case.
     if (*last_address >= data_.size()) {
       return Error("Address past end of ROM")
           .SetLocation(path_, *first_address);
     }
-    return std::vector<uint8_t>(data_.begin() + *first_address,
-                                data_.begin() + *last_address + 1);
+    return ByteView(absl::MakeConstSpan(&data_[*first_address], length));
   } else {
     // Read wraps around a bank.  Just do this by hand.
-    std::vector<uint8_t> result;
+    absl::InlinedVector<uint8_t, 4> result;
     for (int i = 0; i < length; ++i) {
-      auto rom_address = SnesToROMAddress(address.AddWrapped(i), mapping_mode_);
+      auto rom_address = address_map_.ToRomOffset(address.AddWrapped(i));
       NSASM_RETURN_IF_ERROR_WITH_LOCATION(rom_address, path_);
       if (*rom_address >= data_.size()) {
         return Error("Address past end of ROM")
@@ -68,8 +138,30 @@ ErrorOr<std::vector<uint8_t>> Rom::Read(nsasm::Address address,
       }
       result.push_back(data_[*rom_address]);
     }
-    return result;
+    return ByteView(std::move(result));
+  }
+}
+
+std::unique_ptr<Rom> Rom::Clone() const {
+  return std::make_unique<Rom>(
+      mapping_mode_, path_, std::vector<uint8_t>(header_.begin(), header_.end()),
+      std::vector<uint8_t>(data_.begin(), data_.end()));
+}
+
+absl::Span<uint8_t> Rom::MutableData() {
+  if (file_) {
+    auto data = file_->MutableData();
+    if (data.ok()) {
+      return data->subspan(header_.size());
+    }
+    // The mapping couldn't be made writable, so fall back to a copy.
+    owned_header_.assign(header_.begin(), header_.end());
+    owned_data_.assign(data_.begin(), data_.end());
+    header_ = owned_header_;
+    data_ = owned_data_;
+    file_.reset();
   }
+  return absl::MakeSpan(owned_data_);
 }
 
 namespace {
@@ -77,7 +169,7 @@ namespace {
 // Returns true if, heuristically, this looks like a SNES header.
 //
 // TODO: This is realy poor.
-bool CheckSnesHeader(const std::vector<uint8_t>& header) {
+bool CheckSnesHeader(absl::Span<const uint8_t> header) {
   bool checksum_ok = (header[0x2c] ^ header[0x2e]) == 0xff &&
                      (header[0x2d] ^ header[0x2f]) == 0xff;
   return checksum_ok;
@@ -86,124 +178,193 @@ bool CheckSnesHeader(const std::vector<uint8_t>& header) {
 }  // namespace
 
 ErrorOr<std::unique_ptr<Rom>> LoadRomFile(const std::string& path) {
-  // TODO: RAII this file handle
-  FILE* f = fopen(path.c_str(), "rb");
-  if (!f) {
-    return Error("Failed to open file").SetLocation(path);
-  }
-  if (fseek(f, 0, SEEK_END) != 0) {
-    fclose(f);
-    return Error("Failed to read file").SetLocation(path);
-  }
-  int file_size = ftell(f);
-  if (file_size <= 0) {
-    fclose(f);
-    return Error("Failed to read file").SetLocation(path);
-  }
+  auto file = MappedFile::Open(path);
+  NSASM_RETURN_IF_ERROR(file);
+  const size_t file_size = (*file)->Data().size();
   // A SNES rom is in 0x1000-byte page chunks.  SNES ROM files usually contain a
   // 0x0200-byte header in addition to this.  If neither of these is consistent,
   // the ROM is corrupt.
   if (file_size % 0x1000 != 0 && file_size % 0x1000 != 0x200) {
-    fclose(f);
     return Error("File is not an SNES ROM").SetLocation(path);
   }
-  // Seek to the beginning of the file (skipping the SMC header if present).
-  std::vector<uint8_t> header;
-  if (fseek(f, 0, SEEK_SET) != 0) {
-    fclose(f);
-    return Error("Failed to read file").SetLocation(path);
-  }
-  if (file_size % 0x1000 == 0x200) {
-    header.resize(0x200);
-    int bytes_read = fread(&header[0], 1, 0x200, f);
-    if (bytes_read != 0x200) {
-      return Error("Failed to read file").SetLocation(path);
-    }
-    file_size -= 0x200;
-  }
-  std::vector<uint8_t> data;
-  data.resize(file_size);
-  int bytes_read = fread(&data[0], 1, file_size, f);
-  fclose(f);
-  if (bytes_read != file_size || file_size < 0x10000) {
+  // Skip the SMC header if present.
+  const size_t header_size = file_size % 0x1000;
+  absl::Span<const uint8_t> data = (*file)->Data().subspan(header_size);
+  if (data.size() < 0x10000) {
     return Error("Failed to read file e").SetLocation(path);
   }
 
-  bool maybe_lorom = CheckSnesHeader(
-      std::vector<uint8_t>(data.begin() + 0x7fb0, data.begin() + 0x7fe0));
-  bool maybe_hirom = CheckSnesHeader(
-      std::vector<uint8_t>(data.begin() + 0xffb0, data.begin() + 0xffe0));
+  bool maybe_lorom = CheckSnesHeader(data.subspan(0x7fb0, 0x30));
+  bool maybe_hirom = CheckSnesHeader(data.subspan(0xffb0, 0x30));
   if (maybe_lorom == maybe_hirom) {
     return Error("Failed to auto-detect ROM type").SetLocation(path);
   }
+  Mapping mapping;
   if (maybe_lorom) {
-    return std::make_unique<Rom>(kLoRom, path, std::move(header),
-                                 std::move(data));
-  } else if (file_size < 0x400000) {
-    return std::make_unique<Rom>(kHiRom, path, std::move(header),
-                                 std::move(data));
+    mapping = kLoRom;
+  } else if (data.size() < 0x400000) {
+    mapping = kHiRom;
   } else {
-    return std::make_unique<Rom>(kExHiRom, path, std::move(header),
-                                 std::move(data));
+    mapping = kExHiRom;
   }
+  return std::make_unique<Rom>(mapping, path, std::move(*file), header_size);
 }
 
 ErrorOr<void> RomIdentityTest::Write(nsasm::Address address,
                                      absl::Span<const std::uint8_t> data) {
-  auto actual = rom_->Read(address, data.size());
+  auto actual = rom_->ReadView(address, data.size());
   NSASM_RETURN_IF_ERROR(actual);
 
-  if (*actual == data) {
+  absl::Span<const uint8_t> expected = actual->span();
+  if (data.empty() ||
+      std::memcmp(data.data(), expected.data(), data.size()) == 0) {
     return {};
   }
 
-  for (size_t i = 0; i < data.size(); ++i) {
-    if (data[i] != (*actual)[i]) {
+  auto data_it = data.begin();
+  auto expected_it = expected.begin();
+  while (true) {
+    std::tie(data_it, expected_it) =
+        std::mismatch(data_it, data.end(), expected_it);
+    if (data_it == data.end()) {
+      return {};
+    }
+    const size_t i = data_it - data.begin();
+    if (mode_ == kStopAtFirstMismatch) {
       return Error("Wrote 0x%02x to %s, expected 0x%02x", data[i],
-                   address.AddWrapped(i).ToString(), (*actual)[i]);
+                   address.AddWrapped(i).ToString(), expected[i]);
+    }
+    size_t run_end = i + 1;
+    while (run_end < data.size() && data[run_end] != expected[run_end]) {
+      ++run_end;
     }
+    const nsasm::Address run_address = address.AddWrapped(i);
+    Mismatch* mismatch = nullptr;
+    if (!mismatches_.empty()) {
+      // Extend the previous mismatch if this run directly follows it.
+      Mismatch& last = mismatches_.back();
+      if (last.address.AddWrapped(last.written.size()) == run_address) {
+        mismatch = &last;
+      }
+    }
+    if (!mismatch) {
+      mismatch = &mismatches_.emplace_back();
+      mismatch->address = run_address;
+    }
+    mismatch->written.insert(mismatch->written.end(), data.begin() + i,
+                             data.begin() + run_end);
+    mismatch->expected.insert(mismatch->expected.end(),
+                              expected.begin() + i,
+                              expected.begin() + run_end);
+    data_it = data.begin() + run_end;
+    expected_it = expected.begin() + run_end;
   }
+}
 
-  return Error("logic error: comparisons inconsistent??");
+namespace {
+
+// Returns the largest power of two no greater than `value`, which must be
+// nonzero.
+size_t HighestBit(size_t value) {
+  size_t bit = 1;
+  while (value >> 1 >= bit) {
+    bit <<= 1;
+  }
+  return bit;
 }
 
-ErrorOr<void> RomOverwriter::Write(Address address,
-                                   absl::Span<const std::uint8_t> data) {
-  // just dumbly write; this could be made more efficient, but for now
-  // this whole output scheme is meh
-  for (size_t i = 0; i < data.size(); ++i) {
-    auto rom_index =
-        SnesToROMAddress(address.AddWrapped(i), rom_->mapping_mode_);
-    NSASM_RETURN_IF_ERROR(rom_index);
-    if (*rom_index > data_.size()) {
-      return Error("Attempt to write at %s, past end of file",
-                   address.AddWrapped(i).ToString());
+}  // namespace
+
+RomOverwriter::RomOverwriter(std::unique_ptr<Rom> rom)
+    : rom_(std::move(rom)), data_(rom_->MutableData()) {
+  // Split the ROM into power-of-two segments, largest first.  Each segment
+  // after the first is mirrored, along with everything after it, to be as
+  // large as the segment before it.
+  size_t start = 0;
+  size_t length = data_.size();
+  uint32_t weight = 1;
+  while (length > 0) {
+    const size_t segment_size = HighestBit(length);
+    checksum_segments_.push_back({start, start + segment_size, weight});
+    start += segment_size;
+    length -= segment_size;
+    if (length > 0) {
+      const size_t rest_size = HighestBit(length);
+      const size_t mirrored_size =
+          (length == rest_size) ? rest_size : rest_size * 2;
+      weight *= segment_size / mirrored_size;
     }
-    data_[*rom_index] = data[i];
   }
-  return {};
-}
+  for (const ChecksumSegment& segment : checksum_segments_) {
+    uint32_t sum = 0;
+    for (size_t i = segment.begin; i < segment.end; ++i) {
+      sum += data_[i];
+    }
+    checksum_sum_ += sum * segment.weight;
+  }
 
-ErrorOr<void> RomOverwriter::CreateFile(const std::string& path) const {
-  // TODO: RAII this file handle
-  FILE* f = fopen(path.c_str(), "wb");
-  if (!f) {
-    return Error("Failed to open file for write").SetLocation(path);
+  // The header's checksum fields are at $00:FFDC in every mapping mode.
+  auto header_offset = rom_->AddressMap().ToRomOffset(Address(0x00ffdc));
+  if (header_offset.ok() && *header_offset + 4 <= data_.size()) {
+    checksum_offset_ = *header_offset;
   }
-  if (!rom_->header_.empty()) {
-    size_t written = fwrite(&rom_->header_[0], 1, 0x200, f);
-    if (written != 0x200) {
-      return Error("Failed to write header").SetLocation(path);
+}
+
+uint32_t RomOverwriter::ChecksumWeight(size_t index) const {
+  for (const ChecksumSegment& segment : checksum_segments_) {
+    if (index < segment.end) {
+      return segment.weight;
     }
   }
-  size_t written = fwrite(&data_[0], 1, data_.size(), f);
-  if (written != data_.size()) {
-    return Error("Failed to write payload").SetLocation(path);
+  return 0;
+}
+
+void RomOverwriter::WriteByte(size_t index, uint8_t value) {
+  checksum_sum_ += ChecksumWeight(index) * (value - data_[index]);
+  data_[index] = value;
+}
+
+absl::optional<uint16_t> RomOverwriter::Checksum() const {
+  if (!checksum_offset_) {
+    return absl::nullopt;
+  }
+  // A checksum and its complement always sum to $1fe, so count that in place
+  // of whatever the fields hold now.
+  uint16_t sum = checksum_sum_;
+  for (size_t i = *checksum_offset_; i < *checksum_offset_ + 4; ++i) {
+    sum -= ChecksumWeight(i) * data_[i];
   }
-  if (fclose(f) != 0) {
-    return Error("Failed to close file").SetLocation(path);
+  sum += ChecksumWeight(*checksum_offset_) * 0x1fe;
+  return sum;
+}
+
+ErrorOr<void> RomOverwriter::Write(Address address,
+                                   absl::Span<const std::uint8_t> data) {
+  auto runs = rom_->address_map_.ToRomRuns(address, data, data_.size());
+  NSASM_RETURN_IF_ERROR(runs);
+  for (const RomAddressMap::RomRun& run : *runs) {
+    for (size_t i = 0; i < run.data.size(); ++i) {
+      WriteByte(run.offset + i, run.data[i]);
+    }
   }
   return {};
 }
 
+ErrorOr<void> RomOverwriter::CreateFile(const std::string& path) const {
+  // Write the header, then the payload with the checksum fields replaced.
+  // WriteBinaryFilePieces() renames a temporary file into place, which matters
+  // since `path` may be the file that the ROM is still mapped from.
+  std::vector<absl::Span<const uint8_t>> pieces = {rom_->header_, data_};
+  std::array<uint8_t, 4> checksum_fields;
+  if (auto checksum = Checksum()) {
+    const uint16_t complement = ~*checksum;
+    checksum_fields = {uint8_t(complement & 0xff), uint8_t(complement >> 8),
+                       uint8_t(*checksum & 0xff), uint8_t(*checksum >> 8)};
+    absl::Span<const uint8_t> data = data_;
+    pieces = {rom_->header_, data.subspan(0, *checksum_offset_),
+              checksum_fields, data.subspan(*checksum_offset_ + 4)};
+  }
+  return WriteBinaryFilePieces(path, pieces);
+}
+
 }  // namespace nsasm
@@ -1,11 +1,17 @@
 #ifndef NSASM_ROM_H_
 #define NSASM_ROM_H_
 
+#include <array>
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
+#include "absl/container/inlined_vector.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "nsasm/error.h"
+#include "nsasm/mapped_file.h"
 #include "nsasm/memory.h"
 
 namespace nsasm {
@@ -26,6 +32,58 @@ enum Mapping {
 // intercepted by the SNES (for work ram or memory-mapped registers, say.)
 ErrorOr<size_t> SnesToROMAddress(nsasm::Address snes_address, Mapping mapping);
 
+// Precomputed translation from the SNES address space to cartridge ROM offsets
+// for a single mapping mode.  Each of the 256 banks gets an entry holding the
+// lowest bank address that maps to ROM, a mask and a base offset, so that
+// translating an address is a table lookup plus an add.
+class RomAddressMap {
+ public:
+  explicit RomAddressMap(Mapping mapping);
+
+  // As SnesToROMAddress(), for the mapping this table was built for.
+  ErrorOr<size_t> ToRomOffset(nsasm::Address snes_address) const {
+    const BankMapping& bank = banks_[snes_address.Bank()];
+    const uint32_t bank_address = snes_address.BankAddress();
+    if (bank_address < bank.first_valid) {
+      return MappingError(snes_address);
+    }
+    return bank.base + (bank_address & bank.mask);
+  }
+
+  // Part of a write that lands in consecutive bytes of ROM.
+  struct RomRun {
+    size_t offset;
+    absl::Span<const uint8_t> data;
+  };
+  using RomRuns = absl::InlinedVector<RomRun, 1>;
+
+  // Translates a write of `data` at `address` into runs of consecutive ROM
+  // offsets, for a ROM of `rom_size` bytes.  Fails if any byte of the write
+  // falls outside of the ROM.
+  ErrorOr<RomRuns> ToRomRuns(nsasm::Address address,
+                             absl::Span<const uint8_t> data,
+                             size_t rom_size) const;
+
+ private:
+  enum BankFlags : uint8_t {
+    // The entire bank is work RAM.
+    kWram = 1,
+    // The low half of the bank is intercepted by the SNES (low RAM, MMIO).
+    kNonCartLowHalf = 2,
+  };
+
+  struct BankMapping {
+    uint32_t base = 0;
+    uint32_t first_valid = 0;
+    uint16_t mask = 0xffff;
+    uint8_t flags = 0;
+  };
+
+  Error MappingError(nsasm::Address snes_address) const;
+
+  std::array<BankMapping, 256> banks_;
+};
+
 class RomOverwriter;
 
 // Representation of a SNES ROM, presumably loaded from disk.
@@ -34,9 +92,27 @@ class Rom : public InputSource {
   Rom(Mapping mapping_mode, std::string path, std::vector<uint8_t> header,
       std::vector<uint8_t> data)
       : mapping_mode_(mapping_mode),
+        address_map_(mapping_mode),
+        path_(std::move(path)),
+        owned_header_(std::move(header)),
+        owned_data_(std::move(data)),
+        header_(owned_header_),
+        data_(owned_data_) {}
+
+  // Constructs a ROM backed by a mapped file.  The first `header_size` bytes
+  // of the file are a copier header.
+  Rom(Mapping mapping_mode, std::string path, std::unique_ptr<MappedFile> file,
+      size_t header_size)
+      : mapping_mode_(mapping_mode),
+        address_map_(mapping_mode),
         path_(std::move(path)),
-        header_(std::move(header)),
-        data_(std::move(data)) {}
+        file_(std::move(file)),
+        header_(file_->Data().subspan(0, header_size)),
+        data_(file_->Data().subspan(header_size)) {}
+
+  // Spans into owned storage would dangle in a copy.
+  Rom(const Rom&) = delete;
+  Rom& operator=(const Rom&) = delete;
 
   // Returns `length` bytes of program data, starting at `address`, incrementing
   // addresses with the same logic as `AddToPC()` above.
@@ -45,46 +121,133 @@ class Rom : public InputSource {
   ErrorOr<std::vector<uint8_t>> Read(nsasm::Address address,
                                      int length) const override;
 
+  // As above, but returns a view directly into the ROM data unless the read
+  // wraps around a bank.
+  ErrorOr<ByteView> ReadView(nsasm::Address address,
+                             int length) const override;
+
   std::string Path() const override { return path_; }
 
+  // The contents of the ROM, without any copier header.
+  absl::Span<const uint8_t> Data() const { return data_; }
+
+  // The copier header from the ROM file, or an empty span if there was none.
+  absl::Span<const uint8_t> Header() const { return header_; }
+
+  const RomAddressMap& AddressMap() const { return address_map_; }
+
+  // Returns a copy of this ROM that owns its data, and so is unaffected by
+  // later changes to the file this ROM was loaded from.
+  std::unique_ptr<Rom> Clone() const;
+
  private:
   friend class RomOverwriter;
+
+  // Returns a writable view of the ROM data, for RomOverwriter to assemble
+  // into.  A mapped ROM only copies the pages that are then written.
+  absl::Span<uint8_t> MutableData();
+
   Mapping mapping_mode_;
+  RomAddressMap address_map_;
   std::string path_;
-  std::vector<uint8_t> header_;
-  std::vector<uint8_t> data_;
+
+  // Exactly one of these backs header_ and data_: the owned vectors, or
+  // file_ if it is set.
+  std::vector<uint8_t> owned_header_;
+  std::vector<uint8_t> owned_data_;
+  std::unique_ptr<MappedFile> file_;
+
+  absl::Span<const uint8_t> header_;
+  absl::Span<const uint8_t> data_;
 };
 
+// Loads the ROM file at `path`, detecting its mapping mode from its SNES
+// header.  The file is mapped into memory rather than read.
 ErrorOr<std::unique_ptr<Rom>> LoadRomFile(const std::string& path);
 
 // Wraps a SNES ROM and acts as an output sink.  Returns an error if any data
 // written does not match what already exists in a ROM.  This is intended for
 // testing and disassembly validation purposes.
+//
+// Writes are compared directly against the ROM's data without copying.
 class RomIdentityTest : public OutputSink {
  public:
-  RomIdentityTest(std::unique_ptr<Rom> rom) : rom_(std::move(rom)) {}
+  enum Mode {
+    // Fail the first write that doesn't match the ROM.
+    kStopAtFirstMismatch,
+    // Accept writes that don't match the ROM, and record every mismatching
+    // range instead, so that a whole assembly can be checked in one run.
+    kCollectMismatches,
+  };
+
+  // A run of written bytes that differ from the ROM.
+  struct Mismatch {
+    nsasm::Address address;
+    std::vector<uint8_t> written;
+    std::vector<uint8_t> expected;
+  };
+
+  RomIdentityTest(std::unique_ptr<Rom> rom, Mode mode = kStopAtFirstMismatch)
+      : rom_(std::move(rom)), mode_(mode) {}
 
   ErrorOr<void> Write(nsasm::Address address,
                       absl::Span<const std::uint8_t> data) override;
 
+  // The mismatches found so far, in the order they were written.  Always
+  // empty in kStopAtFirstMismatch mode.
+  const std::vector<Mismatch>& Mismatches() const { return mismatches_; }
+
  private:
   std::unique_ptr<Rom> rom_;
+  Mode mode_;
+  std::vector<Mismatch> mismatches_;
 };
 
 // Sink for assembling data over an existing ROM file.
+//
+// The SNES header checksum is kept up to date as data is written, and
+// CreateFile() writes it and its complement into the header.
 class RomOverwriter : public OutputSink {
  public:
-  RomOverwriter(std::unique_ptr<Rom> rom)
-      : rom_(std::move(rom)), data_(rom->data_) {}
+  // Assembles directly over `rom`'s data, which is not copied.
+  RomOverwriter(std::unique_ptr<Rom> rom);
 
   ErrorOr<void> Write(nsasm::Address address,
                       absl::Span<const std::uint8_t> data) override;
 
   ErrorOr<void> CreateFile(const std::string& path) const;
 
+  // Returns the header checksum for the current ROM contents: the 16-bit sum
+  // of its bytes, with the trailing part of a ROM whose size is not a power of
+  // two counted as if mirrored to fill a power of two.  The checksum and
+  // complement fields are counted as if they were already correct.
+  //
+  // Returns nullopt if the ROM is too small to hold a header.
+  absl::optional<uint16_t> Checksum() const;
+
  private:
+  // A range of ROM offsets, and how many times each byte in it is counted in
+  // the checksum.
+  struct ChecksumSegment {
+    size_t begin;
+    size_t end;
+    uint32_t weight;
+  };
+
+  // Returns the weight of the byte at `index` in the checksum.
+  uint32_t ChecksumWeight(size_t index) const;
+
+  // Writes a single byte, updating the running checksum.
+  void WriteByte(size_t index, uint8_t value);
+
   std::unique_ptr<Rom> rom_;
-  std::vector<uint8_t> data_;
+  absl::Span<uint8_t> data_;
+
+  std::vector<ChecksumSegment> checksum_segments_;
+  // Offset of the header's checksum complement, followed by the checksum.
+  absl::optional<size_t> checksum_offset_;
+  // Weighted sum of all bytes in data_, modulo 2^16.
+  uint16_t checksum_sum_ = 0;
 };
 
 }  // namespace nsasm
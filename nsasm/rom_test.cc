@@ -0,0 +1,349 @@
+#include "nsasm/rom.h"
+
+#include <cstdio>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "nsasm/serialize.h"
+
+namespace nsasm {
+namespace {
+
+using testing::ElementsAre;
+
+// Returns a 64KiB HiRom image where every byte holds the low byte of its own
+// ROM offset plus its bank.
+std::unique_ptr<Rom> MakeHiRom() {
+  std::vector<uint8_t> data(0x10000);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = (i & 0xff) ^ (i >> 8);
+  }
+  return std::make_unique<Rom>(kHiRom, "test.sfc", std::vector<uint8_t>(),
+                               std::move(data));
+}
+
+TEST(Rom, ReadViewMatchesRead) {
+  auto rom = MakeHiRom();
+  for (int address : {0xc00000, 0xc01234, 0xc0fffc, 0xc0fffe, 0xc0ffff}) {
+    for (int length : {0, 1, 2, 4}) {
+      SCOPED_TRACE(absl::StrFormat("$%06x, length %d", address, length));
+      auto read = rom->Read(Address(address), length);
+      auto view = rom->ReadView(Address(address), length);
+      NSASM_ASSERT_OK(read);
+      NSASM_ASSERT_OK(view);
+      EXPECT_EQ(view->size(), size_t(length));
+      EXPECT_EQ(std::vector<uint8_t>(view->begin(), view->end()), *read);
+    }
+  }
+}
+
+TEST(Rom, ReadViewWrapsAtBank) {
+  auto rom = MakeHiRom();
+  auto view = rom->ReadView(Address(0xc0fffe), 4);
+  NSASM_ASSERT_OK(view);
+  EXPECT_THAT(view->span(), ElementsAre(0x01, 0x00, 0x00, 0x01));
+}
+
+TEST(Rom, ReadViewDoesNotCopy) {
+  auto rom = MakeHiRom();
+  auto first = rom->ReadView(Address(0xc01000), 4);
+  auto second = rom->ReadView(Address(0xc01001), 3);
+  NSASM_ASSERT_OK(first);
+  NSASM_ASSERT_OK(second);
+  // Both views point into the same backing storage.
+  EXPECT_EQ(first->data() + 1, second->data());
+}
+
+TEST(Rom, ReadViewErrors) {
+  auto rom = MakeHiRom();
+  EXPECT_FALSE(rom->ReadView(Address(0x7e0000), 1).ok());
+  EXPECT_FALSE(rom->ReadView(Address(0xc10000), 1).ok());
+  EXPECT_FALSE(rom->ReadView(Address(0xc00000), -1).ok());
+}
+
+TEST(RomAddressMap, MatchesBankLayout) {
+  RomAddressMap lorom(kLoRom);
+  RomAddressMap hirom(kHiRom);
+  RomAddressMap exhirom(kExHiRom);
+
+  auto offset = [](const RomAddressMap& map, int address) -> int {
+    auto result = map.ToRomOffset(Address(address));
+    return result.ok() ? int(*result) : -1;
+  };
+
+  EXPECT_EQ(offset(lorom, 0x008000), 0x000000);
+  EXPECT_EQ(offset(lorom, 0x80ffff), 0x007fff);
+  EXPECT_EQ(offset(lorom, 0x818000), 0x008000);
+  EXPECT_EQ(offset(lorom, 0xc08000), 0x200000);
+  EXPECT_EQ(offset(lorom, 0x407fff), -1);
+  EXPECT_EQ(offset(lorom, 0x007fff), -1);
+
+  EXPECT_EQ(offset(hirom, 0xc00000), 0x000000);
+  EXPECT_EQ(offset(hirom, 0xc12345), 0x012345);
+  EXPECT_EQ(offset(hirom, 0x018000), 0x018000);
+  EXPECT_EQ(offset(hirom, 0x417fff), 0x017fff);
+  EXPECT_EQ(offset(hirom, 0x017fff), -1);
+
+  EXPECT_EQ(offset(exhirom, 0xc00000), 0x000000);
+  EXPECT_EQ(offset(exhirom, 0xff8000), 0x3f8000);
+  EXPECT_EQ(offset(exhirom, 0x400000), 0x400000);
+  EXPECT_EQ(offset(exhirom, 0x3f8000), 0x7f8000);
+
+  for (const RomAddressMap* map : {&lorom, &hirom, &exhirom}) {
+    EXPECT_EQ(offset(*map, 0x7e0000), -1);
+    EXPECT_EQ(offset(*map, 0x7fffff), -1);
+    EXPECT_EQ(offset(*map, 0x802100), -1);
+  }
+}
+
+TEST(RomAddressMap, ToRomRuns) {
+  RomAddressMap map(kHiRom);
+  const std::vector<uint8_t> data = {1, 2, 3, 4};
+  // Writes wrap within a bank.
+  auto runs = map.ToRomRuns(Address(0xc0fffe), data, 0x400000);
+  NSASM_ASSERT_OK(runs);
+  ASSERT_EQ(runs->size(), 2);
+  EXPECT_EQ((*runs)[0].offset, 0xfffe);
+  EXPECT_THAT((*runs)[0].data, ElementsAre(1, 2));
+  EXPECT_EQ((*runs)[1].offset, 0);
+  EXPECT_THAT((*runs)[1].data, ElementsAre(3, 4));
+
+  runs = map.ToRomRuns(Address(0xc01234), data, 0x400000);
+  NSASM_ASSERT_OK(runs);
+  ASSERT_EQ(runs->size(), 1);
+  EXPECT_EQ((*runs)[0].offset, 0x1234);
+
+  EXPECT_FALSE(map.ToRomRuns(Address(0xfffffe), data, 0x3fffff).ok());
+  EXPECT_FALSE(map.ToRomRuns(Address(0x7e0000), data, 0x400000).ok());
+}
+
+TEST(RomAddressMap, ErrorMessages) {
+  RomAddressMap lorom(kLoRom);
+  EXPECT_THAT(lorom.ToRomOffset(Address(0x7e1234)).error().ToString(),
+              testing::HasSubstr("WRAM"));
+  EXPECT_THAT(lorom.ToRomOffset(Address(0x002100)).error().ToString(),
+              testing::HasSubstr("non-CART"));
+  EXPECT_THAT(lorom.ToRomOffset(Address(0x401234)).error().ToString(),
+              testing::HasSubstr("Invalid LoRom"));
+}
+
+TEST(RomIdentityTest, StopsAtFirstMismatch) {
+  RomIdentityTest identity(MakeHiRom());
+  // $c01000 holds 10 11 12 13.
+  NSASM_EXPECT_OK(identity.Write(Address(0xc01000), {0x10, 0x11, 0x12}));
+  auto result = identity.Write(Address(0xc01000), {0x10, 0x00, 0x12, 0x00});
+  ASSERT_FALSE(result.ok());
+  EXPECT_THAT(result.error().ToString(),
+              testing::HasSubstr("Wrote 0x00 to $c01001, expected 0x11"));
+  EXPECT_TRUE(identity.Mismatches().empty());
+}
+
+TEST(RomIdentityTest, CollectsMismatches) {
+  RomIdentityTest identity(MakeHiRom(), RomIdentityTest::kCollectMismatches);
+  // $c01000 holds 10 11 12 13; $c0fffe holds 01 00, wrapping to 00 01.
+  NSASM_EXPECT_OK(identity.Write(Address(0xc01000), {0x10, 0x00, 0x00, 0x13}));
+  NSASM_EXPECT_OK(identity.Write(Address(0xc01000), {0x00, 0x11, 0x12, 0x00}));
+  // Continues the previous mismatch.
+  NSASM_EXPECT_OK(identity.Write(Address(0xc01004), {0x00, 0x15}));
+  NSASM_EXPECT_OK(identity.Write(Address(0xc0fffe), {0x01, 0xaa, 0x00, 0x00}));
+  EXPECT_FALSE(identity.Write(Address(0x7e0000), {0x00}).ok());
+
+  const auto& mismatches = identity.Mismatches();
+  ASSERT_EQ(mismatches.size(), 5u);
+  EXPECT_EQ(mismatches[0].address, Address(0xc01001));
+  EXPECT_THAT(mismatches[0].written, ElementsAre(0x00, 0x00));
+  EXPECT_THAT(mismatches[0].expected, ElementsAre(0x11, 0x12));
+  EXPECT_EQ(mismatches[1].address, Address(0xc01000));
+  EXPECT_THAT(mismatches[1].written, ElementsAre(0x00));
+  EXPECT_EQ(mismatches[2].address, Address(0xc01003));
+  EXPECT_THAT(mismatches[2].written, ElementsAre(0x00, 0x00));
+  EXPECT_THAT(mismatches[2].expected, ElementsAre(0x13, 0x14));
+  EXPECT_EQ(mismatches[3].address, Address(0xc0ffff));
+  EXPECT_THAT(mismatches[3].written, ElementsAre(0xaa));
+  EXPECT_THAT(mismatches[3].expected, ElementsAre(0x00));
+  EXPECT_EQ(mismatches[4].address, Address(0xc00001));
+  EXPECT_THAT(mismatches[4].written, ElementsAre(0x00));
+  EXPECT_THAT(mismatches[4].expected, ElementsAre(0x01));
+}
+
+TEST(RomOverwriter, WritesThroughMapping) {
+  RomOverwriter overwriter(MakeHiRom());
+  std::vector<uint8_t> bytes = {1, 2, 3, 4};
+  NSASM_EXPECT_OK(overwriter.Write(Address(0xc01000), bytes));
+  NSASM_EXPECT_OK(overwriter.Write(Address(0xc0fffe), bytes));
+  EXPECT_FALSE(overwriter.Write(Address(0xc10000), bytes).ok());
+  EXPECT_FALSE(overwriter.Write(Address(0x7e0000), bytes).ok());
+}
+
+// Computes a SNES header checksum the way emulators do, recursively
+// mirroring the part of the ROM past the largest power of two.
+uint16_t MirroredSum(const uint8_t* start, size_t* length, size_t mask) {
+  while (!(*length & mask) && mask) {
+    mask >>= 1;
+  }
+  uint16_t part1 = 0;
+  for (size_t i = 0; i < mask; ++i) {
+    part1 += start[i];
+  }
+  uint16_t part2 = 0;
+  size_t next_length = *length - mask;
+  if (next_length) {
+    part2 = MirroredSum(start + mask, &next_length, mask >> 1);
+    while (next_length < mask) {
+      next_length += next_length;
+      part2 += part2;
+    }
+    *length = mask + mask;
+  }
+  return part1 + part2;
+}
+
+uint16_t ExpectedChecksum(const std::vector<uint8_t>& data) {
+  size_t length = data.size();
+  return MirroredSum(data.data(), &length, 0x800000);
+}
+
+// Fills in a correct checksum and complement for the header at `offset`.
+void FixChecksum(std::vector<uint8_t>* data, size_t offset) {
+  (*data)[offset] = (*data)[offset + 1] = 0xff;
+  (*data)[offset + 2] = (*data)[offset + 3] = 0x00;
+  const uint16_t checksum = ExpectedChecksum(*data);
+  (*data)[offset] = ~checksum & 0xff;
+  (*data)[offset + 1] = ~checksum >> 8;
+  (*data)[offset + 2] = checksum & 0xff;
+  (*data)[offset + 3] = checksum >> 8;
+}
+
+TEST(RomOverwriter, MaintainsChecksum) {
+  const std::string path = testing::TempDir() + "/rom_test_checksum.sfc";
+  for (size_t size : {0x10000, 0x30000, 0x28000, 0x2c000, 0x38000}) {
+    SCOPED_TRACE(absl::StrFormat("ROM size 0x%x", size));
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < data.size(); ++i) {
+      data[i] = (i * 7) ^ (i >> 8);
+    }
+    RomOverwriter overwriter(std::make_unique<Rom>(
+        kHiRom, "test.sfc", std::vector<uint8_t>(), std::move(data)));
+    std::vector<uint8_t> bytes = {0xff, 0x00, 0x80, 0x12};
+    for (int address : {0xc01000, 0xc0fffe, 0xc0ffdc, 0xc10123, 0xc28888,
+                        0xc2c123, 0xc30000, 0xc37fff}) {
+      // Writes past the end of the ROM are expected to fail.
+      (void)overwriter.Write(Address(address), bytes);
+    }
+    NSASM_ASSERT_OK(overwriter.CreateFile(path));
+    auto written = ReadBinaryFile(path);
+    NSASM_ASSERT_OK(written);
+    const std::vector<uint8_t>& file = *written;
+    const uint16_t complement = file[0xffdc] | (file[0xffdd] << 8);
+    const uint16_t checksum = file[0xffde] | (file[0xffdf] << 8);
+    EXPECT_EQ(checksum, ExpectedChecksum(file));
+    EXPECT_EQ(complement ^ checksum, 0xffff);
+    EXPECT_EQ(overwriter.Checksum(), checksum);
+  }
+  std::remove(path.c_str());
+}
+
+// Returns a 128KiB image with a plausible SNES header at the LoRom location.
+std::vector<uint8_t> MakeLoRomImage() {
+  std::vector<uint8_t> data(0x20000);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = i & 0xff;
+  }
+  FixChecksum(&data, 0x7fdc);
+  return data;
+}
+
+class RomFileTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = testing::TempDir() + "/rom_test.sfc";
+    out_path_ = testing::TempDir() + "/rom_test_out.sfc";
+  }
+  void TearDown() override {
+    std::remove(path_.c_str());
+    std::remove(out_path_.c_str());
+  }
+
+  std::string path_;
+  std::string out_path_;
+};
+
+TEST_F(RomFileTest, LoadsMappedFile) {
+  std::vector<uint8_t> image = MakeLoRomImage();
+  NSASM_ASSERT_OK(WriteBinaryFile(path_, image));
+  auto rom = LoadRomFile(path_);
+  NSASM_ASSERT_OK(rom);
+  EXPECT_EQ((*rom)->Data(), absl::MakeConstSpan(image));
+  auto view = (*rom)->ReadView(Address(0x818000), 2);
+  NSASM_ASSERT_OK(view);
+  EXPECT_THAT(view->span(), ElementsAre(0x00, 0x01));
+}
+
+TEST_F(RomFileTest, SkipsCopierHeader) {
+  std::vector<uint8_t> image(0x200, 0xee);
+  std::vector<uint8_t> data = MakeLoRomImage();
+  image.insert(image.end(), data.begin(), data.end());
+  NSASM_ASSERT_OK(WriteBinaryFile(path_, image));
+  auto rom = LoadRomFile(path_);
+  NSASM_ASSERT_OK(rom);
+  EXPECT_EQ((*rom)->Data(), absl::MakeConstSpan(data));
+
+  // The header is preserved when writing a new file.
+  RomOverwriter overwriter(*std::move(rom));
+  NSASM_ASSERT_OK(overwriter.CreateFile(out_path_));
+  EXPECT_EQ(*ReadBinaryFile(out_path_), image);
+}
+
+TEST_F(RomFileTest, RejectsBadFiles) {
+  EXPECT_FALSE(LoadRomFile(path_).ok());
+  // Not a multiple of the page size
+  NSASM_ASSERT_OK(WriteBinaryFile(path_, std::vector<uint8_t>(0x20100)));
+  EXPECT_FALSE(LoadRomFile(path_).ok());
+  // No recognizable header
+  NSASM_ASSERT_OK(WriteBinaryFile(path_, std::vector<uint8_t>(0x20000)));
+  EXPECT_FALSE(LoadRomFile(path_).ok());
+}
+
+TEST_F(RomFileTest, OverwriterLeavesSourceFileAlone) {
+  const std::vector<uint8_t> image = MakeLoRomImage();
+  NSASM_ASSERT_OK(WriteBinaryFile(path_, image));
+  auto rom = LoadRomFile(path_);
+  NSASM_ASSERT_OK(rom);
+  RomOverwriter overwriter(*std::move(rom));
+  std::vector<uint8_t> bytes = {0xaa, 0xbb};
+  NSASM_ASSERT_OK(overwriter.Write(Address(0x818000), bytes));
+  EXPECT_EQ(*ReadBinaryFile(path_), image);
+
+  // Writing over the mapped file itself is safe.
+  NSASM_ASSERT_OK(overwriter.CreateFile(path_));
+  std::vector<uint8_t> expected = image;
+  expected[0x8000] = 0xaa;
+  expected[0x8001] = 0xbb;
+  FixChecksum(&expected, 0x7fdc);
+  EXPECT_EQ(*ReadBinaryFile(path_), expected);
+}
+
+TEST_F(RomFileTest, CloneOutlivesSourceFile) {
+  const std::vector<uint8_t> image = MakeLoRomImage();
+  NSASM_ASSERT_OK(WriteBinaryFile(path_, image));
+  auto rom = LoadRomFile(path_);
+  NSASM_ASSERT_OK(rom);
+  std::unique_ptr<Rom> clone = (*rom)->Clone();
+
+  RomOverwriter overwriter(*std::move(rom));
+  std::vector<uint8_t> bytes = {0xaa, 0xbb};
+  NSASM_ASSERT_OK(overwriter.Write(Address(0x818000), bytes));
+  NSASM_ASSERT_OK(overwriter.CreateFile(path_));
+  std::remove(path_.c_str());
+
+  auto read = clone->Read(Address(0x818000), 2);
+  NSASM_ASSERT_OK(read);
+  EXPECT_THAT(*read, ElementsAre(image[0x8000], image[0x8001]));
+  EXPECT_EQ(std::vector<uint8_t>(clone->Data().begin(), clone->Data().end()),
+            image);
+}
+
+}  // namespace
+}  // namespace nsasm
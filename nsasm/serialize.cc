@@ -0,0 +1,151 @@
+#include "nsasm/serialize.h"
+
+#include <array>
+#include <cstdio>
+#include <memory>
+
+namespace nsasm {
+
+void ByteWriter::WriteU16(uint16_t value) {
+  WriteU8(value & 0xff);
+  WriteU8(value >> 8);
+}
+
+void ByteWriter::WriteU32(uint32_t value) {
+  WriteU16(value & 0xffff);
+  WriteU16(value >> 16);
+}
+
+void ByteWriter::WriteU64(uint64_t value) {
+  WriteU32(value & 0xffffffff);
+  WriteU32(value >> 32);
+}
+
+void ByteWriter::WriteString(std::string_view value) {
+  WriteU32(value.size());
+  data_.insert(data_.end(), value.begin(), value.end());
+}
+
+uint8_t ByteReader::ReadU8() {
+  if (!ok_ || pos_ >= data_.size()) {
+    ok_ = false;
+    return 0;
+  }
+  return data_[pos_++];
+}
+
+uint16_t ByteReader::ReadU16() {
+  uint16_t lo = ReadU8();
+  uint16_t hi = ReadU8();
+  return lo | (hi << 8);
+}
+
+uint32_t ByteReader::ReadU32() {
+  uint32_t lo = ReadU16();
+  uint32_t hi = ReadU16();
+  return lo | (hi << 16);
+}
+
+uint64_t ByteReader::ReadU64() {
+  uint64_t lo = ReadU32();
+  uint64_t hi = ReadU32();
+  return lo | (hi << 32);
+}
+
+std::string ByteReader::ReadString() {
+  uint32_t size = ReadU32();
+  if (!ok_ || size > data_.size() - pos_) {
+    ok_ = false;
+    return std::string();
+  }
+  std::string result(reinterpret_cast<const char*>(data_.data() + pos_), size);
+  pos_ += size;
+  return result;
+}
+
+uint64_t Fnv1a(absl::Span<const uint8_t> data, uint64_t hash) {
+  for (uint8_t byte : data) {
+    hash ^= byte;
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+uint32_t Crc32(absl::Span<const uint8_t> data, uint32_t crc) {
+  static const auto* table = [] {
+    auto* table = new std::array<uint32_t, 256>;
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t value = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        value = (value >> 1) ^ ((value & 1) ? 0xedb88320 : 0);
+      }
+      (*table)[i] = value;
+    }
+    return table;
+  }();
+  crc = ~crc;
+  for (uint8_t byte : data) {
+    crc = (*table)[(crc ^ byte) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+namespace {
+
+// Closes the file when it goes out of scope.
+using FileHandle = std::unique_ptr<FILE, int (*)(FILE*)>;
+
+FileHandle OpenFile(const std::string& path, const char* mode) {
+  return FileHandle(fopen(path.c_str(), mode), &fclose);
+}
+
+}  // namespace
+
+ErrorOr<std::vector<uint8_t>> ReadBinaryFile(const std::string& path) {
+  FileHandle f = OpenFile(path, "rb");
+  if (!f) {
+    return Error("Failed to open file").SetLocation(path);
+  }
+  std::vector<uint8_t> data;
+  uint8_t buffer[0x10000];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), f.get())) > 0) {
+    data.insert(data.end(), buffer, buffer + read);
+  }
+  if (ferror(f.get())) {
+    return Error("Failed to read file").SetLocation(path);
+  }
+  return data;
+}
+
+ErrorOr<void> WriteBinaryFile(const std::string& path,
+                              absl::Span<const uint8_t> data) {
+  return WriteBinaryFilePieces(path, {data});
+}
+
+ErrorOr<void> WriteBinaryFilePieces(
+    const std::string& path,
+    absl::Span<const absl::Span<const uint8_t>> pieces) {
+  const std::string temp_path = path + ".tmp";
+  FileHandle f = OpenFile(temp_path, "wb");
+  if (!f) {
+    return Error("Failed to open file for write").SetLocation(temp_path);
+  }
+  bool written = true;
+  for (absl::Span<const uint8_t> piece : pieces) {
+    written = written &&
+              fwrite(piece.data(), 1, piece.size(), f.get()) == piece.size();
+  }
+  // Close explicitly, since a failure to flush is a failure to write.
+  if (fclose(f.release()) != 0 || !written) {
+    std::remove(temp_path.c_str());
+    return Error("Failed to write file").SetLocation(temp_path);
+  }
+  if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    std::remove(temp_path.c_str());
+    return Error("Failed to replace file").SetLocation(path);
+  }
+  return {};
+}
+
+}  // namespace nsasm
@@ -0,0 +1,99 @@
+#ifndef NSASM_SERIALIZE_H_
+#define NSASM_SERIALIZE_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "nsasm/error.h"
+
+namespace nsasm {
+
+// Helpers for nsasm's binary cache files.  All values are little-endian.
+
+// Appends values to a growing byte buffer.
+class ByteWriter {
+ public:
+  void WriteU8(uint8_t value) { data_.push_back(value); }
+  void WriteU16(uint16_t value);
+  void WriteU32(uint32_t value);
+  void WriteU64(uint64_t value);
+  // Writes a length-prefixed string.
+  void WriteString(std::string_view value);
+
+  const std::vector<uint8_t>& Data() const { return data_; }
+
+ private:
+  std::vector<uint8_t> data_;
+};
+
+// Reads values back out of a buffer written by ByteWriter.
+//
+// Reading past the end of the buffer returns zeros and puts the reader into a
+// failed state, as does calling Fail() on malformed data.  Callers can read a
+// whole structure and then check ok() once at the end.
+class ByteReader {
+ public:
+  explicit ByteReader(absl::Span<const uint8_t> data) : data_(data) {}
+
+  uint8_t ReadU8();
+  uint16_t ReadU16();
+  uint32_t ReadU32();
+  uint64_t ReadU64();
+  std::string ReadString();
+
+  bool ok() const { return ok_; }
+  bool AtEnd() const { return pos_ == data_.size(); }
+  void Fail() { ok_ = false; }
+
+ private:
+  absl::Span<const uint8_t> data_;
+  size_t pos_ = 0;
+  bool ok_ = true;
+};
+
+// Reads an enum value written with WriteU16().  Marks `in` as failed, and
+// returns `max`, if the value is larger than `max`.
+template <typename Enum>
+Enum ReadEnum(ByteReader* in, Enum max) {
+  uint16_t value = in->ReadU16();
+  if (value > max) {
+    in->Fail();
+    return max;
+  }
+  return Enum(value);
+}
+
+// 64-bit FNV-1a hash.  Pass a previous result as `hash` to continue hashing
+// more data.
+constexpr uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ull;
+uint64_t Fnv1a(absl::Span<const uint8_t> data,
+               uint64_t hash = kFnvOffsetBasis);
+inline uint64_t Fnv1a(std::string_view data, uint64_t hash = kFnvOffsetBasis) {
+  return Fnv1a(absl::Span<const uint8_t>(
+                   reinterpret_cast<const uint8_t*>(data.data()), data.size()),
+               hash);
+}
+
+// CRC-32 (as used by zlib, PNG and BPS patches).  Pass a previous result as
+// `crc` to continue checksumming more data.
+uint32_t Crc32(absl::Span<const uint8_t> data, uint32_t crc = 0);
+
+// Reads an entire binary file into memory.
+ErrorOr<std::vector<uint8_t>> ReadBinaryFile(const std::string& path);
+
+// Writes an entire binary file.  The data is written to a temporary file
+// which is then renamed into place, so readers never see a partial file.
+ErrorOr<void> WriteBinaryFile(const std::string& path,
+                              absl::Span<const uint8_t> data);
+
+// As above, writing the concatenation of `pieces`.
+ErrorOr<void> WriteBinaryFilePieces(
+    const std::string& path,
+    absl::Span<const absl::Span<const uint8_t>> pieces);
+
+}  // namespace nsasm
+
+#endif  // NSASM_SERIALIZE_H_
@@ -0,0 +1,71 @@
+#include "nsasm/serialize.h"
+
+#include "gtest/gtest.h"
+
+namespace nsasm {
+namespace {
+
+TEST(Serialize, RoundTrip) {
+  ByteWriter writer;
+  writer.WriteU8(0x12);
+  writer.WriteU16(0x3456);
+  writer.WriteU32(0x789abcde);
+  writer.WriteU64(0x0123456789abcdefull);
+  writer.WriteString("hello");
+  writer.WriteString("");
+  EXPECT_EQ(writer.Data().size(), 1 + 2 + 4 + 8 + 9 + 4);
+  // Little-endian
+  EXPECT_EQ(writer.Data()[1], 0x56);
+  EXPECT_EQ(writer.Data()[2], 0x34);
+
+  ByteReader reader(writer.Data());
+  EXPECT_EQ(reader.ReadU8(), 0x12);
+  EXPECT_EQ(reader.ReadU16(), 0x3456);
+  EXPECT_EQ(reader.ReadU32(), 0x789abcde);
+  EXPECT_EQ(reader.ReadU64(), 0x0123456789abcdefull);
+  EXPECT_EQ(reader.ReadString(), "hello");
+  EXPECT_EQ(reader.ReadString(), "");
+  EXPECT_TRUE(reader.AtEnd());
+  EXPECT_TRUE(reader.ok());
+}
+
+TEST(Serialize, ReadPastEnd) {
+  ByteWriter writer;
+  writer.WriteU16(0x1234);
+  writer.WriteU32(100);  // string length, with no string data
+
+  ByteReader reader(writer.Data());
+  EXPECT_EQ(reader.ReadU32(), 0x00641234);
+  EXPECT_TRUE(reader.ok());
+  EXPECT_EQ(reader.ReadU32(), 0);
+  EXPECT_FALSE(reader.ok());
+
+  ByteReader string_reader(writer.Data());
+  string_reader.ReadU16();
+  EXPECT_EQ(string_reader.ReadString(), "");
+  EXPECT_FALSE(string_reader.ok());
+}
+
+TEST(Serialize, Fnv1a) {
+  // Published FNV-1a test vectors.
+  EXPECT_EQ(Fnv1a(""), 0xcbf29ce484222325ull);
+  EXPECT_EQ(Fnv1a("a"), 0xaf63dc4c8601ec8cull);
+  EXPECT_EQ(Fnv1a("foobar"), 0x85944171f73967e8ull);
+  // Hashing can be continued across calls.
+  EXPECT_EQ(Fnv1a("bar", Fnv1a("foo")), Fnv1a("foobar"));
+}
+
+TEST(Serialize, Crc32) {
+  auto bytes = [](std::string_view s) {
+    return absl::Span<const uint8_t>(
+        reinterpret_cast<const uint8_t*>(s.data()), s.size());
+  };
+  // Standard CRC-32 check values.
+  EXPECT_EQ(Crc32(bytes("")), 0u);
+  EXPECT_EQ(Crc32(bytes("123456789")), 0xcbf43926u);
+  // Checksumming can be continued across calls.
+  EXPECT_EQ(Crc32(bytes("6789"), Crc32(bytes("12345"))), 0xcbf43926u);
+}
+
+}  // namespace
+}  // namespace nsasm
@@ -1,7 +1,38 @@
 #include "nsasm/statement.h"
 
+#include <utility>
+
 namespace nsasm {
 
+void Statement::Serialize(ByteWriter* out) const {
+  out->WriteU8(data_.index());
+  switch (data_.index()) {
+    case 0:
+      absl::get<nsasm::Instruction>(data_).Serialize(out);
+      return;
+    case 1:
+    default:
+      absl::get<nsasm::Directive>(data_).Serialize(out);
+      return;
+  }
+}
+
+Statement Statement::Deserialize(ByteReader* in,
+                                 const nsasm::Location& file) {
+  switch (in->ReadU8()) {
+    case 0:
+      return Statement(nsasm::Instruction::Deserialize(in, file));
+    case 1:
+      return Statement(nsasm::Directive::Deserialize(in, file));
+    default: {
+      in->Fail();
+      nsasm::Directive directive;
+      directive.name = D_end;
+      return Statement(std::move(directive));
+    }
+  }
+}
+
 std::string Statement::ToString() const {
   switch (data_.index()) {
     case 0:
@@ -60,8 +60,22 @@ class Statement {
 
   bool IsExitInstruction() const;
 
+  // Binds the names in this statement's arguments (see Expression::Bind()).
+  void Bind(const BindingContext& context) {
+    if (nsasm::Instruction* ins = Instruction()) {
+      ins->Bind(context);
+    } else {
+      Directive()->Bind(context);
+    }
+  }
+
   std::string ToString() const;
 
+  // Writes this statement to a cache file, or reads it back, as with
+  // Instruction::Serialize() and Instruction::Deserialize().
+  void Serialize(ByteWriter* out) const;
+  static Statement Deserialize(ByteReader* in, const nsasm::Location& file);
+
  private:
   absl::variant<nsasm::Instruction, nsasm::Directive> data_;
 };
@@ -0,0 +1,77 @@
+#include "nsasm/symbol.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <shared_mutex>
+
+#include "absl/container/flat_hash_map.h"
+
+namespace nsasm {
+
+namespace {
+
+// Strings are stored in fixed-size chunks that never move, so that str() can
+// read a string without taking the lock.
+constexpr int kChunkBits = 12;
+constexpr uint32_t kChunkSize = 1 << kChunkBits;
+constexpr uint32_t kMaxChunks = 1 << 16;
+
+class SymbolTable {
+ public:
+  SymbolTable() { Intern(""); }
+
+  uint32_t Intern(std::string_view sv) {
+    {
+      std::shared_lock<std::shared_mutex> lock(mutex_);
+      auto it = ids_.find(sv);
+      if (it != ids_.end()) {
+        return it->second;
+      }
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto it = ids_.find(sv);
+    if (it != ids_.end()) {
+      return it->second;
+    }
+    const uint32_t id = size_++;
+    const uint32_t chunk = id >> kChunkBits;
+    if (chunk >= kMaxChunks) {
+      std::abort();
+    }
+    std::string* strings = chunks_[chunk].load(std::memory_order_relaxed);
+    if (!strings) {
+      strings = new std::string[kChunkSize];
+      chunks_[chunk].store(strings, std::memory_order_release);
+    }
+    std::string& stored = strings[id & (kChunkSize - 1)];
+    stored = std::string(sv);
+    ids_[stored] = id;
+    return id;
+  }
+
+  const std::string& Lookup(uint32_t id) const {
+    return chunks_[id >> kChunkBits].load(
+        std::memory_order_acquire)[id & (kChunkSize - 1)];
+  }
+
+ private:
+  std::shared_mutex mutex_;
+  // Keys point into chunks_.
+  absl::flat_hash_map<std::string_view, uint32_t> ids_;
+  uint32_t size_ = 0;
+  std::atomic<std::string*> chunks_[kMaxChunks] = {};
+};
+
+SymbolTable& Table() {
+  static SymbolTable* table = new SymbolTable;
+  return *table;
+}
+
+}  // namespace
+
+Symbol::Symbol(std::string_view sv) : id_(Table().Intern(sv)) {}
+
+const std::string& Symbol::str() const { return Table().Lookup(id_); }
+
+}  // namespace nsasm
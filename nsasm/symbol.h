@@ -0,0 +1,63 @@
+#ifndef NSASM_SYMBOL_H_
+#define NSASM_SYMBOL_H_
+
+#include <compare>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "absl/strings/str_format.h"
+
+namespace nsasm {
+
+// An interned string, used for identifiers and module names.
+//
+// Each distinct spelling is stored once, in a process-wide table, and a Symbol
+// holds only its 32-bit index.  Symbols compare equal and hash by that index,
+// so names can be used as map keys without hashing or copying strings.
+// Ordering is by spelling, so that sorted containers of names don't depend on
+// the order in which names were first seen.
+//
+// Interning is thread-safe.  Interned strings are never freed.
+class Symbol {
+ public:
+  // The empty string.
+  Symbol() : id_(0) {}
+  explicit Symbol(std::string_view sv);
+
+  const std::string& str() const;
+  bool empty() const { return id_ == 0; }
+
+  bool operator==(Symbol rhs) const { return id_ == rhs.id_; }
+  std::strong_ordering operator<=>(Symbol rhs) const {
+    if (id_ == rhs.id_) {
+      return std::strong_ordering::equal;
+    }
+    return str().compare(rhs.str()) < 0 ? std::strong_ordering::less
+                                        : std::strong_ordering::greater;
+  }
+
+  template <typename H>
+  friend H AbslHashValue(H h, Symbol s) {
+    return H::combine(std::move(h), s.id_);
+  }
+
+  friend absl::FormatConvertResult<absl::FormatConversionCharSet::kString>
+  AbslFormatConvert(Symbol s, const absl::FormatConversionSpec&,
+                    absl::FormatSink* sink) {
+    sink->Append(s.str());
+    return {true};
+  }
+
+ private:
+  uint32_t id_;
+};
+
+inline std::ostream& operator<<(std::ostream& os, Symbol s) {
+  return os << s.str();
+}
+
+}  // namespace nsasm
+
+#endif  // NSASM_SYMBOL_H_
@@ -0,0 +1,62 @@
+#include "nsasm/symbol.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_format.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "nsasm/thread_pool.h"
+
+namespace nsasm {
+namespace {
+
+TEST(Symbol, InternsSpellings) {
+  const Symbol a("symbol_test_a");
+  const Symbol b("symbol_test_b");
+  EXPECT_EQ(a, Symbol(std::string("symbol_test_a")));
+  EXPECT_NE(a, b);
+  EXPECT_EQ(a.str(), "symbol_test_a");
+  EXPECT_EQ(absl::StrFormat("'%s'", b), "'symbol_test_b'");
+
+  EXPECT_TRUE(Symbol().empty());
+  EXPECT_EQ(Symbol(""), Symbol());
+  EXPECT_FALSE(a.empty());
+
+  absl::flat_hash_set<Symbol> set = {a, b, Symbol("symbol_test_a")};
+  EXPECT_EQ(set.size(), 2);
+}
+
+TEST(Symbol, OrdersBySpelling) {
+  // Interned in the opposite order to their spelling.
+  const Symbol z("symbol_test_order_z");
+  const Symbol y("symbol_test_order_y");
+  EXPECT_LT(y, z);
+  EXPECT_GT(z, y);
+  EXPECT_LT(Symbol(), y);
+}
+
+TEST(Symbol, ConcurrentInterning) {
+  // Every thread interns the same names, and must agree on each one.
+  constexpr int kNames = 10000;
+  ThreadPool pool(4);
+  std::vector<std::vector<Symbol>> results(8);
+  pool.ParallelFor(results.size(), [&results](int i) {
+    for (int n = 0; n < kNames; ++n) {
+      results[i].push_back(
+          Symbol(absl::StrFormat("symbol_test_%d", (n * (i + 1)) % kNames)));
+    }
+  });
+  for (int i = 0; i < int(results.size()); ++i) {
+    for (int n = 0; n < kNames; ++n) {
+      const Symbol& symbol = results[i][n];
+      ASSERT_EQ(symbol.str(),
+                absl::StrFormat("symbol_test_%d", (n * (i + 1)) % kNames));
+      ASSERT_EQ(symbol, Symbol(symbol.str()));
+    }
+  }
+}
+
+}  // namespace
+}  // namespace nsasm
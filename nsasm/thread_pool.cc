@@ -0,0 +1,129 @@
+#include "nsasm/thread_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace nsasm {
+
+ThreadPool::ThreadPool(int num_threads) {
+  if (num_threads < 1) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    queues_.push_back(std::make_unique<TaskQueue>());
+  }
+  // Worker 0 is whichever thread calls ParallelFor().
+  for (int i = 1; i < num_threads; ++i) {
+    threads_.emplace_back([this, i] { WorkerLoop(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutting_down_ = true;
+  }
+  work_ready_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ThreadPool::ParallelFor(int count,
+                             const std::function<void(int)>& task) {
+  if (count <= 0) {
+    return;
+  }
+  if (threads_.empty() || count == 1) {
+    for (int i = 0; i < count; ++i) {
+      task(i);
+    }
+    return;
+  }
+
+  // Deal the tasks out in contiguous blocks, so that neighboring tasks tend
+  // to run on the same thread.
+  const int num_workers = NumThreads();
+  for (int worker = 0; worker < num_workers; ++worker) {
+    const int begin = int64_t(count) * worker / num_workers;
+    const int end = int64_t(count) * (worker + 1) / num_workers;
+    TaskQueue& queue = *queues_[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    for (int i = begin; i < end; ++i) {
+      queue.indices.push_back(i);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    busy_workers_ = num_workers - 1;
+    ++generation_;
+  }
+  work_ready_.notify_all();
+
+  RunTasks(0, task);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  work_done_.wait(lock, [this] { return busy_workers_ == 0; });
+  task_ = nullptr;
+}
+
+void ThreadPool::WorkerLoop(int worker) {
+  int seen_generation = 0;
+  while (true) {
+    const std::function<void(int)>* task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_ready_.wait(lock, [this, seen_generation] {
+        return shutting_down_ || generation_ != seen_generation;
+      });
+      if (shutting_down_) {
+        return;
+      }
+      seen_generation = generation_;
+      task = task_;
+    }
+    RunTasks(worker, *task);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--busy_workers_ == 0) {
+        work_done_.notify_all();
+      }
+    }
+  }
+}
+
+void ThreadPool::RunTasks(int worker, const std::function<void(int)>& task) {
+  int index;
+  while (PopTask(worker, &index) || StealTask(worker, &index)) {
+    task(index);
+  }
+}
+
+bool ThreadPool::PopTask(int worker, int* index) {
+  TaskQueue& queue = *queues_[worker];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.indices.empty()) {
+    return false;
+  }
+  *index = queue.indices.front();
+  queue.indices.pop_front();
+  return true;
+}
+
+bool ThreadPool::StealTask(int thief, int* index) {
+  const int num_workers = NumThreads();
+  for (int offset = 1; offset < num_workers; ++offset) {
+    TaskQueue& queue = *queues_[(thief + offset) % num_workers];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.indices.empty()) {
+      *index = queue.indices.back();
+      queue.indices.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace nsasm
@@ -0,0 +1,68 @@
+#ifndef NSASM_THREAD_POOL_H_
+#define NSASM_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nsasm {
+
+// A fixed set of threads for running batches of independent tasks.
+//
+// Each thread has its own queue of tasks.  A thread that runs out of work
+// steals from the back of another thread's queue, so batches of uneven tasks
+// (like subroutines of wildly different sizes) still balance across threads.
+class ThreadPool {
+ public:
+  // Creates a pool that runs tasks on `num_threads` threads, counting the
+  // thread that calls ParallelFor().  A value less than 1 selects the number
+  // of hardware threads.
+  explicit ThreadPool(int num_threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int NumThreads() const { return int(queues_.size()); }
+
+  // Calls `task(i)` for every i in [0, count), and returns once all calls have
+  // finished.  Calls may run concurrently, in any order.  The calling thread
+  // takes part in the work.
+  //
+  // Not reentrant: `task` must not call ParallelFor() on the same pool.
+  void ParallelFor(int count, const std::function<void(int)>& task);
+
+ private:
+  struct TaskQueue {
+    std::mutex mutex;
+    std::deque<int> indices;
+  };
+
+  void WorkerLoop(int worker);
+
+  // Runs tasks from this worker's own queue, then steals from the others,
+  // until no queued tasks remain.
+  void RunTasks(int worker, const std::function<void(int)>& task);
+  bool PopTask(int worker, int* index);
+  bool StealTask(int thief, int* index);
+
+  std::vector<std::unique_ptr<TaskQueue>> queues_;
+  std::vector<std::thread> threads_;
+
+  // Guards the fields below, which hand batches to the worker threads.
+  std::mutex mutex_;
+  std::condition_variable work_ready_;
+  std::condition_variable work_done_;
+  const std::function<void(int)>* task_ = nullptr;
+  int generation_ = 0;
+  int busy_workers_ = 0;
+  bool shutting_down_ = false;
+};
+
+}  // namespace nsasm
+
+#endif  // NSASM_THREAD_POOL_H_
@@ -0,0 +1,47 @@
+#include "nsasm/thread_pool.h"
+
+#include <atomic>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace nsasm {
+namespace {
+
+TEST(ThreadPool, RunsEveryTaskOnce) {
+  ThreadPool pool(4);
+  EXPECT_EQ(pool.NumThreads(), 4);
+  for (int count : {0, 1, 3, 100, 1000}) {
+    std::vector<std::atomic<int>> runs(count);
+    pool.ParallelFor(count, [&runs](int i) { ++runs[i]; });
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(runs[i], 1) << "task " << i << " of " << count;
+    }
+  }
+}
+
+TEST(ThreadPool, BalancesUnevenTasks) {
+  // All of the expensive tasks are dealt to the first thread's queue; the
+  // other threads steal them once their own cheap tasks run out.
+  ThreadPool pool(4);
+  std::atomic<int> total(0);
+  pool.ParallelFor(64, [&total](int i) {
+    int work = (i < 16) ? 100000 : 1;
+    for (int j = 0; j < work; ++j) {
+      total.fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+  EXPECT_EQ(total, 16 * 100000 + 48);
+}
+
+TEST(ThreadPool, SingleThread) {
+  ThreadPool pool(1);
+  EXPECT_EQ(pool.NumThreads(), 1);
+  std::vector<int> order;
+  pool.ParallelFor(5, [&order](int i) { order.push_back(i); });
+  EXPECT_THAT(order, testing::ElementsAre(0, 1, 2, 3, 4));
+}
+
+}  // namespace
+}  // namespace nsasm
@@ -46,7 +46,7 @@ std::string Token::ToString() const {
   }
   auto identifier = Identifier();
   if (identifier) {
-    return absl::StrCat("identifier ", *identifier);
+    return absl::StrCat("identifier ", identifier->str());
   }
   auto punctuation = Punctuation();
   if (punctuation) {
@@ -8,6 +8,7 @@
 #include "nsasm/error.h"
 #include "nsasm/mnemonic.h"
 #include "nsasm/numeric_type.h"
+#include "nsasm/symbol.h"
 
 namespace nsasm {
 
@@ -34,6 +35,8 @@ std::string ToString(Punctuation p);
 class Token {
  public:
   explicit Token(const std::string& identifier, Location loc)
+      : value_(Symbol(identifier)), location_(loc) {}
+  explicit Token(Symbol identifier, Location loc)
       : value_(identifier), location_(loc) {}
   explicit Token(int number, Location loc, NumericType type = T_unknown)
       : value_(number), location_(loc), type_(type) {}
@@ -50,9 +53,7 @@ class Token {
   explicit Token(nsasm::EndOfLine eol, Location loc)
       : value_(eol), location_(loc) {}
 
-  const std::string* Identifier() const {
-    return absl::get_if<std::string>(&value_);
-  }
+  const Symbol* Identifier() const { return absl::get_if<Symbol>(&value_); }
   const int* Literal() const { return absl::get_if<int>(&value_); }
   const nsasm::Mnemonic* Mnemonic() const {
     return absl::get_if<nsasm::Mnemonic>(&value_);
@@ -82,7 +83,7 @@ class Token {
   bool operator!=(const Token& rhs) const { return value_ != rhs.value_; }
 
  private:
-  absl::variant<std::string, int, nsasm::Mnemonic, nsasm::Suffix,
+  absl::variant<Symbol, int, nsasm::Mnemonic, nsasm::Suffix,
                 nsasm::DirectiveName, nsasm::Punctuation, nsasm::EndOfLine>
       value_;
   nsasm::Location location_;
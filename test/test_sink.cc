@@ -15,6 +15,14 @@ ErrorOr<void> TestSink::Write(nsasm::Address address,
   return {};
 }
 
+ErrorOr<void> RecordingSink::Write(nsasm::Address address,
+                                   absl::Span<const std::uint8_t> data) {
+  for (size_t i = 0; i < data.size(); ++i) {
+    bytes_[address.AddWrapped(i)] = data[i];
+  }
+  return {};
+}
+
 ErrorOr<void> TestSink::Check() const {
   // Local copy of received map; we will clear it as we go
   std::map<nsasm::Address, std::uint8_t> received = received_;
@@ -30,6 +30,20 @@ class TestSink : public OutputSink {
   std::map<nsasm::Address, std::uint8_t> received_;
 };
 
+// Records every byte written.  Later writes replace earlier ones.
+class RecordingSink : public OutputSink {
+ public:
+  ErrorOr<void> Write(nsasm::Address address,
+                      absl::Span<const std::uint8_t> data) override;
+
+  const std::map<nsasm::Address, std::uint8_t>& Bytes() const {
+    return bytes_;
+  }
+
+ private:
+  std::map<nsasm::Address, std::uint8_t> bytes_;
+};
+
 }  // namespace nsasm
 
 #endif  // TEST_TEST_SINK_H_
@@ -1,32 +1,42 @@
+#include <vector>
+
 #include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
 #include "nsasm/assembler.h"
 #include "nsasm/disassemble.h"
+#include "nsasm/disassembly_cache.h"
 #include "nsasm/rom.h"
+#include "nsasm/serialize.h"
+#include "nsasm/thread_pool.h"
 
 void usage(char* path) {
   absl::PrintF(
-      "Usage: %s <path-to-rom-file> {<path-to-asm-file> ...}\n\n"
+      "Usage: %s [--cache_dir=<dir>] <path-to-rom-file> "
+      "{<path-to-asm-file> ...}\n\n"
       "Assemble the provided .asm files, and validate that their output\n"
       "matches the contents of hte provided ROM.\n\n"
       "On success, start disassembling at all remote jump targets found\n"
-      "in the provided .asm file.\n",
+      "in the provided .asm file.\n\n"
+      "With --cache_dir, disassembly results are saved in the given\n"
+      "directory, and reused by later runs on the same inputs.\n",
       path);
 }
 
-void CombineStates(
-    std::map<nsasm::Address, nsasm::StatusFlags>* targets,
-    const std::map<nsasm::Address, nsasm::StatusFlags>& new_targets) {
-  for (const auto& node : new_targets) {
-    auto it = targets->find(node.first);
-    if (it == targets->end()) {
-      (*targets)[node.first] = node.second;
+int main(int argc, char** argv) {
+  std::string cache_dir;
+  std::vector<char*> args;
+  for (int i = 0; i < argc; ++i) {
+    absl::string_view arg = argv[i];
+    if (absl::ConsumePrefix(&arg, "--cache_dir=")) {
+      cache_dir = std::string(arg);
     } else {
-      it->second |= node.second;
+      args.push_back(argv[i]);
     }
   }
-}
+  argc = args.size();
+  argv = args.data();
 
-int main(int argc, char** argv) {
   if (argc < 3) {
     usage(argv[0]);
     return 0;
@@ -58,26 +68,44 @@ int main(int argc, char** argv) {
   std::map<nsasm::Address, nsasm::ReturnConvention> return_conventions =
       assembler->JumpTargetReturnConventions();
 
-  nsasm::Disassembler disassembler(*std::move(rom));
+  // The identity sink took ownership of the ROM above, so the disassembler
+  // needs its own copy.
+  auto disassembly_rom = nsasm::LoadRomFile(argv[1]);
+  if (!disassembly_rom.ok()) {
+    absl::PrintF("Error loading ROM: %s\n",
+                 disassembly_rom.error().ToString());
+    return 1;
+  }
+  // The results depend on the .asm files as well as the ROM.
+  uint64_t cache_key = nsasm::Fnv1a((*disassembly_rom)->Data());
+  for (const nsasm::File& file : asm_files) {
+    cache_key = nsasm::Fnv1a(file.path(), cache_key);
+    for (const std::string& line : file) {
+      cache_key = nsasm::Fnv1a(line, cache_key);
+      cache_key = nsasm::Fnv1a("\n", cache_key);
+    }
+  }
+
+  nsasm::Disassembler disassembler(*std::move(disassembly_rom));
   disassembler.AddTargetReturnConventions(return_conventions);
 
-  for (int pass = 0; pass < 100; ++pass) {
-    std::map<nsasm::Address, nsasm::StatusFlags> new_seeds;
-    for (const auto& node : seeds) {
-      if (assembler->Contains(node.first)) {
-        // This function is already disassembled in our input.
-        continue;
-      }
-      auto branch_targets = disassembler.Disassemble(node.first, node.second);
-      if (!branch_targets.ok()) {
-        absl::PrintF("; ERROR branching to %s with mode %s\n",
-                     node.first.ToString(), node.second.ToString());
-        absl::PrintF(";   %s\n", branch_targets.error().ToString());
-      } else {
-        CombineStates(&new_seeds, *branch_targets);
-      }
-    }
-    seeds = std::move(new_seeds);
+  auto skip = [&assembler](nsasm::Address address) {
+    // Skip functions already disassembled in our input.
+    return assembler->Contains(address);
+  };
+  nsasm::ThreadPool pool;
+  std::vector<nsasm::Disassembler::SeedError> errors;
+  if (cache_dir.empty()) {
+    errors = disassembler.DisassembleToFixedPoint(seeds, skip, &pool);
+  } else {
+    errors = nsasm::CachedDisassembleToFixedPoint(
+        nsasm::DisassemblyCachePath(cache_dir, cache_key), cache_key,
+        &disassembler, seeds, skip, &pool);
+  }
+  for (const auto& error : errors) {
+    absl::PrintF("; ERROR branching to %s with mode %s\n",
+                 error.address.ToString(), error.flags.ToString());
+    absl::PrintF(";   %s\n", error.error.ToString());
   }
   auto status = disassembler.Cleanup();
   if (!status.ok()) {
@@ -105,13 +133,17 @@ int main(int argc, char** argv) {
       }
       if (value.second.is_entry) {
         absl::PrintF("%-8s .entry %s\n", label,
-                     value.second.current_execution_state.Flags().ToString());
+                     disassembler.State(value.second.current_execution_state)
+                         .Flags()
+                         .ToString());
         label.clear();
       }
       std::string text =
           absl::StrFormat("%-8s %s", label, instruction.ToString());
+      const nsasm::ExecutionState& next_state =
+          disassembler.State(value.second.next_execution_state);
       absl::PrintF("%-35s ; %s %s\n", text, pc.ToString(),
-                   value.second.next_execution_state.Flags().ToString());
+                   next_state.Flags().ToString());
 
       pc = pc.AddWrapped(value.second.instruction.SerializedSize());
     }
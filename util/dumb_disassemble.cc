@@ -43,32 +43,30 @@ int main(int argc, char** argv) {
   nsasm::ExecutionState execution_state(*parsed_flag);
   std::map<nsasm::Address, nsasm::ExecutionState> local_jumps;
   while (true) {
-    auto instruction_data = (*rom)->Read(address, 4);
+    auto instruction_data = (*rom)->ReadView(address, 4);
     if (!instruction_data.ok()) {
       absl::PrintF("%s - ERROR: %s\n", address.ToString(),
                    instruction_data.error().ToString());
       return 1;
     }
-    auto instruction =
-        nsasm::Decode(*instruction_data, execution_state.Flags());
-    if (!instruction.ok()) {
+    nsasm::DecodedOp op;
+    if (!nsasm::DecodeOp(*instruction_data, execution_state.Flags(), &op)) {
+      auto error = nsasm::Decode(*instruction_data, execution_state.Flags());
       absl::PrintF("%s - ERROR: %s\n", address.ToString(),
-                   instruction.error().ToString());
+                   error.error().ToString());
       return 1;
     }
-    int instruction_bytes =
-        nsasm::InstructionLength(instruction->addressing_mode);
-    nsasm::Address next_pc = address.AddWrapped(instruction_bytes);
-    auto status = instruction->Execute(&execution_state);
+    nsasm::Instruction instruction = nsasm::ToInstruction(op);
+    nsasm::Address next_pc = address.AddWrapped(op.length);
+    auto status = instruction.Execute(&execution_state);
     if (!status.ok()) {
       absl::PrintF("%s - ERROR: %s\n", address.ToString(),
                    status.error().ToString());
       return 1;
     }
     std::string local_branch_target;
-    if (instruction->IsLocalBranch()) {
-      nsasm::Address target = next_pc.AddWrapped(
-          *instruction->arg1.Evaluate(nsasm::NullLookupContext()));
+    if (op.is_local_branch) {
+      nsasm::Address target = next_pc.AddWrapped(op.arg1);
       auto prev_value = local_jumps.find(target);
       local_branch_target = absl::StrFormat(" to %s", target.ToString());
       if (prev_value == local_jumps.end()) {
@@ -79,10 +77,10 @@ int main(int argc, char** argv) {
       }
       local_jumps[target] = execution_state;
     }
-    std::string instruction_string = instruction->ToString();
+    std::string instruction_string = instruction.ToString();
     absl::PrintF("%s - %30s ; %s%s\n", address.ToString(), instruction_string,
                  execution_state.Flags().ToString(), local_branch_target);
-    if (instruction->IsExitInstruction()) {
+    if (op.is_exit) {
       auto next_instruction_it = local_jumps.lower_bound(next_pc);
       if (next_instruction_it == local_jumps.end()) {
         absl::PrintF("End of subroutine.\n");
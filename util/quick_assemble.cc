@@ -1,21 +1,177 @@
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
 #include "absl/strings/match.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
 #include "nsasm/assembler.h"
+#include "nsasm/file_watcher.h"
+#include "nsasm/patch.h"
 #include "nsasm/rom.h"
 
 // Test utility to exercise assembly
 
 void usage(char* path) {
   absl::PrintF(
-      "Usage: %s <path-to-rom-file> <path-to-output> {<path-to-asm-file> "
-      "...}\n\n"
+      "Usage: %s [--all_mismatches] [--cache_dir=<dir>] [--watch] "
+      "<path-to-rom-file> "
+      "<path-to-output> "
+      "{<path-to-asm-file> ...}\n\n"
       "Assembles one or more ASM files, or returns an error message.\n"
       "If path-to-output is `-`, instead check that the asm files make no \n"
-      "changes to the ROM being overwritten.",
+      "changes to the ROM being overwritten.  With --all_mismatches, this \n"
+      "check reports every change instead of stopping at the first one.\n"
+      "If path-to-output ends in .ips or .bps, write a patch in that format\n"
+      "instead of a full ROM.\n\n"
+      "With --cache_dir, parsed asm files are saved in the given directory,\n"
+      "and reused by later runs on unchanged files.\n\n"
+      "With --watch, keep running after assembling, and reassemble and\n"
+      "rewrite the output whenever an asm file changes.  Only the changed\n"
+      "file, and files that use names whose values it changed, are\n"
+      "reassembled.\n",
       path);
 }
 
+// Formats bytes for a mismatch report, eliding all but the first few.
+std::string HexBytes(const std::vector<uint8_t>& bytes) {
+  constexpr size_t kMaxBytes = 8;
+  std::string result;
+  for (size_t i = 0; i < bytes.size() && i < kMaxBytes; ++i) {
+    absl::StrAppendFormat(&result, i ? " %02x" : "%02x", bytes[i]);
+  }
+  if (bytes.size() > kMaxBytes) {
+    absl::StrAppendFormat(&result, " ... (%d bytes)", bytes.size());
+  }
+  return result;
+}
+
+// Returns a sink that assembles over `rom` for writing to `output_path`: a
+// PatchWriter for IPS and BPS output, or a RomOverwriter for a full ROM.
+std::unique_ptr<nsasm::OutputSink> MakeOutputSink(
+    std::unique_ptr<nsasm::Rom> rom, const std::string& output_path) {
+  if (absl::EndsWith(output_path, ".ips") ||
+      absl::EndsWith(output_path, ".bps")) {
+    return absl::make_unique<nsasm::PatchWriter>(std::move(rom));
+  }
+  return absl::make_unique<nsasm::RomOverwriter>(std::move(rom));
+}
+
+// Writes the contents of `sink` to `output_path`, as an IPS or BPS patch or as
+// a full ROM.
+nsasm::ErrorOr<void> WriteOutput(const nsasm::OutputSink& sink,
+                                 const std::string& output_path) {
+  if (absl::EndsWith(output_path, ".ips")) {
+    return dynamic_cast<const nsasm::PatchWriter&>(sink).CreateIpsFile(
+        output_path);
+  }
+  if (absl::EndsWith(output_path, ".bps")) {
+    return dynamic_cast<const nsasm::PatchWriter&>(sink).CreateBpsFile(
+        output_path);
+  }
+  return dynamic_cast<const nsasm::RomOverwriter&>(sink).CreateFile(
+      output_path);
+}
+
+// Assembles `paths` from scratch into `sink`.
+nsasm::ErrorOr<void> AssembleAll(const std::vector<std::string>& paths,
+                                 nsasm::OutputSink* sink,
+                                 nsasm::ThreadPool* pool,
+                                 const std::string& cache_dir,
+                                 nsasm::Assembler* assembler) {
+  std::vector<nsasm::File> asm_files;
+  for (const std::string& path : paths) {
+    auto file = nsasm::OpenFile(path);
+    NSASM_RETURN_IF_ERROR(file);
+    asm_files.push_back(*std::move(file));
+  }
+  *assembler = nsasm::Assembler();
+  NSASM_RETURN_IF_ERROR(assembler->AddAsmFiles(asm_files, pool, cache_dir));
+  return assembler->Assemble(sink, pool);
+}
+
+// Reassembles and rewrites the output each time a file in `paths` changes.
+// The ROM, parsed modules and assembler state stay in memory between builds.
+// `original` is the ROM as it was before anything was assembled over it, and
+// `sink` holds the output of the last build, which succeeded if `assembled`
+// is true.
+int Watch(const std::vector<std::string>& paths, const nsasm::Rom& original,
+          std::unique_ptr<nsasm::OutputSink> sink,
+          const std::string& output_path, nsasm::ThreadPool* pool,
+          const std::string& cache_dir, nsasm::Assembler* assembler,
+          bool assembled) {
+  auto watcher = nsasm::FileWatcher::Create(paths);
+  if (!watcher.ok()) {
+    absl::PrintF("Error watching files: %s\n", watcher.error().ToString());
+    return 1;
+  }
+  absl::PrintF("Watching %d files for changes\n", paths.size());
+  while (true) {
+    std::fflush(stdout);
+    auto changed = (*watcher)->WaitForChanges();
+    if (!changed.ok()) {
+      absl::PrintF("Error watching files: %s\n", changed.error().ToString());
+      return 1;
+    }
+    if (changed->empty()) {
+      continue;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    nsasm::ErrorOr<void> status;
+    if (assembled) {
+      for (const std::string& path : *changed) {
+        auto file = nsasm::OpenFile(path);
+        if (!file.ok()) {
+          status = file.error();
+          break;
+        }
+        status = assembler->Reassemble(*file, original, sink.get(), pool,
+                                       cache_dir);
+        if (!status.ok()) {
+          break;
+        }
+      }
+    } else {
+      // The last build failed, so neither the assembler state nor the output
+      // it left behind can be reused.  Start over from the original ROM.
+      sink = MakeOutputSink(original.Clone(), output_path);
+      status = AssembleAll(paths, sink.get(), pool, cache_dir, assembler);
+    }
+    if (status.ok()) {
+      status = WriteOutput(*sink, output_path);
+    }
+    assembled = status.ok();
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    if (status.ok()) {
+      absl::PrintF("Rebuilt %s in %d ms\n", output_path, elapsed.count());
+    } else {
+      absl::PrintF("Error assembling: %s\n", status.error().ToString());
+    }
+  }
+}
+
 int main(int argc, char** argv) {
+  bool all_mismatches = false;
+  bool watch = false;
+  std::string cache_dir;
+  std::vector<char*> args;
+  for (int i = 0; i < argc; ++i) {
+    absl::string_view arg = argv[i];
+    if (arg == "--all_mismatches") {
+      all_mismatches = true;
+    } else if (arg == "--watch") {
+      watch = true;
+    } else if (absl::ConsumePrefix(&arg, "--cache_dir=")) {
+      cache_dir = std::string(arg);
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  argc = args.size();
+  argv = args.data();
+
   if (argc < 4) {
     usage(argv[0]);
     return 0;
@@ -32,42 +188,66 @@ int main(int argc, char** argv) {
     absl::PrintF("Error: %s given as output path\n", output_path);
     return 1;
   }
+  if (watch && identity_test) {
+    absl::PrintF("Error: --watch requires an output path\n");
+    return 1;
+  }
+
+  // The output may be written over the ROM file itself, so --watch keeps a
+  // copy of the ROM taken before anything is assembled over it or written.
+  std::unique_ptr<nsasm::Rom> original;
+  if (watch) {
+    original = (*rom)->Clone();
+  }
 
   std::unique_ptr<nsasm::OutputSink> sink;
   if (identity_test) {
-    sink = absl::make_unique<nsasm::RomIdentityTest>(std::move(*rom));
+    sink = absl::make_unique<nsasm::RomIdentityTest>(
+        std::move(*rom), all_mismatches
+                             ? nsasm::RomIdentityTest::kCollectMismatches
+                             : nsasm::RomIdentityTest::kStopAtFirstMismatch);
   } else {
-    sink = absl::make_unique<nsasm::RomOverwriter>(std::move(*rom));
+    sink = MakeOutputSink(std::move(*rom), output_path);
   }
 
-  std::vector<nsasm::File> asm_files;
-  for (int arg_index = 3; arg_index < argc; ++arg_index) {
-    auto file = nsasm::OpenFile(argv[arg_index]);
-    if (!file.ok()) {
-      absl::PrintF("Error loading file: %s\n", file.error().ToString());
+  const std::vector<std::string> asm_paths(argv + 3, argv + argc);
+  nsasm::ThreadPool pool;
+  nsasm::Assembler assembler;
+  auto status =
+      AssembleAll(asm_paths, sink.get(), &pool, cache_dir, &assembler);
+  if (!status.ok()) {
+    absl::PrintF("Error assembling: %s\n", status.error().ToString());
+    if (!watch) {
       return 1;
     }
-    asm_files.push_back(*std::move(file));
-  }
-
-  auto assembler = nsasm::Assemble(asm_files, sink.get());
-  if (!assembler.ok()) {
-    absl::PrintF("Error assembling: %s\n", assembler.error().ToString());
-    return 1;
   }
 
   if (identity_test) {
-    auto jump_targets = assembler->JumpTargets();
+    auto jump_targets = assembler.JumpTargets();
     absl::PrintF("%d jump targets found\n", jump_targets.size());
     for (const auto& node : jump_targets) {
       absl::PrintF("  %s %s\n", node.first.ToString(), node.second.ToString());
     }
-  } else {
-    const auto& overwriter = dynamic_cast<const nsasm::RomOverwriter&>(*sink);
-    auto write_status = overwriter.CreateFile(output_path);
+    const auto& mismatches =
+        dynamic_cast<const nsasm::RomIdentityTest&>(*sink).Mismatches();
+    if (!mismatches.empty()) {
+      absl::PrintF("%d mismatching ranges found\n", mismatches.size());
+      for (const auto& mismatch : mismatches) {
+        absl::PrintF("  %s: wrote %s, expected %s\n",
+                     mismatch.address.ToString(), HexBytes(mismatch.written),
+                     HexBytes(mismatch.expected));
+      }
+      return 1;
+    }
+  } else if (status.ok()) {
+    auto write_status = WriteOutput(*sink, output_path);
     if (!write_status.ok()) {
       absl::PrintF("Error writing file: %s\n", write_status.error().ToString());
     }
   }
+  if (watch) {
+    return Watch(asm_paths, *original, std::move(sink), output_path, &pool,
+                 cache_dir, &assembler, status.ok());
+  }
   // assembler.DebugPrint();
 }
\ No newline at end of file
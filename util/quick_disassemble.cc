@@ -1,38 +1,47 @@
 #include <cstdint>
 #include <cstdio>
+#include <vector>
 
 #include "absl/strings/numbers.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
 #include "nsasm/decode.h"
 #include "nsasm/disassemble.h"
+#include "nsasm/disassembly_cache.h"
 #include "nsasm/instruction.h"
 #include "nsasm/rom.h"
+#include "nsasm/serialize.h"
+#include "nsasm/thread_pool.h"
 
 // Test utility to exercise disassembly
 
 void usage(char* path) {
   absl::PrintF(
-      "Usage: %s <path-to-rom> ([@]<snes-hex-address> <mode name>)+\n\n"
+      "Usage: %s [--cache_dir=<dir>] <path-to-rom> "
+      "([@]<snes-hex-address> <mode name>)+\n\n"
       "Disassembles some code starting at the named offset.\n"
       "If the offset begins with @, dereference the 16-bit address at this "
-      "location.\n",
+      "location.\n\n"
+      "With --cache_dir, disassembly results are saved in the given\n"
+      "directory, and reused by later runs on the same ROM.\n",
       path);
 }
 
-void CombineStates(
-    std::map<nsasm::Address, nsasm::StatusFlags>* targets,
-    const std::map<nsasm::Address, nsasm::StatusFlags>& new_targets) {
-  for (const auto& node : new_targets) {
-    auto it = targets->find(node.first);
-    if (it == targets->end()) {
-      (*targets)[node.first] = node.second;
+int main(int argc, char** argv) {
+  std::string cache_dir;
+  std::vector<char*> args;
+  for (int i = 0; i < argc; ++i) {
+    absl::string_view arg = argv[i];
+    if (absl::ConsumePrefix(&arg, "--cache_dir=")) {
+      cache_dir = std::string(arg);
     } else {
-      it->second |= node.second;
+      args.push_back(argv[i]);
     }
   }
-}
+  argc = args.size();
+  argv = args.data();
 
-int main(int argc, char** argv) {
   if (argc < 4) {
     usage(argv[0]);
     return 0;
@@ -70,21 +79,22 @@ int main(int argc, char** argv) {
     seeds.emplace(nsasm::Address(rd_address), *parsed_flag);
   }
 
+  const uint64_t cache_key = nsasm::Fnv1a((*rom)->Data());
   nsasm::Disassembler disassembler(std::move(*rom));
 
-  for (int pass = 0; pass < 100; ++pass) {
-    std::map<nsasm::Address, nsasm::StatusFlags> new_seeds;
-    for (const auto& node : seeds) {
-      auto branch_targets = disassembler.Disassemble(node.first, node.second);
-      if (!branch_targets.ok()) {
-        absl::PrintF("; ERROR branching to %s with mode %s\n",
-                     node.first.ToString(), node.second.ToString());
-        absl::PrintF(";   %s\n", branch_targets.error().ToString());
-      } else {
-        CombineStates(&new_seeds, *branch_targets);
-      }
-    }
-    seeds = std::move(new_seeds);
+  nsasm::ThreadPool pool;
+  std::vector<nsasm::Disassembler::SeedError> errors;
+  if (cache_dir.empty()) {
+    errors = disassembler.DisassembleToFixedPoint(seeds, nullptr, &pool);
+  } else {
+    errors = nsasm::CachedDisassembleToFixedPoint(
+        nsasm::DisassemblyCachePath(cache_dir, cache_key), cache_key,
+        &disassembler, seeds, nullptr, &pool);
+  }
+  for (const auto& error : errors) {
+    absl::PrintF("; ERROR branching to %s with mode %s\n",
+                 error.address.ToString(), error.flags.ToString());
+    absl::PrintF(";   %s\n", error.error.ToString());
   }
   auto status = disassembler.Cleanup();
   if (!status.ok()) {
@@ -112,13 +122,17 @@ int main(int argc, char** argv) {
       }
       if (value.second.is_entry) {
         absl::PrintF("%-8s .entry %s\n", label,
-                     value.second.current_execution_state.Flags().ToString());
+                     disassembler.State(value.second.current_execution_state)
+                         .Flags()
+                         .ToString());
         label.clear();
       }
       std::string text =
           absl::StrFormat("%-8s %s", label, instruction.ToString());
+      const nsasm::ExecutionState& next_state =
+          disassembler.State(value.second.next_execution_state);
       absl::PrintF("%-35s ; %s %s\n", text, pc.ToString(),
-                   value.second.next_execution_state.Flags().ToString());
+                   next_state.Flags().ToString());
 
       pc = pc.AddWrapped(value.second.instruction.SerializedSize());
     }